@@ -20,11 +20,15 @@
 
 #include "audiosource.h"
 #include "videosource.h"
+#include "bskernels.h"
+#include "bsprobes.h"
 #include "version.h"
 #include <algorithm>
 #include <thread>
 #include <cassert>
 #include <iterator>
+#include <cmath>
+#include <limits>
 
 #include "../libp2p/p2p_api.h"
 
@@ -37,6 +41,9 @@ extern "C" {
 }
 
 bool LWAudioDecoder::ReadPacket() {
+    if (SharedPackets)
+        return SharedPackets->ReadPacket(TrackNumber, Packet);
+
     while (av_read_frame(FormatContext, Packet) >= 0) {
         if (Packet->stream_index == TrackNumber)
             return true;
@@ -149,6 +156,7 @@ void LWAudioDecoder::OpenFile(const std::string &SourceFile, int Track, bool Var
 }
 
 LWAudioDecoder::LWAudioDecoder(const std::string &SourceFile, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts, double DrcScale) {
+    BSTraceSpan Trace("open");
     try {
         Packet = av_packet_alloc();
         OpenFile(SourceFile, Track, VariableFormat, Threads, LAVFOpts, DrcScale);
@@ -156,6 +164,7 @@ LWAudioDecoder::LWAudioDecoder(const std::string &SourceFile, int Track, bool Va
         Free();
         throw;
     }
+    BS_PROBE1(audio_decoder_open, TrackNumber);
 }
 
 void LWAudioDecoder::Free() {
@@ -166,6 +175,7 @@ void LWAudioDecoder::Free() {
 }
 
 LWAudioDecoder::~LWAudioDecoder() {
+    BS_PROBE1(audio_decoder_close, TrackNumber);
     Free();
 }
 
@@ -174,6 +184,8 @@ int64_t LWAudioDecoder::GetSourceSize() const {
 }
 
 int64_t LWAudioDecoder::GetSourcePostion() const {
+    if (SharedPackets)
+        return SharedPackets->GetSourcePosition();
     return avio_tell(FormatContext->pb);
 }
 
@@ -181,6 +193,10 @@ int LWAudioDecoder::GetTrack() const {
     return TrackNumber;
 }
 
+void LWAudioDecoder::SetSharedPacketReader(SharedPacketReader *Reader) {
+    SharedPackets = Reader;
+}
+
 int64_t LWAudioDecoder::GetFrameNumber() const {
     return CurrentFrame;
 }
@@ -225,6 +241,7 @@ void LWAudioDecoder::GetAudioProperties(AudioProperties &AP) {
 }
 
 AVFrame *LWAudioDecoder::GetNextFrame() {
+    BSTraceSpan Trace("decode", CurrentFrame);
     if (DecodeSuccess) {
         DecodeSuccess = DecodeNextFrame();
         if (DecodeSuccess) {
@@ -239,6 +256,7 @@ AVFrame *LWAudioDecoder::GetNextFrame() {
 }
 
 bool LWAudioDecoder::SkipFrames(int64_t Count) {
+    BSTraceSpan Trace("skip", CurrentFrame);
     while (Count-- > 0) {
         if (DecodeSuccess) {
             DecodeSuccess = DecodeNextFrame(true);
@@ -296,6 +314,7 @@ const AVFrame *BestAudioFrame::GetAVFrame() const {
 };
 
 static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame) {
+    BSTraceSpan Trace("hash");
     std::array<uint8_t, HashSize> Result;
 
     bool IsPlanar = av_sample_fmt_is_planar(static_cast<AVSampleFormat>(Frame->format));
@@ -321,6 +340,290 @@ static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame) {
     return Result;
 }
 
+std::array<uint8_t, HashSize> GetAudioFrameHash(const AVFrame *Frame) {
+    return GetHash(Frame);
+}
+
+// Sample format conversion, fused into the packing/unpacking copy when an output format is set.
+// The loops are kept trivial so the compiler can vectorize the common contiguous case.
+// Narrowing conversions round to nearest and saturate.
+
+namespace {
+    template<typename T>
+    struct SampleConverter {};
+
+    template<>
+    struct SampleConverter<int16_t> {
+        static int16_t Convert(uint8_t V) { return static_cast<int16_t>((V - 128) * 256); }
+        static int16_t Convert(int16_t V) { return V; }
+        static int16_t Convert(int32_t V) { return static_cast<int16_t>(std::min<int32_t>((V >> 16) + ((V >> 15) & 1), INT16_MAX)); }
+        static int16_t Convert(int64_t V) { return static_cast<int16_t>(std::min<int64_t>((V >> 48) + ((V >> 47) & 1), INT16_MAX)); }
+        static int16_t Convert(float V) {
+            float S = std::min(std::max(V * 32768.0f, -32768.0f), 32767.0f);
+            return static_cast<int16_t>(S + (S >= 0 ? 0.5f : -0.5f));
+        }
+        static int16_t Convert(double V) {
+            double S = std::min(std::max(V * 32768.0, -32768.0), 32767.0);
+            return static_cast<int16_t>(S + (S >= 0 ? 0.5 : -0.5));
+        }
+    };
+
+    template<>
+    struct SampleConverter<int32_t> {
+        static int32_t Convert(uint8_t V) { return static_cast<int32_t>(static_cast<uint32_t>(V - 128) << 24); }
+        static int32_t Convert(int16_t V) { return static_cast<int32_t>(static_cast<uint32_t>(V) << 16); }
+        static int32_t Convert(int32_t V) { return V; }
+        static int32_t Convert(int64_t V) { return static_cast<int32_t>(std::min<int64_t>((V >> 32) + ((V >> 31) & 1), INT32_MAX)); }
+        static int32_t Convert(float V) { return Convert(static_cast<double>(V)); }
+        static int32_t Convert(double V) {
+            double S = std::min(std::max(V * 2147483648.0, -2147483648.0), 2147483647.0);
+            return static_cast<int32_t>(S + (S >= 0 ? 0.5 : -0.5));
+        }
+    };
+
+    template<>
+    struct SampleConverter<float> {
+        static float Convert(uint8_t V) { return (V - 128) * (1.0f / 128); }
+        static float Convert(int16_t V) { return V * (1.0f / 32768); }
+        static float Convert(int32_t V) { return static_cast<float>(V * (1.0 / 2147483648.0)); }
+        static float Convert(int64_t V) { return static_cast<float>(V * (1.0 / 9223372036854775808.0)); }
+        static float Convert(float V) { return V; }
+        static float Convert(double V) { return static_cast<float>(V); }
+    };
+}
+
+template<typename SrcT, typename DstT>
+static void ConvertSamplesT(const uint8_t *Src, size_t SrcStep, uint8_t *Dst, size_t DstStep, size_t Length) {
+    const SrcT *S = reinterpret_cast<const SrcT *>(Src);
+    DstT *D = reinterpret_cast<DstT *>(Dst);
+    if (SrcStep == 1 && DstStep == 1) {
+        for (size_t i = 0; i < Length; i++)
+            D[i] = SampleConverter<DstT>::Convert(S[i]);
+    } else {
+        for (size_t i = 0; i < Length; i++)
+            D[i * DstStep] = SampleConverter<DstT>::Convert(S[i * SrcStep]);
+    }
+}
+
+template<typename DstT>
+static void ConvertSamplesTo(int SrcFormat, const uint8_t *Src, size_t SrcStep, uint8_t *Dst, size_t DstStep, size_t Length) {
+    switch (av_get_packed_sample_fmt(static_cast<AVSampleFormat>(SrcFormat))) {
+        case AV_SAMPLE_FMT_U8:
+            ConvertSamplesT<uint8_t, DstT>(Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_S16:
+            ConvertSamplesT<int16_t, DstT>(Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_S32:
+            ConvertSamplesT<int32_t, DstT>(Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_S64:
+            ConvertSamplesT<int64_t, DstT>(Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_FLT:
+            ConvertSamplesT<float, DstT>(Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_DBL:
+            ConvertSamplesT<double, DstT>(Src, SrcStep, Dst, DstStep, Length);
+            break;
+        default:
+            throw AudioException("Unsupported sample format for conversion");
+    }
+}
+
+// Step is the distance between consecutive samples of the same channel counted in samples
+static void ConvertSamples(int SrcFormat, const uint8_t *Src, size_t SrcStep, int DstFormat, uint8_t *Dst, size_t DstStep, size_t Length) {
+    switch (DstFormat) {
+        case AV_SAMPLE_FMT_S16:
+            ConvertSamplesTo<int16_t>(SrcFormat, Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_S32:
+            ConvertSamplesTo<int32_t>(SrcFormat, Src, SrcStep, Dst, DstStep, Length);
+            break;
+        case AV_SAMPLE_FMT_FLT:
+            ConvertSamplesTo<float>(SrcFormat, Src, SrcStep, Dst, DstStep, Length);
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// Accumulates peak, RMS and EBU R128 loudness during indexing. The K-weighting filter
+// coefficients are derived for the actual sample rate the same way libebur128 does it.
+// Energy is summed in 100ms sub-blocks so the 400ms gating blocks and 3s short-term
+// windows can be assembled from them afterwards.
+
+namespace {
+    class AudioStatisticsCollector {
+    private:
+        static constexpr int64_t ShortTermSubBlocks = 30;
+        static constexpr int64_t GatingSubBlocks = 4;
+
+        struct Biquad {
+            double B0, B1, B2, A1, A2;
+        };
+
+        Biquad Stages[2];
+        std::vector<std::array<double, 4>> State; // transposed direct form II state for both stages
+        std::vector<double> ChannelWeights;
+        std::vector<float> Buffer;
+        std::vector<double> SubBlockEnergy;
+        int64_t SubBlockSize;
+        int64_t Position = 0;
+        double TrackPeak = 0;
+        double TrackSumSquares = 0;
+        int64_t TrackSamples = 0;
+
+        static double EnergyToLoudness(double Energy) {
+            return (Energy > 0) ? (-0.691 + 10 * std::log10(Energy)) : -std::numeric_limits<double>::infinity();
+        }
+
+        void SetChannels(const AVChannelLayout &Layout) {
+            State.assign(Layout.nb_channels, {});
+            ChannelWeights.resize(Layout.nb_channels);
+            for (int i = 0; i < Layout.nb_channels; i++) {
+                switch (av_channel_layout_channel_from_index(&Layout, i)) {
+                    case AV_CHAN_LOW_FREQUENCY:
+                    case AV_CHAN_LOW_FREQUENCY_2:
+                        ChannelWeights[i] = 0;
+                        break;
+                    case AV_CHAN_BACK_LEFT:
+                    case AV_CHAN_BACK_RIGHT:
+                    case AV_CHAN_SIDE_LEFT:
+                    case AV_CHAN_SIDE_RIGHT:
+                        ChannelWeights[i] = 1.41;
+                        break;
+                    default:
+                        ChannelWeights[i] = 1;
+                }
+            }
+        }
+    public:
+        AudioStatisticsCollector(int SampleRate, const AVChannelLayout &Layout) : SubBlockSize(std::max(SampleRate / 10, 1)) {
+            // High shelf
+            double K = std::tan(3.14159265358979323846 * 1681.974450955533 / SampleRate);
+            double Q = 0.7071752369554196;
+            double Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+            double Vb = std::pow(Vh, 0.4996667741545416);
+            double A0 = 1.0 + K / Q + K * K;
+            Stages[0] = { (Vh + Vb * K / Q + K * K) / A0, 2.0 * (K * K - Vh) / A0, (Vh - Vb * K / Q + K * K) / A0, 2.0 * (K * K - 1.0) / A0, (1.0 - K / Q + K * K) / A0 };
+
+            // High pass
+            K = std::tan(3.14159265358979323846 * 38.13547087602444 / SampleRate);
+            Q = 0.5003270373238773;
+            A0 = 1.0 + K / Q + K * K;
+            Stages[1] = { 1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / A0, (1.0 - K / Q + K * K) / A0 };
+
+            SetChannels(Layout);
+        }
+
+        AudioStatistics Process(const AVFrame *F) {
+            int Channels = F->ch_layout.nb_channels;
+            if (Channels != static_cast<int>(State.size()))
+                SetChannels(F->ch_layout);
+
+            bool IsPlanar = av_sample_fmt_is_planar(static_cast<AVSampleFormat>(F->format));
+            size_t BytesPerSample = av_get_bytes_per_sample(static_cast<AVSampleFormat>(F->format));
+            int64_t Length = F->nb_samples;
+            Buffer.resize(Length);
+
+            float FramePeak = 0;
+            double FrameSumSquares = 0;
+
+            for (int c = 0; c < Channels; c++) {
+                if (IsPlanar)
+                    ConvertSamples(F->format, F->extended_data[c], 1, AV_SAMPLE_FMT_FLT, reinterpret_cast<uint8_t *>(Buffer.data()), 1, Length);
+                else
+                    ConvertSamples(F->format, F->extended_data[0] + c * BytesPerSample, Channels, AV_SAMPLE_FMT_FLT, reinterpret_cast<uint8_t *>(Buffer.data()), 1, Length);
+
+                for (int64_t i = 0; i < Length; i++) {
+                    FramePeak = std::max(FramePeak, std::abs(Buffer[i]));
+                    FrameSumSquares += static_cast<double>(Buffer[i]) * Buffer[i];
+                }
+
+                if (ChannelWeights[c] == 0)
+                    continue;
+
+                std::array<double, 4> &Z = State[c];
+                int64_t i = 0;
+                while (i < Length) {
+                    int64_t SubBlock = (Position + i) / SubBlockSize;
+                    int64_t End = std::min(Length, (SubBlock + 1) * SubBlockSize - Position);
+                    if (static_cast<int64_t>(SubBlockEnergy.size()) <= SubBlock)
+                        SubBlockEnergy.resize(SubBlock + 1);
+                    double Energy = 0;
+                    for (; i < End; i++) {
+                        double X = Buffer[i];
+                        for (int s = 0; s < 2; s++) {
+                            double Y = Stages[s].B0 * X + Z[s * 2];
+                            Z[s * 2] = Stages[s].B1 * X - Stages[s].A1 * Y + Z[s * 2 + 1];
+                            Z[s * 2 + 1] = Stages[s].B2 * X - Stages[s].A2 * Y;
+                            X = Y;
+                        }
+                        Energy += X * X;
+                    }
+                    SubBlockEnergy[SubBlock] += ChannelWeights[c] * Energy;
+                }
+            }
+
+            Position += Length;
+            TrackPeak = std::max<double>(TrackPeak, FramePeak);
+            TrackSumSquares += FrameSumSquares;
+            TrackSamples += Length * Channels;
+
+            AudioStatistics Result = { FramePeak, (Length * Channels > 0) ? std::sqrt(FrameSumSquares / (Length * Channels)) : 0, -std::numeric_limits<double>::infinity() };
+
+            int64_t Complete = Position / SubBlockSize;
+            if (Complete > 0) {
+                int64_t First = std::max<int64_t>(Complete - ShortTermSubBlocks, 0);
+                double Energy = 0;
+                for (int64_t j = First; j < Complete; j++)
+                    Energy += SubBlockEnergy[j];
+                Result.Loudness = EnergyToLoudness(Energy / ((Complete - First) * SubBlockSize));
+            }
+
+            return Result;
+        }
+
+        AudioStatistics GetTrackStatistics() const {
+            AudioStatistics Result = { TrackPeak, (TrackSamples > 0) ? std::sqrt(TrackSumSquares / TrackSamples) : 0, -std::numeric_limits<double>::infinity() };
+
+            // Gated integrated loudness from 400ms blocks with 75% overlap
+            std::vector<double> Blocks;
+            int64_t Complete = Position / SubBlockSize;
+            for (int64_t j = 0; j + GatingSubBlocks <= Complete; j++) {
+                double Energy = 0;
+                for (int64_t k = j; k < j + GatingSubBlocks; k++)
+                    Energy += SubBlockEnergy[k];
+                Energy /= GatingSubBlocks * SubBlockSize;
+                if (EnergyToLoudness(Energy) > -70)
+                    Blocks.push_back(Energy);
+            }
+
+            if (Blocks.empty())
+                return Result;
+
+            double Sum = 0;
+            for (const auto &Iter : Blocks)
+                Sum += Iter;
+            double RelativeThreshold = EnergyToLoudness(Sum / Blocks.size()) - 10;
+
+            Sum = 0;
+            size_t Count = 0;
+            for (const auto &Iter : Blocks) {
+                if (EnergyToLoudness(Iter) > RelativeThreshold) {
+                    Sum += Iter;
+                    Count++;
+                }
+            }
+
+            if (Count > 0)
+                Result.Loudness = EnergyToLoudness(Sum / Count);
+            return Result;
+        }
+    };
+}
+
 BestAudioSource::Cache::CacheBlock::CacheBlock(int64_t FrameNumber, AVFrame *Frame) : FrameNumber(FrameNumber), Frame(Frame) {
     assert(Frame->nb_samples > 0);
     for (int i = 0; i < Frame->nb_extended_buf; i++)
@@ -334,6 +637,7 @@ BestAudioSource::Cache::CacheBlock::~CacheBlock() {
 
 void BestAudioSource::Cache::ApplyMaxSize() {
     while (Size > MaxSize) {
+        BSTraceInstant("cache evict", Data.back().FrameNumber);
         Size -= Data.back().Size;
         Data.pop_back();
     }
@@ -366,19 +670,32 @@ void BestAudioSource::Cache::CacheFrame(int64_t FrameNumber, AVFrame *Frame) {
     ApplyMaxSize();
 }
 
-BestAudioFrame *BestAudioSource::Cache::GetFrame(int64_t N) {
+BestAudioSource::Cache::CacheBlock *BestAudioSource::Cache::GetBlock(int64_t N) {
     for (auto Iter = Data.begin(); Iter != Data.end(); ++Iter) {
         if (Iter->FrameNumber == N) {
-            AVFrame *F = Iter->Frame;
             Data.splice(Data.begin(), Data, Iter);
-            return new BestAudioFrame(F);
+            return &Data.front();
         }
     }
     return nullptr;
 }
 
-BestAudioSource::BestAudioSource(const std::string &SourceFile, int Track, int AjustDelay, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, double DrcScale, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress)
-    : Source(SourceFile), AudioTrack(Track), VariableFormat(VariableFormat), Threads(Threads), DrcScale(DrcScale) {
+BestAudioFrame *BestAudioSource::Cache::GetFrame(int64_t N) {
+    CacheBlock *Block = GetBlock(N);
+    BSTraceInstant(Block ? "cache hit" : "cache miss", N);
+    return Block ? new BestAudioFrame(Block->Frame) : nullptr;
+}
+
+std::shared_ptr<const BestAudioFrame> BestAudioSource::Cache::GetFrameRef(int64_t N) {
+    CacheBlock *Block = GetBlock(N);
+    BSTraceInstant(Block ? "cache hit" : "cache miss", N);
+    if (Block && !Block->Ref)
+        Block->Ref = std::make_shared<const BestAudioFrame>(Block->Frame);
+    return Block ? Block->Ref : nullptr;
+}
+
+BestAudioSource::BestAudioSource(const std::string &SourceFile, int Track, int AjustDelay, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, double DrcScale, bool ComputeStatistics, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress, SharedPacketReader *IndexPackets)
+    : Source(SourceFile), AudioTrack(Track), VariableFormat(VariableFormat), Threads(Threads), ComputeStatistics(ComputeStatistics), DrcScale(DrcScale) {
     if (LAVFOpts)
         LAVFOptions = *LAVFOpts;
 
@@ -386,9 +703,16 @@ BestAudioSource::BestAudioSource(const std::string &SourceFile, int Track, int A
 
     Decoder->GetAudioProperties(AP);
     AudioTrack = Decoder->GetTrack();
+    NativeAF = AP.AF;
     
-    if (!ReadAudioTrackIndex(CachePath.empty() ? SourceFile : CachePath)) {
-        if (!IndexTrack(Progress))
+    bool IndexLoaded = ReadAudioTrackIndex(CachePath.empty() ? SourceFile : CachePath);
+    BS_PROBE3(audio_index_load, AudioTrack, IndexLoaded, TrackIndex.Frames.size());
+
+    if (!IndexLoaded) {
+        BS_PROBE1(audio_index_build_start, AudioTrack);
+        bool Indexed = IndexTrack(Progress, IndexPackets);
+        BS_PROBE3(audio_index_build_done, AudioTrack, Indexed, TrackIndex.Frames.size());
+        if (!Indexed)
             throw AudioException("Indexing of '" + SourceFile + "' track #" + std::to_string(AudioTrack) + " failed");
 
         WriteAudioTrackIndex(CachePath.empty() ? SourceFile : CachePath);
@@ -417,10 +741,59 @@ void BestAudioSource::SetSeekPreRoll(int64_t Frames) {
     PreRoll = std::max<int64_t>(Frames, 0);
 }
 
-bool BestAudioSource::IndexTrack(const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress) {
+void BestAudioSource::SetMaxDecoders(int Count) {
+    if (Count < 1 || Count > MaxVideoSources)
+        throw AudioException("MaxDecoders must be between 1 and " + std::to_string(MaxVideoSources));
+    MaxDecoders = Count;
+    for (int i = MaxDecoders; i < MaxVideoSources; i++)
+        Decoders[i].reset();
+}
+
+void BestAudioSource::SetAccessLog(const std::string &Filename) {
+    RequestLog.reset();
+    if (!Filename.empty()) {
+        RequestLog.reset(new AccessLog(Filename, false, AudioTrack));
+        if (!RequestLog->IsOpen()) {
+            RequestLog.reset();
+            throw AudioException("Couldn't open access log '" + Filename + "' for writing");
+        }
+    }
+}
+
+const DecodeCounters &BestAudioSource::GetDecodeCounters() const {
+    return Counters;
+}
+
+void BestAudioSource::ResetDecodeCounters() {
+    Counters = {};
+}
+
+void BestAudioSource::SetOutputFormat(bool Float, int Bits) {
+    if (Bits == 0) {
+        OutputSampleFormat = AV_SAMPLE_FMT_NONE;
+        AP.AF = NativeAF;
+        return;
+    }
+
+    if (Float && Bits == 32)
+        OutputSampleFormat = AV_SAMPLE_FMT_FLT;
+    else if (!Float && Bits == 16)
+        OutputSampleFormat = AV_SAMPLE_FMT_S16;
+    else if (!Float && Bits == 32)
+        OutputSampleFormat = AV_SAMPLE_FMT_S32;
+    else
+        throw AudioException("Unsupported output format, only 16 and 32 bit integer and 32 bit float samples can be produced");
+
+    AP.AF.Set(OutputSampleFormat, 0);
+}
+
+bool BestAudioSource::IndexTrack(const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress, SharedPacketReader *Packets) {
+    BSTraceSpan Trace("index");
     std::unique_ptr<LWAudioDecoder> Decoder(new LWAudioDecoder(Source, AudioTrack, VariableFormat, Threads, LAVFOptions, DrcScale));
+    if (Packets)
+        Decoder->SetSharedPacketReader(Packets);
 
-    int64_t FileSize = Progress ? Decoder->GetSourceSize() : -1;
+    int64_t FileSize = Progress ? (Packets ? Packets->GetSourceSize() : Decoder->GetSourceSize()) : -1;
 
     // Fixme, implement frame discarding based on first seen format?
     /*
@@ -431,6 +804,7 @@ bool BestAudioSource::IndexTrack(const std::function<void(int Track, int64_t Cur
     */
 
     int64_t NumSamples = 0;
+    std::unique_ptr<AudioStatisticsCollector> Statistics;
 
     while (true) {
         AVFrame *F = Decoder->GetNextFrame();
@@ -440,11 +814,20 @@ bool BestAudioSource::IndexTrack(const std::function<void(int Track, int64_t Cur
         TrackIndex.Frames.push_back({ F->pts, NumSamples, F->nb_samples, GetHash(F) });
         NumSamples += F->nb_samples;
 
+        if (ComputeStatistics) {
+            if (!Statistics)
+                Statistics.reset(new AudioStatisticsCollector(F->sample_rate, F->ch_layout));
+            TrackIndex.Statistics.push_back(Statistics->Process(F));
+        }
+
         av_frame_free(&F);
         if (Progress)
             Progress(AudioTrack, Decoder->GetSourcePostion(), FileSize);
     };
 
+    if (Statistics)
+        TrackIndex.TrackStatistics = Statistics->GetTrackStatistics();
+
     if (Progress)
         Progress(AudioTrack, INT64_MAX, INT64_MAX);
 
@@ -494,21 +877,62 @@ const AudioProperties &BestAudioSource::GetAudioProperties() const {
 //    at least 100 frames earlier.
 // 5. If linear decoding after seeking fails handle it the same way as #4 and flag it as a bad seek point and retry from at least 100 frames earlier.
 
+// Does everything GetFrame() and GetFrameRef() have in common. Returns the cache entry of the frame if it's cached and also sets Decoded
+// if it had to be decoded, a decoded frame that didn't end up in the cache is only returned in Decoded.
+BestAudioSource::Cache::CacheBlock *BestAudioSource::RequestFrame(int64_t N, bool Linear, std::unique_ptr<BestAudioFrame> &Decoded) {
+    Counters.Requests++;
+    BS_PROBE2(audio_frame_request, AudioTrack, N);
+    Cache::CacheBlock *Block = FrameCache.GetBlock(N);
+    bool CacheHit = !!Block;
+    BSTraceInstant(CacheHit ? "cache hit" : "cache miss", N);
+    if (CacheHit) {
+        Counters.CacheHits++;
+    } else {
+        Decoded.reset(Linear ? GetFrameLinearInternal(N) : GetFrameInternal(N));
+        // The decoded frame normally ends up in the cache too
+        if (Decoded)
+            Block = FrameCache.GetBlock(N);
+    }
+
+    BS_PROBE4(audio_frame_done, AudioTrack, N, CacheHit, Block || Decoded);
+    return Block;
+}
+
 BestAudioFrame *BestAudioSource::GetFrame(int64_t N, bool Linear) {
     if (N < 0 || N >= AP.NumFrames)
         return nullptr;
 
-    std::unique_ptr<BestAudioFrame> F(FrameCache.GetFrame(N));
-    if (!F)
-        F.reset(Linear ? GetFrameLinearInternal(N) : GetFrameInternal(N));
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtAudioFrame, N);
+
+    std::unique_ptr<BestAudioFrame> Decoded;
+    Cache::CacheBlock *Block = RequestFrame(N, Linear, Decoded);
+    if (!Decoded && Block)
+        Decoded.reset(new BestAudioFrame(Block->Frame));
+    return Decoded.release();
+}
 
-    return F.release();
+std::shared_ptr<const BestAudioFrame> BestAudioSource::GetFrameRef(int64_t N, bool Linear) {
+    if (N < 0 || N >= AP.NumFrames)
+        return nullptr;
+
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtAudioFrame, N);
+
+    std::unique_ptr<BestAudioFrame> Decoded;
+    Cache::CacheBlock *Block = RequestFrame(N, Linear, Decoded);
+    if (!Block)
+        return std::move(Decoded);
+    // A freshly decoded frame becomes the shared one so its properties aren't parsed a second time
+    if (!Block->Ref)
+        Block->Ref = Decoded ? std::move(Decoded) : std::make_shared<const BestAudioFrame>(Block->Frame);
+    return Block->Ref;
 }
 
 void BestAudioSource::SetLinearMode() {
     assert(!LinearMode);
     if (!LinearMode) {
         BSDebugPrint("Linear mode is now forced");
+        Counters.LinearFallbacks++;
+        BS_PROBE1(audio_linear_mode, AudioTrack);
         LinearMode = true;
         FrameCache.Clear();
         for (size_t i = 0; i < MaxVideoSources; i++)
@@ -566,25 +990,35 @@ namespace {
 }
 
 BestAudioFrame *BestAudioSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std::unique_ptr<LWAudioDecoder> &Decoder, size_t Depth) {
+    BSTraceSpan Trace("seek", N);
+    BS_PROBE4(audio_seek, AudioTrack, N, SeekFrame, Depth);
+    Counters.Seeks++;
     if (!Decoder->Seek(TrackIndex.Frames[SeekFrame].PTS)) {
         BSDebugPrint("Unseekable file", N);
+        BS_PROBE4(audio_seek_failed, AudioTrack, N, SeekFrame, Depth);
         SetLinearMode();
         return GetFrameLinearInternal(N);
     }
 
     Decoder->SkipFrames(PreRoll / 2);
+    Counters.DecodedFrames += PreRoll / 2;
 
     FrameHolder MatchFrames;
 
     while (true) {
         AVFrame *F = Decoder->GetNextFrame();
+        if (F)
+            Counters.DecodedFrames++;
         if (!F && MatchFrames.empty()) {
             BadSeekLocations.insert(SeekFrame);
+            Counters.BadSeeks++;
+            BS_PROBE4(audio_seek_failed, AudioTrack, N, SeekFrame, Depth);
             BSDebugPrint("No frame could be decoded after seeking, added as bad seek location", N, SeekFrame);
             if (Depth < RetrySeekAttempts) {
                 int64_t SeekFrameNext = GetSeekFrame(SeekFrame - 100);
                 BSDebugPrint("Retrying seeking with", N, SeekFrameNext);
                 if (SeekFrameNext < 100) { // #2 again
+                    Counters.LinearFallbacks++;
                     Decoder.reset();
                     return GetFrameLinearInternal(N);
                 } else {
@@ -639,11 +1073,14 @@ BestAudioFrame *BestAudioSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
         if (!SuitableCandidate || UndeterminableLocation) {
             BSDebugPrint("No destination frame number could be determined after seeking, added as bad seek location", N, SeekFrame);
             BadSeekLocations.insert(SeekFrame);
+            Counters.BadSeeks++;
+            BS_PROBE4(audio_seek_failed, AudioTrack, N, SeekFrame, Depth);
             MatchFrames.clear();
             if (Depth < RetrySeekAttempts) {
                 int64_t SeekFrameNext = GetSeekFrame(SeekFrame - 100);
                 BSDebugPrint("Retrying seeking with", N, SeekFrameNext);
                 if (SeekFrameNext < 100) { // #2 again
+                    Counters.LinearFallbacks++;
                     Decoder.reset();
                     return GetFrameLinearInternal(N);
                 } else {
@@ -659,6 +1096,7 @@ BestAudioFrame *BestAudioSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
 
         if (Matches.size() == 1) {
             int64_t MatchedN = *Matches.begin();
+            BS_PROBE4(audio_seek_done, AudioTrack, N, SeekFrame, MatchedN);
 
 #ifndef NDEBUG
             if (MatchedN < 100)
@@ -709,7 +1147,7 @@ BestAudioFrame *BestAudioSource::GetFrameInternal(int64_t N) {
         return GetFrameLinearInternal(N);
 
     // # 1 A suitable linear decoder exists and seeking is out of the question
-    for (int i = 0; i < MaxVideoSources; i++) {
+    for (int i = 0; i < MaxDecoders; i++) {
         if (Decoders[i] && Decoders[i]->GetFrameNumber() <= N && Decoders[i]->GetFrameNumber() >= SeekFrame)
             return GetFrameLinearInternal(N);
     }
@@ -719,7 +1157,7 @@ BestAudioFrame *BestAudioSource::GetFrameInternal(int64_t N) {
     // Grab/create a new decoder to use for seeking, the position is irrelevant
     int EmptySlot = -1;
     int LeastRecentlyUsed = 0;
-    for (int i = 0; i < MaxVideoSources; i++) {
+    for (int i = 0; i < MaxDecoders; i++) {
         if (!Decoders[i])
             EmptySlot = i;
         if (Decoders[i] && DecoderLastUse[i] < DecoderLastUse[LeastRecentlyUsed])
@@ -727,8 +1165,10 @@ BestAudioFrame *BestAudioSource::GetFrameInternal(int64_t N) {
     }
 
     int Index = (EmptySlot >= 0) ? EmptySlot : LeastRecentlyUsed;
-    if (!Decoders[Index])
+    if (!Decoders[Index]) {
         Decoders[Index].reset(new LWAudioDecoder(Source, AudioTrack, VariableFormat, Threads, LAVFOptions, DrcScale));
+        Counters.DecoderCreations++;
+    }
 
     DecoderLastUse[Index] = DecoderSequenceNum++;
 
@@ -741,7 +1181,7 @@ BestAudioFrame *BestAudioSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
     int Index = -1;
     int EmptySlot = -1;
     int LeastRecentlyUsed = 0;
-    for (int i = 0; i < MaxVideoSources; i++) {
+    for (int i = 0; i < MaxDecoders; i++) {
         if (Decoders[i] && (!ForceUnseeked || !Decoders[i]->HasSeeked()) && Decoders[i]->GetFrameNumber() <= N && (Index < 0 || Decoders[Index]->GetFrameNumber() < Decoders[i]->GetFrameNumber()))
             Index = i;
         if (!Decoders[i])
@@ -754,6 +1194,7 @@ BestAudioFrame *BestAudioSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
     if (Index < 0) {
         Index = (EmptySlot >= 0) ? EmptySlot : LeastRecentlyUsed;
         Decoders[Index].reset(new LWAudioDecoder(Source, AudioTrack, VariableFormat, Threads, LAVFOptions, DrcScale));
+        Counters.DecoderCreations++;
     }
 
     std::unique_ptr<LWAudioDecoder> &Decoder = Decoders[Index];
@@ -766,6 +1207,8 @@ BestAudioFrame *BestAudioSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
         int64_t SamplePos = Decoder->GetSamplePos();
         if (FrameNumber >= N - PreRoll) {
             AVFrame *Frame = Decoder->GetNextFrame();
+            if (Frame)
+                Counters.DecodedFrames++;
 
             // This is the most central sanity check. It primarily exists to catch the case
             // when a decoder has successfully seeked and had its location identified but
@@ -778,10 +1221,12 @@ BestAudioFrame *BestAudioSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
                     BSDebugPrint("Decoded frame does not match hash in GetFrameLinearInternal() or no frame produced at all, added as bad seek location", N, FrameNumber);
                     assert(SeekFrame >= 0);
                     BadSeekLocations.insert(SeekFrame);
+                    Counters.BadSeeks++;
                     if (Depth < RetrySeekAttempts) {
                         int64_t SeekFrameNext = GetSeekFrame(SeekFrame - 100);
                         BSDebugPrint("Retrying seeking with", N, SeekFrameNext);
                         if (SeekFrameNext < 100) { // #2 again
+                            Counters.LinearFallbacks++;
                             Decoder.reset();
                             return GetFrameLinearInternal(N);
                         } else {
@@ -804,6 +1249,7 @@ BestAudioFrame *BestAudioSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
             FrameCache.CacheFrame(FrameNumber, Frame);
         } else if (FrameNumber < N) {
             Decoder->SkipFrames(N - PreRoll - FrameNumber);
+            Counters.DecodedFrames += Decoder->GetFrameNumber() - FrameNumber;
         }
 
         if (!Decoder->HasMoreFrames())
@@ -814,14 +1260,18 @@ BestAudioFrame *BestAudioSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
 }
 
 BestAudioSource::FrameRange BestAudioSource::GetFrameRangeBySamples(int64_t Start, int64_t Count) const {
+    return GetFrameRangeBySamples(TrackIndex.Frames, AP.NumSamples, Start, Count);
+}
+
+BestAudioSource::FrameRange BestAudioSource::GetFrameRangeBySamples(const std::vector<AudioTrackIndex::FrameInfo> &Frames, int64_t NumSamples, int64_t Start, int64_t Count) {
     FrameRange Result = { -1, -1, -1 };
-    if (Count <= 0 || Start >= AP.NumSamples)
+    if (Count <= 0 || Start >= NumSamples)
         return Result;
     if (Start < 0) {
         Result.First = 0;
     } else {
-        for (size_t i = 0; i < TrackIndex.Frames.size(); i++) {
-            if (Start >= TrackIndex.Frames[i].Start && Start < TrackIndex.Frames[i].Start + TrackIndex.Frames[i].Length) {
+        for (size_t i = 0; i < Frames.size(); i++) {
+            if (Start >= Frames[i].Start && Start < Frames[i].Start + Frames[i].Length) {
                 Result.First = i;
                 break;
             }
@@ -829,11 +1279,11 @@ BestAudioSource::FrameRange BestAudioSource::GetFrameRangeBySamples(int64_t Star
     }
 
     int64_t EndPos = Start + Count;
-    if (EndPos >= AP.NumSamples) {
-        Result.Last = AP.NumFrames - 1;
+    if (EndPos >= NumSamples) {
+        Result.Last = Frames.size() - 1;
     } else {
-        for (size_t i = 0; i < TrackIndex.Frames.size(); i++) {
-            if (EndPos - 1 >= TrackIndex.Frames[i].Start && EndPos - 1 < TrackIndex.Frames[i].Start + TrackIndex.Frames[i].Length) {
+        for (size_t i = 0; i < Frames.size(); i++) {
+            if (EndPos - 1 >= Frames[i].Start && EndPos - 1 < Frames[i].Start + Frames[i].Length) {
                 Result.Last = i;
                 break;
             }
@@ -842,8 +1292,50 @@ BestAudioSource::FrameRange BestAudioSource::GetFrameRangeBySamples(int64_t Star
 
     assert(Result.First >= 0 && Result.Last >= 0);
 
-    Result.FirstSamplePos = TrackIndex.Frames[Result.First].Start;
+    Result.FirstSamplePos = Frames[Result.First].Start;
+
+    return Result;
+}
+
+bool BestAudioSource::HasStatistics() const {
+    return !TrackIndex.Statistics.empty();
+}
+
+const AudioStatistics &BestAudioSource::GetTrackStatistics() const {
+    if (!HasStatistics())
+        throw AudioException("Statistics weren't computed when the index was created");
+    return TrackIndex.TrackStatistics;
+}
+
+const AudioStatistics &BestAudioSource::GetFrameStatistics(int64_t N) const {
+    if (!HasStatistics())
+        throw AudioException("Statistics weren't computed when the index was created");
+    if (N < 0 || N >= AP.NumFrames)
+        throw AudioException("Out of bounds frame requested");
+    return TrackIndex.Statistics[N];
+}
+
+AudioStatistics BestAudioSource::GetStatisticsBySamples(int64_t Start, int64_t Count) const {
+    if (!HasStatistics())
+        throw AudioException("Statistics weren't computed when the index was created");
 
+    AudioStatistics Result = { 0, 0, -std::numeric_limits<double>::infinity() };
+    auto Range = GetFrameRangeBySamples(Start - SampleDelay, Count);
+    if (Range.First == -1)
+        return Result;
+
+    double SumSquares = 0;
+    int64_t Length = 0;
+    for (int64_t i = Range.First; i <= Range.Last; i++) {
+        const AudioStatistics &Iter = TrackIndex.Statistics[i];
+        Result.Peak = std::max(Result.Peak, Iter.Peak);
+        SumSquares += Iter.RMS * Iter.RMS * TrackIndex.Frames[i].Length;
+        Length += TrackIndex.Frames[i].Length;
+    }
+
+    if (Length > 0)
+        Result.RMS = std::sqrt(SumSquares / Length);
+    Result.Loudness = TrackIndex.Statistics[Range.Last].Loudness;
     return Result;
 }
 
@@ -867,7 +1359,7 @@ void BestAudioSource::ZeroFillEndPacked(uint8_t *Data, int64_t Start, int64_t &C
     }
 }
 
-static void PackChannels(const uint8_t **Src, uint8_t *&Dst, size_t Length, size_t Channels, size_t BytesPerSample) {
+void PackChannels(const uint8_t **Src, uint8_t *&Dst, size_t Length, size_t Channels, size_t BytesPerSample) {
     for (size_t i = 0; i < Length; i++) {
         for (size_t c = 0; c < Channels; c++) {
             memcpy(Dst, Src[c], BytesPerSample);
@@ -878,6 +1370,7 @@ static void PackChannels(const uint8_t **Src, uint8_t *&Dst, size_t Length, size
 }
 
 bool BestAudioSource::FillInFramePacked(const BestAudioFrame *Frame, int64_t FrameStartSample, uint8_t *&Data, int64_t &Start, int64_t &Count) {
+    BSTraceSpan Trace("export");
     const AVFrame *F = Frame->GetAVFrame();
     bool IsPlanar = av_sample_fmt_is_planar(static_cast<AVSampleFormat>(F->format));
     if ((Start >= FrameStartSample) && (Start < FrameStartSample + Frame->NumSamples)) {
@@ -885,7 +1378,19 @@ bool BestAudioSource::FillInFramePacked(const BestAudioFrame *Frame, int64_t Fra
         if (Length == 0)
             return false;
 
-        if (IsPlanar) {
+        if (OutputSampleFormat != AV_SAMPLE_FMT_NONE) {
+            int Channels = F->ch_layout.nb_channels;
+            size_t SrcBytesPerSample = av_get_bytes_per_sample(static_cast<AVSampleFormat>(F->format));
+            if (IsPlanar) {
+                size_t ByteOffset = (Start - FrameStartSample) * SrcBytesPerSample;
+                for (int i = 0; i < Channels; i++)
+                    ConvertSamples(F->format, F->extended_data[i] + ByteOffset, 1, OutputSampleFormat, Data + i * AP.AF.BytesPerSample, Channels, Length);
+            } else {
+                size_t ByteOffset = (Start - FrameStartSample) * SrcBytesPerSample * Channels;
+                ConvertSamples(F->format, F->extended_data[0] + ByteOffset, 1, OutputSampleFormat, Data, 1, Length * Channels);
+            }
+            Data += Length * AP.AF.BytesPerSample * Channels;
+        } else if (IsPlanar) {
             std::vector<const uint8_t *> DataV;
             DataV.reserve(F->ch_layout.nb_channels);
             size_t ByteOffset = (Start - FrameStartSample) * AP.AF.BytesPerSample;
@@ -930,7 +1435,7 @@ void BestAudioSource::ZeroFillEndPlanar(uint8_t *Data[], int64_t Start, int64_t
     }
 }
 
-static void UnpackChannels(const uint8_t *Src, uint8_t *Dst[], size_t Length, size_t Channels, size_t BytesPerSample) {
+void UnpackChannels(const uint8_t *Src, uint8_t *Dst[], size_t Length, size_t Channels, size_t BytesPerSample) {
     for (size_t i = 0; i < Length; i++) {
         for (size_t c = 0; c < Channels; c++) {
             memcpy(Dst[c], Src, BytesPerSample);
@@ -941,6 +1446,7 @@ static void UnpackChannels(const uint8_t *Src, uint8_t *Dst[], size_t Length, si
 }
 
 bool BestAudioSource::FillInFramePlanar(const BestAudioFrame *Frame, int64_t FrameStartSample, uint8_t *Data[], int64_t &Start, int64_t &Count) {
+    BSTraceSpan Trace("export");
     const AVFrame *F = Frame->GetAVFrame();
     bool IsPlanar = av_sample_fmt_is_planar(static_cast<AVSampleFormat>(F->format));
     if ((Start >= FrameStartSample) && (Start < FrameStartSample + Frame->NumSamples)) {
@@ -948,7 +1454,17 @@ bool BestAudioSource::FillInFramePlanar(const BestAudioFrame *Frame, int64_t Fra
         if (Length == 0)
             return false;
 
-        if (IsPlanar) {
+        if (OutputSampleFormat != AV_SAMPLE_FMT_NONE) {
+            int Channels = F->ch_layout.nb_channels;
+            size_t SrcBytesPerSample = av_get_bytes_per_sample(static_cast<AVSampleFormat>(F->format));
+            for (int i = 0; i < AP.Channels; i++) {
+                if (IsPlanar)
+                    ConvertSamples(F->format, F->extended_data[i] + (Start - FrameStartSample) * SrcBytesPerSample, 1, OutputSampleFormat, Data[i], 1, Length);
+                else
+                    ConvertSamples(F->format, F->extended_data[0] + ((Start - FrameStartSample) * Channels + i) * SrcBytesPerSample, Channels, OutputSampleFormat, Data[i], 1, Length);
+                Data[i] += Length * AP.AF.BytesPerSample;
+            }
+        } else if (IsPlanar) {
             size_t ByteLength = Length * AP.AF.BytesPerSample;
             size_t ByteOffset = (Start - FrameStartSample) * AP.AF.BytesPerSample;
             for (int i = 0; i < AP.Channels; i++) {
@@ -969,6 +1485,7 @@ bool BestAudioSource::FillInFramePlanar(const BestAudioFrame *Frame, int64_t Fra
 }
 
 void BestAudioSource::GetPackedAudio(uint8_t *Data, int64_t Start, int64_t Count) {
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtPackedAudio, Start, Count);
     Start -= SampleDelay;
 
     ZeroFillStartPacked(Data, Start, Count);
@@ -979,7 +1496,7 @@ void BestAudioSource::GetPackedAudio(uint8_t *Data, int64_t Start, int64_t Count
         return;
 
     for (int64_t i = Range.First; i <= Range.Last; i++) {
-        std::unique_ptr<BestAudioFrame> F(GetFrame(i));
+        std::shared_ptr<const BestAudioFrame> F = GetFrameRef(i);
         FillInFramePacked(F.get(), Range.FirstSamplePos, Data, Start, Count);
         Range.FirstSamplePos += F->NumSamples;
     }
@@ -994,6 +1511,7 @@ void BestAudioSource::GetPackedAudio(uint8_t *Data, int64_t Start, int64_t Count
 }
 
 void BestAudioSource::GetPlanarAudio(uint8_t *const *const Data, int64_t Start, int64_t Count) {
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtPlanarAudio, Start, Count);
     Start -= SampleDelay;
 
     std::vector<uint8_t *> DataV;
@@ -1009,7 +1527,7 @@ void BestAudioSource::GetPlanarAudio(uint8_t *const *const Data, int64_t Start,
         return;
 
     for (int64_t i = Range.First; i <= Range.Last; i++) {
-        std::unique_ptr<BestAudioFrame> F(GetFrame(i));
+        std::shared_ptr<const BestAudioFrame> F = GetFrameRef(i);
         FillInFramePlanar(F.get(), Range.FirstSamplePos, DataV.data(), Start, Count);
         Range.FirstSamplePos += F->NumSamples;
     }
@@ -1035,6 +1553,7 @@ bool BestAudioSource::WriteAudioTrackIndex(const std::string &CachePath) {
     WriteInt(F, AudioTrack);
     WriteInt(F, VariableFormat);
     WriteDouble(F, DrcScale);
+    WriteInt(F, ComputeStatistics);
 
     WriteInt(F, static_cast<int>(LAVFOptions.size()));
     for (const auto &Iter : LAVFOptions) {
@@ -1050,6 +1569,17 @@ bool BestAudioSource::WriteAudioTrackIndex(const std::string &CachePath) {
         WriteInt64(F, Iter.Length);
     }
 
+    if (ComputeStatistics) {
+        for (const auto &Iter : TrackIndex.Statistics) {
+            WriteDouble(F, Iter.Peak);
+            WriteDouble(F, Iter.RMS);
+            WriteDouble(F, Iter.Loudness);
+        }
+        WriteDouble(F, TrackIndex.TrackStatistics.Peak);
+        WriteDouble(F, TrackIndex.TrackStatistics.RMS);
+        WriteDouble(F, TrackIndex.TrackStatistics.Loudness);
+    }
+
     return true;
 }
 
@@ -1067,6 +1597,10 @@ bool BestAudioSource::ReadAudioTrackIndex(const std::string &CachePath) {
         return false;
     if (!ReadCompareDouble(F, DrcScale))
         return false;
+    // An index with statistics is also good enough when they weren't requested
+    bool IndexHasStatistics = !!ReadInt(F);
+    if (ComputeStatistics && !IndexHasStatistics)
+        return false;
 
     int LAVFOptCount = ReadInt(F);
     std::map<std::string, std::string> IndexLAVFOptions;
@@ -1092,6 +1626,21 @@ bool BestAudioSource::ReadAudioTrackIndex(const std::string &CachePath) {
         TrackIndex.Frames.push_back(FI);
     }
 
-    return true;
+    if (IndexHasStatistics) {
+        TrackIndex.Statistics.reserve(NumFrames);
+        for (int i = 0; i < NumFrames; i++) {
+            AudioStatistics AS = {};
+            AS.Peak = ReadDouble(F);
+            AS.RMS = ReadDouble(F);
+            AS.Loudness = ReadDouble(F);
+            TrackIndex.Statistics.push_back(AS);
+        }
+        TrackIndex.TrackStatistics.Peak = ReadDouble(F);
+        TrackIndex.TrackStatistics.RMS = ReadDouble(F);
+        TrackIndex.TrackStatistics.Loudness = ReadDouble(F);
+    }
+
+    // Short reads return -1 so a truncated index is only noticed here
+    return !feof(F.get()) && !ferror(F.get());
 }
 
@@ -61,6 +61,12 @@ struct AudioProperties {
     double StartTime; /* in seconds */
 };
 
+struct AudioStatistics {
+    double Peak; /* absolute sample peak where 1.0 is full scale */
+    double RMS; /* over all channels where 1.0 is full scale */
+    double Loudness; /* EBU R128 in LUFS, short-term loudness for frames and integrated loudness for the whole track, -inf for silence */
+};
+
 struct LWAudioDecoder {
 private:
     AVFormatContext *FormatContext = nullptr;
@@ -72,6 +78,7 @@ private:
     bool DecodeSuccess = true;
     AVPacket *Packet = nullptr;
     bool Seeked = false;
+    SharedPacketReader *SharedPackets = nullptr;
 
     void OpenFile(const std::string &SourceFile, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts, double DrcScale);
     bool ReadPacket();
@@ -83,6 +90,7 @@ public:
     [[nodiscard]] int64_t GetSourceSize() const;
     [[nodiscard]] int64_t GetSourcePostion() const;
     [[nodiscard]] int GetTrack() const; // Useful when opening nth video track to get the actual number
+    void SetSharedPacketReader(SharedPacketReader *Reader); // Packets are read from Reader instead of the decoder's own file from now on, only call directly after creation and never seek afterwards
     [[nodiscard]] int64_t GetFrameNumber() const; // The frame you will get when calling GetNextFrame()
     [[nodiscard]] int64_t GetSamplePos() const; // The frame you will get when calling GetNextFrame()
     void SetFrameNumber(int64_t N, int64_t SampleNumber); // Use after seeking to update internal frame number
@@ -119,22 +127,25 @@ private:
         };
 
         std::vector<FrameInfo> Frames;
+        std::vector<AudioStatistics> Statistics; /* per frame, empty unless computed during indexing */
+        AudioStatistics TrackStatistics = {};
     };
 
     bool WriteAudioTrackIndex(const std::string &CachePath);
     bool ReadAudioTrackIndex(const std::string &CachePath);
 
     class Cache {
-    private:
+    public:
         class CacheBlock {
         public:
             int64_t FrameNumber;
             AVFrame *Frame;
+            std::shared_ptr<const BestAudioFrame> Ref; // Created on first access so properties are only parsed once
             size_t Size = 0;
             CacheBlock(int64_t FrameNumber, AVFrame *Frame);
             ~CacheBlock();
         };
-
+    private:
         size_t Size = 0;
         size_t MaxSize = 1024 * 1024 * 1024;
         std::list<CacheBlock> Data;
@@ -143,7 +154,9 @@ private:
         void Clear();
         void SetMaxSize(size_t Bytes);
         void CacheFrame(int64_t FrameNumber, AVFrame *Frame); // Takes ownership of Frame
+        [[nodiscard]] CacheBlock *GetBlock(int64_t N); // Moves the block to the front, nullptr if N isn't cached
         [[nodiscard]] BestAudioFrame *GetFrame(int64_t N);
+        [[nodiscard]] std::shared_ptr<const BestAudioFrame> GetFrameRef(int64_t N);
     };
 
     AudioTrackIndex TrackIndex;
@@ -157,20 +170,27 @@ private:
     int AudioTrack;
     bool VariableFormat;
     int Threads;
+    bool ComputeStatistics;
     bool LinearMode = false;
+    int MaxDecoders = MaxVideoSources;
     uint64_t DecoderSequenceNum = 0;
     uint64_t DecoderLastUse[MaxVideoSources] = {};
     std::unique_ptr<LWAudioDecoder> Decoders[MaxVideoSources];
+    DecodeCounters Counters = {};
+    std::unique_ptr<AccessLog> RequestLog;
     int64_t PreRoll = 40;
     int64_t SampleDelay = 0;
+    AudioFormat NativeAF = {};
+    int OutputSampleFormat = -1; /* AVSampleFormat of the output, -1 passes through the decoder's native format */
     static constexpr size_t RetrySeekAttempts = 10;
     std::set<int64_t> BadSeekLocations;
     void SetLinearMode();
     [[nodiscard]] int64_t GetSeekFrame(int64_t N);
     [[nodiscard]] BestAudioFrame *SeekAndDecode(int64_t N, int64_t SeekFrame, std::unique_ptr<LWAudioDecoder> &Decoder, size_t Depth = 0);
+    [[nodiscard]] Cache::CacheBlock *RequestFrame(int64_t N, bool Linear, std::unique_ptr<BestAudioFrame> &Decoded);
     [[nodiscard]] BestAudioFrame *GetFrameInternal(int64_t N);
     [[nodiscard]] BestAudioFrame *GetFrameLinearInternal(int64_t N, int64_t SeekFrame = -1, size_t Depth = 0, bool ForceUnseeked = false);
-    [[nodiscard]] bool IndexTrack(const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    [[nodiscard]] bool IndexTrack(const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr, SharedPacketReader *Packets = nullptr);
     bool InitializeRFF();
     void ZeroFillStartPacked(uint8_t *&Data, int64_t &Start, int64_t &Count);
     void ZeroFillEndPacked(uint8_t *Data, int64_t Start, int64_t &Count);
@@ -178,21 +198,35 @@ private:
     void ZeroFillStartPlanar(uint8_t *Data[], int64_t &Start, int64_t &Count);
     void ZeroFillEndPlanar(uint8_t *Data[], int64_t Start, int64_t &Count);
     bool FillInFramePlanar(const BestAudioFrame *Frame, int64_t FrameStartSample, uint8_t *Data[], int64_t &Start, int64_t &Count);
+    friend struct BSKernelAccess;
 public:
     struct FrameRange {
         int64_t First;
         int64_t Last;
         int64_t FirstSamplePos;
     };
+private:
+    [[nodiscard]] static FrameRange GetFrameRangeBySamples(const std::vector<AudioTrackIndex::FrameInfo> &Frames, int64_t NumSamples, int64_t Start, int64_t Count);
+public:
 
-    BestAudioSource(const std::string &SourceFile, int Track, int AjustDelay, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, double DrcScale, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    BestAudioSource(const std::string &SourceFile, int Track, int AjustDelay, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, double DrcScale, bool ComputeStatistics, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr, SharedPacketReader *IndexPackets = nullptr); /* IndexPackets is only used if the track has to be indexed */
     [[nodiscard]] int GetTrack() const; // Useful when opening nth video track to get the actual number
     void SetMaxCacheSize(size_t Bytes); /* default max size is 1GB */
     void SetSeekPreRoll(int64_t Frames); /* the number of frames to cache before the position being fast forwarded to */
+    void SetMaxDecoders(int Count); /* the number of decoders kept open at different positions, between 1 and 4, default is 4 */
+    void SetAccessLog(const std::string &Filename); /* records all GetFrame(), GetFrameRef(), GetPackedAudio() and GetPlanarAudio() requests, pass an empty string to stop, only change it while no requests are in progress */
+    [[nodiscard]] const DecodeCounters &GetDecodeCounters() const;
+    void ResetDecodeCounters();
+    void SetOutputFormat(bool Float, int Bits); /* converts the output of GetPackedAudio() and GetPlanarAudio() to 16/32 bit integer or 32 bit float samples, pass Bits = 0 to restore the decoder's native format. Lowering the bit depth rounds to nearest and clips without dithering */
     double GetRelativeStartTime(int Track) const;
     [[nodiscard]] const AudioProperties &GetAudioProperties() const;
     [[nodiscard]] BestAudioFrame *GetFrame(int64_t N, bool Linear = false);
+    [[nodiscard]] std::shared_ptr<const BestAudioFrame> GetFrameRef(int64_t N, bool Linear = false); /* shares the cached frame instead of creating a new copy for every request */
     [[nodiscard]] FrameRange GetFrameRangeBySamples(int64_t Start, int64_t Count) const;
+    [[nodiscard]] bool HasStatistics() const; /* only true if ComputeStatistics was set when the index was created */
+    [[nodiscard]] const AudioStatistics &GetTrackStatistics() const;
+    [[nodiscard]] const AudioStatistics &GetFrameStatistics(int64_t N) const;
+    [[nodiscard]] AudioStatistics GetStatisticsBySamples(int64_t Start, int64_t Count) const; /* combined statistics of all frames overlapping the range, loudness is taken from the last one */
     void GetPackedAudio(uint8_t *Data, int64_t Start, int64_t Count);
     void GetPlanarAudio(uint8_t *const *const Data, int64_t Start, int64_t Count);
 };
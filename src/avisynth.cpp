@@ -58,13 +58,14 @@ class AvisynthVideoSource : public IClip {
     int64_t FPSNum;
     int64_t FPSDen;
     bool RFF;
+    bool Proxy;
     std::string VarPrefix;
 public:
     AvisynthVideoSource(const char *SourceFile, int Track,
         int AFPSNum, int AFPSDen, bool RFF, int Threads, int SeekPreRoll, bool EnableDrefs, bool UseAbsolutePath,
         const char *CachePath, int CacheSize, const char *HWDevice, int ExtraHWFrames,
-        const char *Timecodes, const char *VarPrefix, IScriptEnvironment *Env)
-        : FPSNum(AFPSNum), FPSDen(AFPSDen), RFF(RFF), VarPrefix(VarPrefix) {
+        const char *Timecodes, const char *VarPrefix, bool Statistics, int ProxyScale, bool SampledHash, const char *AccessLogPath, IScriptEnvironment *Env)
+        : FPSNum(AFPSNum), FPSDen(AFPSDen), RFF(RFF), Proxy(ProxyScale > 0), VarPrefix(VarPrefix) {
 
         try {
             if (FPSDen < 1)
@@ -73,73 +74,84 @@ public:
             if (FPSNum > 0 && RFF)
                 throw VideoException("Cannot combine CFR and RFF modes");
 
+            if (Proxy && (FPSNum > 0 || RFF))
+                throw VideoException("Cannot combine proxy output with CFR or RFF modes");
+
             std::map<std::string, std::string> Opts;
             if (EnableDrefs)
                 Opts["enable_drefs"] = "1";
             if (UseAbsolutePath)
                 Opts["use_absolute_path"] = "1";
 
-            V.reset(new BestVideoSource(SourceFile, HWDevice ? HWDevice : "", ExtraHWFrames, Track, false, Threads, CachePath, &Opts));
+            V.reset(new BestVideoSource(SourceFile, HWDevice ? HWDevice : "", ExtraHWFrames, Track, false, Threads, CachePath, &Opts, Statistics, ProxyScale, SampledHash));
 
             const VideoProperties &VP = V->GetVideoProperties();
-            if (VP.VF.ColorFamily == cfGray) {
-                VI.pixel_type = VideoInfo::CS_GENERIC_Y;
-            } else if (VP.VF.ColorFamily == cfYUV && VP.VF.Alpha) {
-                VI.pixel_type = VideoInfo::CS_PLANAR | VideoInfo::CS_YUVA | VideoInfo::CS_VPlaneFirst; // Why is there no generic YUVA constant?
-            } else if (VP.VF.ColorFamily == cfYUV) {
-                VI.pixel_type = VideoInfo::CS_PLANAR | VideoInfo::CS_YUV | VideoInfo::CS_VPlaneFirst; // Why is there no generic YUV constant?
-            } else if (VP.VF.ColorFamily == cfRGB && VP.VF.Alpha) {
-                VI.pixel_type = VideoInfo::CS_GENERIC_RGBP;
-            } else if (VP.VF.ColorFamily == cfRGB) {
-                VI.pixel_type = VideoInfo::CS_GENERIC_RGBAP;
+            if (Proxy) {
+                // The proxy is always 8 bit 4:2:0 no matter what the source is
+                VI.pixel_type = VideoInfo::CS_PLANAR | VideoInfo::CS_YUV | VideoInfo::CS_VPlaneFirst | VideoInfo::CS_Sub_Height_2 | VideoInfo::CS_Sub_Width_2 | VideoInfo::CS_Sample_Bits_8;
+                VI.width = V->GetProxyWidth() & ~1;
+                VI.height = V->GetProxyHeight() & ~1;
             } else {
-                throw VideoException("Unsupported output colorspace");
-            }
+                if (VP.VF.ColorFamily == cfGray) {
+                    VI.pixel_type = VideoInfo::CS_GENERIC_Y;
+                } else if (VP.VF.ColorFamily == cfYUV && VP.VF.Alpha) {
+                    VI.pixel_type = VideoInfo::CS_PLANAR | VideoInfo::CS_YUVA | VideoInfo::CS_VPlaneFirst; // Why is there no generic YUVA constant?
+                } else if (VP.VF.ColorFamily == cfYUV) {
+                    VI.pixel_type = VideoInfo::CS_PLANAR | VideoInfo::CS_YUV | VideoInfo::CS_VPlaneFirst; // Why is there no generic YUV constant?
+                } else if (VP.VF.ColorFamily == cfRGB && VP.VF.Alpha) {
+                    VI.pixel_type = VideoInfo::CS_GENERIC_RGBP;
+                } else if (VP.VF.ColorFamily == cfRGB) {
+                    VI.pixel_type = VideoInfo::CS_GENERIC_RGBAP;
+                } else {
+                    throw VideoException("Unsupported output colorspace");
+                }
 
-            if (VP.VF.SubSamplingH == 0) {
-                VI.pixel_type |= VideoInfo::CS_Sub_Height_1;
-            } else if (VP.VF.SubSamplingH == 1) {
-                VI.pixel_type |= VideoInfo::CS_Sub_Height_2;
-            } else if (VP.VF.SubSamplingH == 2) {
-                VI.pixel_type |= VideoInfo::CS_Sub_Height_4;
-            } else {
-                throw VideoException("Unsupported output subsampling");
-            }
+                if (VP.VF.SubSamplingH == 0) {
+                    VI.pixel_type |= VideoInfo::CS_Sub_Height_1;
+                } else if (VP.VF.SubSamplingH == 1) {
+                    VI.pixel_type |= VideoInfo::CS_Sub_Height_2;
+                } else if (VP.VF.SubSamplingH == 2) {
+                    VI.pixel_type |= VideoInfo::CS_Sub_Height_4;
+                } else {
+                    throw VideoException("Unsupported output subsampling");
+                }
 
-            if (VP.VF.SubSamplingW == 0) {
-                VI.pixel_type |= VideoInfo::CS_Sub_Width_1;
-            } else if (VP.VF.SubSamplingW == 1) {
-                VI.pixel_type |= VideoInfo::CS_Sub_Width_2;
-            } else if (VP.VF.SubSamplingW == 2) {
-                VI.pixel_type |= VideoInfo::CS_Sub_Width_4;
-            } else {
-                throw VideoException("Unsupported output subsampling");
-            }
+                if (VP.VF.SubSamplingW == 0) {
+                    VI.pixel_type |= VideoInfo::CS_Sub_Width_1;
+                } else if (VP.VF.SubSamplingW == 1) {
+                    VI.pixel_type |= VideoInfo::CS_Sub_Width_2;
+                } else if (VP.VF.SubSamplingW == 2) {
+                    VI.pixel_type |= VideoInfo::CS_Sub_Width_4;
+                } else {
+                    throw VideoException("Unsupported output subsampling");
+                }
 
-            if (VP.VF.Bits == 32 && VP.VF.Float) {
-                VI.pixel_type |= VideoInfo::CS_Sample_Bits_32;
-            } else if (VP.VF.Bits == 16 && !VP.VF.Float) {
-                VI.pixel_type |= VideoInfo::CS_Sample_Bits_16;
-            } else if (VP.VF.Bits == 14 && !VP.VF.Float) {
-                VI.pixel_type |= VideoInfo::CS_Sample_Bits_14;
-            } else if (VP.VF.Bits == 12 && !VP.VF.Float) {
-                VI.pixel_type |= VideoInfo::CS_Sample_Bits_12;
-            } else if (VP.VF.Bits == 10 && !VP.VF.Float) {
-                VI.pixel_type |= VideoInfo::CS_Sample_Bits_10;
-            } else if (VP.VF.Bits == 8 && !VP.VF.Float) {
-                VI.pixel_type |= VideoInfo::CS_Sample_Bits_8;
-            } else {
-                throw VideoException("Unsupported output bitdepth");
-            }
+                if (VP.VF.Bits == 32 && VP.VF.Float) {
+                    VI.pixel_type |= VideoInfo::CS_Sample_Bits_32;
+                } else if (VP.VF.Bits == 16 && !VP.VF.Float) {
+                    VI.pixel_type |= VideoInfo::CS_Sample_Bits_16;
+                } else if (VP.VF.Bits == 14 && !VP.VF.Float) {
+                    VI.pixel_type |= VideoInfo::CS_Sample_Bits_14;
+                } else if (VP.VF.Bits == 12 && !VP.VF.Float) {
+                    VI.pixel_type |= VideoInfo::CS_Sample_Bits_12;
+                } else if (VP.VF.Bits == 10 && !VP.VF.Float) {
+                    VI.pixel_type |= VideoInfo::CS_Sample_Bits_10;
+                } else if (VP.VF.Bits == 8 && !VP.VF.Float) {
+                    VI.pixel_type |= VideoInfo::CS_Sample_Bits_8;
+                } else {
+                    throw VideoException("Unsupported output bitdepth");
+                }
 
-            // FIXME, set TFF flag too?
+                // FIXME, set TFF flag too?
 
-            VI.width = VP.Width;
-            VI.height = VP.Height;
+                VI.width = VP.Width;
+                VI.height = VP.Height;
+
+                // Crop to obey subsampling width/height requirements
+                VI.width -= VI.width % (1 << VP.VF.SubSamplingW);
+                VI.height -= VI.height % (1 << VP.VF.SubSamplingH);
+            }
 
-            // Crop to obey subsampling width/height requirements
-            VI.width -= VI.width % (1 << VP.VF.SubSamplingW);
-            VI.height -= VI.height % (1 << VP.VF.SubSamplingH);
             VI.num_frames = vsh::int64ToIntS(VP.NumFrames);
             VI.SetFPS(VP.FPS.Num, VP.FPS.Den);
 
@@ -164,6 +176,9 @@ public:
             if (Timecodes)
                 V->WriteTimecodes(Timecodes);
 
+            if (AccessLogPath)
+                V->SetAccessLog(AccessLogPath);
+
             // FIXME, does anyone use this?
             // Set AR variables
             Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix.c_str(), "BSSAR_NUM"), VP.SAR.Num);
@@ -202,16 +217,18 @@ public:
     PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment *Env) {
         PVideoFrame Dst;
 
-        std::unique_ptr<BestVideoFrame> Src;
+        std::shared_ptr<const BestVideoFrame> Src;
         try {
-            if (RFF) {
+            if (Proxy) {
+                Src.reset(V->GetProxyFrame(std::min(n, VI.num_frames - 1)));
+            } else if (RFF) {
                 Src.reset(V->GetFrameWithRFF(std::min(n, VI.num_frames - 1)));
             } else if (FPSNum > 0) {
                 double currentTime = V->GetVideoProperties().StartTime +
                     (double)(std::min(n, VI.num_frames - 1) * FPSDen) / FPSNum;
                 Src.reset(V->GetFrameByTime(currentTime));
             } else {
-                Src.reset(V->GetFrame(std::min(n, VI.num_frames - 1)));
+                Src = V->GetFrameRef(std::min(n, VI.num_frames - 1));
             }
 
             if (!Src)
@@ -311,6 +328,15 @@ public:
         Env->propSetInt(Props, "FlipHorizontal", VP.FlipHorizontal, 0);
         Env->propSetInt(Props, "Rotation", VP.Rotation, 0);
 
+        if (!RFF && FPSNum <= 0 && V->HasStatistics()) {
+            const VideoStatistics &VS = V->GetFrameStatistics(std::min(n, VI.num_frames - 1));
+            Env->propSetInt(Props, "LumaMin", VS.LumaMin, 0);
+            Env->propSetInt(Props, "LumaMax", VS.LumaMax, 0);
+            Env->propSetFloat(Props, "LumaMean", VS.LumaMean, 0);
+            Env->propSetFloat(Props, "LumaDiff", VS.LumaDiff, 0);
+            Env->propSetData(Props, "LumaThumbnail", reinterpret_cast<const char *>(VS.Thumbnail.data()), static_cast<int>(VS.Thumbnail.size()), 0);
+        }
+
         return Dst;
     }
 };
@@ -336,8 +362,12 @@ static AVSValue __cdecl CreateBSVideoSource(AVSValue Args, void *UserData, IScri
     int ExtraHWFrames = Args[12].AsInt(9);
     const char *Timecodes = Args[13].AsString(nullptr);
     const char *VarPrefix = Args[14].AsString("");
+    bool Statistics = Args[15].AsBool(false);
+    int ProxyScale = Args[16].AsInt(0);
+    const char *AccessLogPath = Args[17].AsString(nullptr);
+    bool SampledHash = Args[18].AsBool(false);
 
-    return new AvisynthVideoSource(Source, Track, FPSNum, FPSDen, RFF, Threads, SeekPreroll, EnableDrefs, UseAbsolutePath, CachePath, CacheSize, HWDevice, ExtraHWFrames, Timecodes, VarPrefix, Env);
+    return new AvisynthVideoSource(Source, Track, FPSNum, FPSDen, RFF, Threads, SeekPreroll, EnableDrefs, UseAbsolutePath, CachePath, CacheSize, HWDevice, ExtraHWFrames, Timecodes, VarPrefix, Statistics, ProxyScale, SampledHash, AccessLogPath, Env);
 }
 
 class AvisynthAudioSource : public IClip {
@@ -345,7 +375,7 @@ class AvisynthAudioSource : public IClip {
     std::unique_ptr<BestAudioSource> A;
 public:
     AvisynthAudioSource(const char *Source, int Track,
-        int AdjustDelay, int Threads, bool EnableDrefs, bool UseAbsolutePath, double DrcScale, const char *CachePath, int CacheSize, IScriptEnvironment *Env) {
+        int AdjustDelay, int Threads, bool EnableDrefs, bool UseAbsolutePath, double DrcScale, bool Statistics, int OutputBits, bool OutputFloat, const char *CachePath, int CacheSize, const char *AccessLogPath, IScriptEnvironment *Env) {
 
         std::map<std::string, std::string> Opts;
         if (EnableDrefs)
@@ -354,7 +384,9 @@ public:
             Opts["use_absolute_path"] = "1";
 
         try {
-            A.reset(new BestAudioSource(Source, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale));
+            A.reset(new BestAudioSource(Source, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale, Statistics));
+            if (OutputBits > 0)
+                A->SetOutputFormat(OutputFloat, OutputBits);
 
             const AudioProperties &AP = A->GetAudioProperties();
             if (AP.AF.Float && AP.AF.Bits == 32) {
@@ -374,7 +406,9 @@ public:
             VI.nchannels = AP.Channels;
             if (AP.ChannelLayout <= std::numeric_limits<unsigned>::max())
                 VI.SetChannelMask(true, static_cast<unsigned>(AP.ChannelLayout));
-            
+
+            if (AccessLogPath)
+                A->SetAccessLog(AccessLogPath);
         } catch (AudioException &e) {
             Env->ThrowError("BestAudioSource: %s", e.what());
         }
@@ -424,8 +458,12 @@ static AVSValue __cdecl CreateBSAudioSource(AVSValue Args, void *UserData, IScri
     double DrcScale = Args[6].AsFloat(0);
     const char *CachePath = Args[7].AsString("");
     int CacheSize = Args[8].AsInt(-1);
+    int OutputBits = Args[9].AsInt(0);
+    bool OutputFloat = Args[10].AsBool(false);
+    bool Statistics = Args[11].AsBool(false);
+    const char *AccessLogPath = Args[12].AsString(nullptr);
 
-    return new AvisynthAudioSource(Source, Track, AdjustDelay, Threads, EnableDrefs, UseAbsolutePath, DrcScale, CachePath, CacheSize, Env);
+    return new AvisynthAudioSource(Source, Track, AdjustDelay, Threads, EnableDrefs, UseAbsolutePath, DrcScale, Statistics, OutputBits, OutputFloat, CachePath, CacheSize, AccessLogPath, Env);
 }
 
 static AVSValue __cdecl BSSetDebugOutput(AVSValue Args, void *UserData, IScriptEnvironment *Env) {
@@ -439,15 +477,24 @@ static AVSValue __cdecl BSSetFFmpegLogLevel(AVSValue Args, void *UserData, IScri
     return SetFFmpegLogLevel(Args[0].AsInt(32));
 }
 
+static AVSValue __cdecl BSSetTraceFile(AVSValue Args, void *UserData, IScriptEnvironment *Env) {
+    BSInit();
+    const char *Filename = Args[0].AsString("");
+    if (!SetBSTraceFile(Filename))
+        Env->ThrowError("BSSetTraceFile: Couldn't open trace file '%s'", Filename);
+    return AVSValue();
+}
+
 const AVS_Linkage *AVS_linkage = nullptr;
 
 extern "C" AVS_EXPORT const char *__stdcall AvisynthPluginInit3(IScriptEnvironment * Env, const AVS_Linkage *const vectors) {
     AVS_linkage = vectors;
 
-    Env->AddFunction("BSVideoSource", "[source]s[track]i[fpsnum]i[fpsden]i[rff]b[threads]i[seekpreroll]i[enable_drefs]b[use_absolute_path]b[cachepath]s[cachesize]i[hwdevice]s[extrahwframes]i[timecodes]s[varprefix]s", CreateBSVideoSource, nullptr);
-    Env->AddFunction("BSAudioSource", "[source]s[track]i[adjustdelay]i[threads]i[enable_drefs]b[use_absolute_path]b[drc_scale]f[cachepath]s[cachesize]i", CreateBSAudioSource, nullptr);
+    Env->AddFunction("BSVideoSource", "[source]s[track]i[fpsnum]i[fpsden]i[rff]b[threads]i[seekpreroll]i[enable_drefs]b[use_absolute_path]b[cachepath]s[cachesize]i[hwdevice]s[extrahwframes]i[timecodes]s[varprefix]s[statistics]b[proxyscale]i[accesslog]s[sampledhash]b", CreateBSVideoSource, nullptr);
+    Env->AddFunction("BSAudioSource", "[source]s[track]i[adjustdelay]i[threads]i[enable_drefs]b[use_absolute_path]b[drc_scale]f[cachepath]s[cachesize]i[outputbits]i[outputfloat]b[statistics]b[accesslog]s", CreateBSAudioSource, nullptr);
     Env->AddFunction("BSSetDebugOutput", "b[enable]", BSSetDebugOutput, nullptr);
     Env->AddFunction("BSSetFFmpegLogLevel", "i[level]", BSSetFFmpegLogLevel, nullptr);
+    Env->AddFunction("BSSetTraceFile", "[filename]s", BSSetTraceFile, nullptr);
 
     return "Best Source 2";
 }
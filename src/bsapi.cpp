@@ -0,0 +1,320 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "bsapi.h"
+#include "videosource.h"
+#include "audiosource.h"
+#include <cstring>
+#include <new>
+
+struct BSVideoSource {
+    std::unique_ptr<BestVideoSource> V;
+};
+
+struct BSAudioSource {
+    std::unique_ptr<BestAudioSource> A;
+};
+
+static thread_local std::string LastError;
+
+static BSError SetError(BSError Error, const char *Message) {
+    LastError = Message;
+    return Error;
+}
+
+// Exceptions must never cross the C boundary so every entry point goes through this, it also clears the last error on success
+template<typename T>
+static BSError Guard(T &&Func) {
+    try {
+        LastError.clear();
+        return Func();
+    } catch (VideoException &e) {
+        return SetError(bsErrorVideo, e.what());
+    } catch (AudioException &e) {
+        return SetError(bsErrorAudio, e.what());
+    } catch (std::bad_alloc &) {
+        return SetError(bsErrorOutOfMemory, "Out of memory");
+    } catch (std::exception &e) {
+        return SetError(bsErrorUnknown, e.what());
+    } catch (...) {
+        return SetError(bsErrorUnknown, "Unknown error");
+    }
+}
+
+static std::map<std::string, std::string> GetOptions(const char *const *Options) {
+    std::map<std::string, std::string> Result;
+    for (; Options && Options[0] && Options[1]; Options += 2)
+        Result[Options[0]] = Options[1];
+    return Result;
+}
+
+static std::function<void(int Track, int64_t Current, int64_t Total)> GetProgress(BSProgressFunc Progress, void *UserData) {
+    if (!Progress)
+        return nullptr;
+    return [Progress, UserData](int Track, int64_t Current, int64_t Total) { Progress(UserData, Track, Current, Total); };
+}
+
+BS_API int BS_GetAPIVersion(void) {
+    return BS_API_VERSION;
+}
+
+BS_API const char *BS_GetLastError(void) {
+    return LastError.c_str();
+}
+
+BS_API BSError BS_OpenVideoSource(const char *SourceFile, int Track, int Threads, const char *CachePath, const char *HWDevice, int ExtraHWFrames,
+    const char *const *LAVFOptions, int ComputeStatistics, BSProgressFunc Progress, void *UserData, BSVideoSource **Source) {
+    return Guard([&]() {
+        if (!SourceFile || !Source)
+            return SetError(bsErrorInvalidArgument, "SourceFile and Source must not be NULL");
+        *Source = nullptr;
+
+        std::map<std::string, std::string> Opts = GetOptions(LAVFOptions);
+        std::unique_ptr<BSVideoSource> S(new BSVideoSource());
+        S->V.reset(new BestVideoSource(SourceFile, HWDevice ? HWDevice : "", ExtraHWFrames, Track, false, Threads, CachePath ? CachePath : "", &Opts, !!ComputeStatistics, 0, false, GetProgress(Progress, UserData)));
+        *Source = S.release();
+        return bsSuccess;
+    });
+}
+
+BS_API void BS_CloseVideoSource(BSVideoSource *Source) {
+    delete Source;
+}
+
+BS_API BSError BS_GetVideoProperties(BSVideoSource *Source, BSVideoProperties *Properties) {
+    return Guard([&]() {
+        if (!Source || !Properties)
+            return SetError(bsErrorInvalidArgument, "Source and Properties must not be NULL");
+
+        const VideoProperties &VP = Source->V->GetVideoProperties();
+        *Properties = {};
+        Properties->NumFrames = VP.NumFrames;
+        Properties->NumRFFFrames = VP.NumRFFFrames;
+        Properties->Duration = VP.Duration;
+        Properties->StartTime = VP.StartTime;
+        Properties->TimeBaseNum = VP.TimeBase.Num;
+        Properties->TimeBaseDen = VP.TimeBase.Den;
+        Properties->FPSNum = VP.FPS.Num;
+        Properties->FPSDen = VP.FPS.Den;
+        Properties->SARNum = VP.SAR.Num;
+        Properties->SARDen = VP.SAR.Den;
+        Properties->Width = VP.Width;
+        Properties->Height = VP.Height;
+        Properties->ColorFamily = VP.VF.ColorFamily;
+        Properties->Alpha = VP.VF.Alpha;
+        Properties->Float = VP.VF.Float;
+        Properties->Bits = VP.VF.Bits;
+        Properties->SubSamplingW = VP.VF.SubSamplingW;
+        Properties->SubSamplingH = VP.VF.SubSamplingH;
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_SetVideoCacheSize(BSVideoSource *Source, int64_t Bytes) {
+    return Guard([&]() {
+        if (!Source || Bytes < 0)
+            return SetError(bsErrorInvalidArgument, "Invalid argument");
+        Source->V->SetMaxCacheSize(static_cast<size_t>(Bytes));
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_SetVideoSeekPreRoll(BSVideoSource *Source, int64_t Frames) {
+    return Guard([&]() {
+        if (!Source)
+            return SetError(bsErrorInvalidArgument, "Source must not be NULL");
+
+        Source->V->SetSeekPreRoll(Frames);
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_GetVideoFrame(BSVideoSource *Source, int64_t N, uint8_t *const *Planes, const ptrdiff_t *Strides, uint8_t *Alpha, ptrdiff_t AlphaStride, BSVideoFrameInfo *Info) {
+    return Guard([&]() {
+        if (!Source || !Planes || !Strides)
+            return SetError(bsErrorInvalidArgument, "Source, Planes and Strides must not be NULL");
+        if (N < 0 || N >= Source->V->GetVideoProperties().NumFrames)
+            return SetError(bsErrorOutOfRange, "Out of bounds frame requested");
+
+        std::shared_ptr<const BestVideoFrame> Src = Source->V->GetFrameRef(N);
+        if (!Src)
+            return SetError(bsErrorVideo, "No frame returned");
+
+        const VideoProperties &VP = Source->V->GetVideoProperties();
+        if (Src->Width != VP.Width || Src->Height != VP.Height || Src->VF.ColorFamily != VP.VF.ColorFamily || Src->VF.Bits != VP.VF.Bits)
+            return SetError(bsErrorUnsupported, "Frame format differs from the first frame");
+
+        // Gray only has a single plane so the caller's arrays may be shorter
+        int NumPlanes = (VP.VF.ColorFamily == 1) ? 1 : 3;
+        uint8_t *Dsts[3] = {};
+        ptrdiff_t DstStrides[3] = {};
+        for (int i = 0; i < NumPlanes; i++) {
+            Dsts[i] = Planes[i];
+            DstStrides[i] = Strides[i];
+        }
+        if (!Src->ExportAsPlanar(Dsts, DstStrides, Alpha, AlphaStride))
+            return SetError(bsErrorUnsupported, "Cannot export frame as planar");
+
+        if (Info) {
+            *Info = {};
+            Info->Pts = Src->Pts;
+            Info->Duration = Src->Duration;
+            Info->Matrix = Src->Matrix;
+            Info->Primaries = Src->Primaries;
+            Info->Transfer = Src->Transfer;
+            Info->ChromaLocation = Src->ChromaLocation;
+            Info->ColorRange = Src->ColorRange;
+            Info->InterlacedFrame = Src->InterlacedFrame;
+            Info->TopFieldFirst = Src->TopFieldFirst;
+            Info->KeyFrame = Src->KeyFrame;
+            Info->RepeatPict = Src->RepeatPict;
+            Info->PictType = Src->PictType;
+        }
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_GetVideoFrameStatistics(BSVideoSource *Source, int64_t N, BSVideoStatistics *Statistics) {
+    return Guard([&]() {
+        if (!Source || !Statistics)
+            return SetError(bsErrorInvalidArgument, "Source and Statistics must not be NULL");
+        if (!Source->V->HasStatistics())
+            return SetError(bsErrorUnsupported, "Statistics weren't computed when the index was created");
+        if (N < 0 || N >= Source->V->GetVideoProperties().NumFrames)
+            return SetError(bsErrorOutOfRange, "Out of bounds frame requested");
+
+        const VideoStatistics &VS = Source->V->GetFrameStatistics(N);
+        static_assert(sizeof(Statistics->Thumbnail) == sizeof(VS.Thumbnail));
+        Statistics->LumaMin = VS.LumaMin;
+        Statistics->LumaMax = VS.LumaMax;
+        Statistics->LumaMean = VS.LumaMean;
+        Statistics->LumaDiff = VS.LumaDiff;
+        memcpy(Statistics->Thumbnail, VS.Thumbnail.data(), sizeof(Statistics->Thumbnail));
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_OpenAudioSource(const char *SourceFile, int Track, int AdjustDelay, int Threads, const char *CachePath,
+    const char *const *LAVFOptions, double DrcScale, int ComputeStatistics, BSProgressFunc Progress, void *UserData, BSAudioSource **Source) {
+    return Guard([&]() {
+        if (!SourceFile || !Source)
+            return SetError(bsErrorInvalidArgument, "SourceFile and Source must not be NULL");
+        *Source = nullptr;
+
+        std::map<std::string, std::string> Opts = GetOptions(LAVFOptions);
+        std::unique_ptr<BSAudioSource> S(new BSAudioSource());
+        S->A.reset(new BestAudioSource(SourceFile, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale, !!ComputeStatistics, GetProgress(Progress, UserData)));
+        *Source = S.release();
+        return bsSuccess;
+    });
+}
+
+BS_API void BS_CloseAudioSource(BSAudioSource *Source) {
+    delete Source;
+}
+
+BS_API BSError BS_GetAudioProperties(BSAudioSource *Source, BSAudioProperties *Properties) {
+    return Guard([&]() {
+        if (!Source || !Properties)
+            return SetError(bsErrorInvalidArgument, "Source and Properties must not be NULL");
+
+        const AudioProperties &AP = Source->A->GetAudioProperties();
+        *Properties = {};
+        Properties->NumFrames = AP.NumFrames;
+        Properties->NumSamples = AP.NumSamples;
+        Properties->StartTime = AP.StartTime;
+        Properties->ChannelLayout = AP.ChannelLayout;
+        Properties->SampleRate = AP.SampleRate;
+        Properties->Channels = AP.Channels;
+        Properties->Float = AP.AF.Float;
+        Properties->Bits = AP.AF.Bits;
+        Properties->BytesPerSample = AP.AF.BytesPerSample;
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_SetAudioCacheSize(BSAudioSource *Source, int64_t Bytes) {
+    return Guard([&]() {
+        if (!Source || Bytes < 0)
+            return SetError(bsErrorInvalidArgument, "Invalid argument");
+        Source->A->SetMaxCacheSize(static_cast<size_t>(Bytes));
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_SetAudioOutputFormat(BSAudioSource *Source, int Float, int Bits) {
+    return Guard([&]() {
+        if (!Source)
+            return SetError(bsErrorInvalidArgument, "Source must not be NULL");
+
+        Source->A->SetOutputFormat(!!Float, Bits);
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_GetPackedAudio(BSAudioSource *Source, uint8_t *Data, int64_t Start, int64_t Count) {
+    return Guard([&]() {
+        if (!Source || !Data || Count < 0)
+            return SetError(bsErrorInvalidArgument, "Invalid argument");
+
+        Source->A->GetPackedAudio(Data, Start, Count);
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_GetPlanarAudio(BSAudioSource *Source, uint8_t *const *Data, int64_t Start, int64_t Count) {
+    return Guard([&]() {
+        if (!Source || !Data || Count < 0)
+            return SetError(bsErrorInvalidArgument, "Invalid argument");
+
+        Source->A->GetPlanarAudio(Data, Start, Count);
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_GetAudioTrackStatistics(BSAudioSource *Source, BSAudioStatistics *Statistics) {
+    return Guard([&]() {
+        if (!Source || !Statistics)
+            return SetError(bsErrorInvalidArgument, "Source and Statistics must not be NULL");
+        if (!Source->A->HasStatistics())
+            return SetError(bsErrorUnsupported, "Statistics weren't computed when the index was created");
+
+        const AudioStatistics &AS = Source->A->GetTrackStatistics();
+        Statistics->Peak = AS.Peak;
+        Statistics->RMS = AS.RMS;
+        Statistics->Loudness = AS.Loudness;
+        return bsSuccess;
+    });
+}
+
+BS_API BSError BS_GetAudioStatistics(BSAudioSource *Source, int64_t Start, int64_t Count, BSAudioStatistics *Statistics) {
+    return Guard([&]() {
+        if (!Source || !Statistics || Count < 0)
+            return SetError(bsErrorInvalidArgument, "Invalid argument");
+        if (!Source->A->HasStatistics())
+            return SetError(bsErrorUnsupported, "Statistics weren't computed when the index was created");
+
+        AudioStatistics AS = Source->A->GetStatisticsBySamples(Start, Count);
+        Statistics->Peak = AS.Peak;
+        Statistics->RMS = AS.RMS;
+        Statistics->Loudness = AS.Loudness;
+        return bsSuccess;
+    });
+}
@@ -0,0 +1,155 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BSAPI_H
+#define BSAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(BS_API_EXPORTS)
+#define BS_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define BS_API __declspec(dllimport)
+#else
+#define BS_API __attribute__((visibility("default")))
+#endif
+
+/* Bumped when the layout of any struct below or the signature of any function changes */
+#define BS_API_VERSION 1
+
+typedef struct BSVideoSource BSVideoSource;
+typedef struct BSAudioSource BSAudioSource;
+
+typedef enum BSError {
+    bsSuccess = 0,
+    bsErrorInvalidArgument = 1,
+    bsErrorOutOfRange = 2,
+    bsErrorUnsupported = 3, /* the requested data or conversion isn't available, for example statistics that weren't computed */
+    bsErrorVideo = 4,
+    bsErrorAudio = 5,
+    bsErrorOutOfMemory = 6,
+    bsErrorUnknown = 7
+} BSError;
+
+/* Called during indexing, Current == Total == INT64_MAX signals completion */
+typedef void (*BSProgressFunc)(void *UserData, int Track, int64_t Current, int64_t Total);
+
+typedef struct BSVideoProperties {
+    int64_t NumFrames;
+    int64_t NumRFFFrames;
+    int64_t Duration; /* in TimeBase units */
+    double StartTime; /* in seconds */
+    int TimeBaseNum;
+    int TimeBaseDen;
+    int FPSNum;
+    int FPSDen;
+    int SARNum;
+    int SARDen;
+    int Width;
+    int Height;
+    int ColorFamily; /* Unknown = 0, Gray = 1, RGB = 2, YUV = 3 */
+    int Alpha;
+    int Float;
+    int Bits;
+    int SubSamplingW;
+    int SubSamplingH;
+} BSVideoProperties;
+
+typedef struct BSVideoFrameInfo {
+    int64_t Pts;
+    int64_t Duration;
+    int Matrix;
+    int Primaries;
+    int Transfer;
+    int ChromaLocation;
+    int ColorRange;
+    int InterlacedFrame;
+    int TopFieldFirst;
+    int KeyFrame;
+    int RepeatPict;
+    char PictType;
+} BSVideoFrameInfo;
+
+typedef struct BSVideoStatistics {
+    int LumaMin;
+    int LumaMax;
+    double LumaMean;
+    double LumaDiff;
+    uint8_t Thumbnail[64];
+} BSVideoStatistics;
+
+typedef struct BSAudioProperties {
+    int64_t NumFrames;
+    int64_t NumSamples;
+    double StartTime; /* in seconds */
+    uint64_t ChannelLayout;
+    int SampleRate;
+    int Channels;
+    int Float;
+    int Bits;
+    int BytesPerSample;
+} BSAudioProperties;
+
+typedef struct BSAudioStatistics {
+    double Peak;
+    double RMS;
+    double Loudness;
+} BSAudioStatistics;
+
+/* Returns BS_API_VERSION of the library */
+BS_API int BS_GetAPIVersion(void);
+
+/* The message of the last error that occurred in the calling thread, only valid until the next call */
+BS_API const char *BS_GetLastError(void);
+
+/* LAVFOptions is a NULL terminated array of key/value pairs or NULL, CachePath and HWDevice may be NULL */
+BS_API BSError BS_OpenVideoSource(const char *SourceFile, int Track, int Threads, const char *CachePath, const char *HWDevice, int ExtraHWFrames,
+    const char *const *LAVFOptions, int ComputeStatistics, BSProgressFunc Progress, void *UserData, BSVideoSource **Source);
+BS_API void BS_CloseVideoSource(BSVideoSource *Source);
+BS_API BSError BS_GetVideoProperties(BSVideoSource *Source, BSVideoProperties *Properties);
+BS_API BSError BS_SetVideoCacheSize(BSVideoSource *Source, int64_t Bytes);
+BS_API BSError BS_SetVideoSeekPreRoll(BSVideoSource *Source, int64_t Frames);
+/* Writes the planes of frame N directly into the caller's buffers which must match the format and dimensions in BSVideoProperties.
+ * Planes are in Y, U, V or R, G, B order and only the first entry of Planes and Strides is read for gray formats. Alpha may be NULL and Info may be NULL. */
+BS_API BSError BS_GetVideoFrame(BSVideoSource *Source, int64_t N, uint8_t *const *Planes, const ptrdiff_t *Strides, uint8_t *Alpha, ptrdiff_t AlphaStride, BSVideoFrameInfo *Info);
+BS_API BSError BS_GetVideoFrameStatistics(BSVideoSource *Source, int64_t N, BSVideoStatistics *Statistics);
+
+BS_API BSError BS_OpenAudioSource(const char *SourceFile, int Track, int AdjustDelay, int Threads, const char *CachePath,
+    const char *const *LAVFOptions, double DrcScale, int ComputeStatistics, BSProgressFunc Progress, void *UserData, BSAudioSource **Source);
+BS_API void BS_CloseAudioSource(BSAudioSource *Source);
+BS_API BSError BS_GetAudioProperties(BSAudioSource *Source, BSAudioProperties *Properties);
+BS_API BSError BS_SetAudioCacheSize(BSAudioSource *Source, int64_t Bytes);
+/* Converts all output to 16/32 bit integer or 32 bit float samples, pass Bits = 0 to restore the native format */
+BS_API BSError BS_SetAudioOutputFormat(BSAudioSource *Source, int Float, int Bits);
+BS_API BSError BS_GetPackedAudio(BSAudioSource *Source, uint8_t *Data, int64_t Start, int64_t Count);
+BS_API BSError BS_GetPlanarAudio(BSAudioSource *Source, uint8_t *const *Data, int64_t Start, int64_t Count);
+BS_API BSError BS_GetAudioTrackStatistics(BSAudioSource *Source, BSAudioStatistics *Statistics);
+BS_API BSError BS_GetAudioStatistics(BSAudioSource *Source, int64_t Start, int64_t Count, BSAudioStatistics *Statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,440 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+// Writes a frame range as Y4M or raw planar data, decoding, exporting and writing run as separate pipelined stages
+
+#include "videosource.h"
+#include "streamsource.h"
+#include "version.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/log.h>
+}
+
+template<typename T>
+class BoundedQueue {
+private:
+    std::mutex Mutex;
+    std::condition_variable NotEmpty;
+    std::condition_variable NotFull;
+    std::deque<T> Items;
+    size_t Capacity;
+    bool Closed = false;
+public:
+    explicit BoundedQueue(size_t Capacity) : Capacity(Capacity) {
+    }
+
+    // Blocks while the queue is full, returns false if the queue was closed
+    bool Push(T &&Item) {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        NotFull.wait(Lock, [this] { return Closed || Items.size() < Capacity; });
+        if (Closed)
+            return false;
+        Items.push_back(std::move(Item));
+        NotEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty, returns false once the queue is closed and drained
+    bool Pop(T &Item) {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        NotEmpty.wait(Lock, [this] { return Closed || !Items.empty(); });
+        if (Items.empty())
+            return false;
+        Item = std::move(Items.front());
+        Items.pop_front();
+        NotFull.notify_one();
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Closed = true;
+        NotEmpty.notify_all();
+        NotFull.notify_all();
+    }
+};
+
+struct DumpOptions {
+    int Track = -1;
+    int Threads = 0;
+    int64_t Start = 0;
+    int64_t End = -1;
+    bool RFF = false;
+    int FPSNum = -1;
+    int FPSDen = 1;
+    bool Y4M = true;
+    bool Stream = false;
+    size_t QueueDepth = 8;
+    std::string CachePath;
+    std::string Output = "-";
+};
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "BestSource %d.%d frame dumper\n"
+        "Usage: bsdump [options] file\n"
+        "  -T <track>    video track, negative numbers select the nth video track (default: -1)\n"
+        "  -t <n>        decoder threads, 0 = autodetect (default: 0)\n"
+        "  -s <n>        first frame to output (default: 0)\n"
+        "  -e <n>        last frame to output, -1 = last frame (default: -1)\n"
+        "  -r            apply RFF flags\n"
+        "  -f <num/den>  convert to constant frame rate\n"
+        "  -R            write raw planar data instead of Y4M\n"
+        "  -p            read the source once without indexing, needed for pipes, - = stdin\n"
+        "  -q <n>        number of frames buffered between stages (default: 8)\n"
+        "  -c <path>     full path of the index file (default: next to the source)\n"
+        "  -o <file>     output file, - = stdout (default: -)\n",
+        BEST_SOURCE_VERSION_MAJOR, BEST_SOURCE_VERSION_MINOR);
+}
+
+static int GetBytesPerSample(const VideoFormat &VF) {
+    if (VF.Bits <= 8)
+        return 1;
+    else if (VF.Bits <= 16)
+        return 2;
+    else
+        return 4;
+}
+
+// ExportAsPlanar() rounds chroma dimensions down so the extra column and row that odd sizes have in Y4M and raw output are filled by repeating the edge
+static void ExtendPlaneEdges(uint8_t *Plane, ptrdiff_t Stride, int Width, int Height, int ExportedWidth, int ExportedHeight, int BytesPerSample) {
+    if (ExportedWidth < 1 || ExportedHeight < 1)
+        return;
+    for (int y = 0; y < ExportedHeight; y++) {
+        uint8_t *Row = Plane + y * Stride;
+        for (int x = ExportedWidth; x < Width; x++)
+            memcpy(Row + x * BytesPerSample, Row + (ExportedWidth - 1) * BytesPerSample, BytesPerSample);
+    }
+    for (int y = ExportedHeight; y < Height; y++)
+        memcpy(Plane + y * Stride, Plane + (ExportedHeight - 1) * Stride, static_cast<size_t>(Width) * BytesPerSample);
+}
+
+// Returns an empty string if the format can't be represented in Y4M
+static std::string GetY4MColorspace(const VideoFormat &VF) {
+    if (VF.Float || VF.Bits > 16)
+        return "";
+    std::string Depth = (VF.Bits > 8) ? ("p" + std::to_string(VF.Bits)) : "";
+    if (VF.ColorFamily == 1)
+        return (VF.Bits > 8) ? "mono16" : "mono";
+    if (VF.ColorFamily != 3)
+        return "";
+    if (VF.SubSamplingW == 1 && VF.SubSamplingH == 1)
+        return (VF.Bits > 8) ? ("420" + Depth) : "420jpeg";
+    if (VF.SubSamplingW == 1 && VF.SubSamplingH == 0)
+        return "422" + Depth;
+    if (VF.SubSamplingW == 0 && VF.SubSamplingH == 0)
+        return "444" + Depth;
+    if (VF.SubSamplingW == 2 && VF.SubSamplingH == 0 && VF.Bits == 8)
+        return "411";
+    return "";
+}
+
+int main(int argc, char **argv) {
+    DumpOptions Options;
+    std::string Source;
+
+    for (int i = 1; i < argc; i++) {
+        std::string Arg = argv[i];
+        bool HasValue = (i + 1 < argc);
+        if (Arg == "-T" && HasValue) {
+            Options.Track = atoi(argv[++i]);
+        } else if (Arg == "-t" && HasValue) {
+            Options.Threads = atoi(argv[++i]);
+        } else if (Arg == "-s" && HasValue) {
+            Options.Start = atoll(argv[++i]);
+        } else if (Arg == "-e" && HasValue) {
+            Options.End = atoll(argv[++i]);
+        } else if (Arg == "-r") {
+            Options.RFF = true;
+        } else if (Arg == "-f" && HasValue) {
+            if (sscanf(argv[++i], "%d/%d", &Options.FPSNum, &Options.FPSDen) < 1 || Options.FPSNum <= 0 || Options.FPSDen <= 0) {
+                fprintf(stderr, "Invalid frame rate '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (Arg == "-R") {
+            Options.Y4M = false;
+        } else if (Arg == "-p") {
+            Options.Stream = true;
+        } else if (Arg == "-q" && HasValue) {
+            Options.QueueDepth = std::max(1, atoi(argv[++i]));
+        } else if (Arg == "-c" && HasValue) {
+            Options.CachePath = argv[++i];
+        } else if (Arg == "-o" && HasValue) {
+            Options.Output = argv[++i];
+        } else if (Arg.size() > 1 && Arg[0] == '-') {
+            PrintUsage();
+            return 1;
+        } else if (Source.empty()) {
+            Source = Arg;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (Source.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (Options.RFF && Options.FPSNum > 0) {
+        fprintf(stderr, "Cannot combine RFF and constant frame rate conversion\n");
+        return 1;
+    }
+
+    if (Options.Stream && (Options.RFF || Options.FPSNum > 0)) {
+        fprintf(stderr, "RFF and constant frame rate conversion need an index and can't be used when streaming\n");
+        return 1;
+    }
+
+    if (Options.Stream && Source == "-")
+        Source = "pipe:0";
+
+    SetFFmpegLogLevel(AV_LOG_QUIET);
+
+    std::unique_ptr<BestVideoSource> V;
+    std::unique_ptr<BestVideoStreamSource> S;
+    try {
+        std::map<std::string, std::string> Opts;
+        if (Options.Stream)
+            S.reset(new BestVideoStreamSource(Source, Options.Track, false, Options.Threads, &Opts));
+        else
+            V.reset(new BestVideoSource(Source, "", 0, Options.Track, false, Options.Threads, Options.CachePath, &Opts, false, 0, false));
+    } catch (VideoException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    const VideoProperties &VP = S ? S->GetVideoProperties() : V->GetVideoProperties();
+    BSRational FPS = VP.FPS;
+    int64_t NumFrames = VP.NumFrames;
+    if (Options.RFF) {
+        NumFrames = VP.NumRFFFrames;
+    } else if (Options.FPSNum > 0) {
+        FPS.Num = Options.FPSNum;
+        FPS.Den = Options.FPSDen;
+        NumFrames = std::max<int64_t>(1, static_cast<int64_t>(VP.Duration * VP.TimeBase.ToDouble() * FPS.Num / FPS.Den));
+    }
+
+    // The number of frames isn't known in advance when streaming so -1 means everything until the end of the stream
+    if (Options.Stream) {
+        if (Options.Start < 0 || (Options.End >= 0 && Options.Start > Options.End)) {
+            fprintf(stderr, "Invalid frame range\n");
+            return 1;
+        }
+    } else {
+        if (Options.End < 0 || Options.End >= NumFrames)
+            Options.End = NumFrames - 1;
+        if (Options.Start < 0 || Options.Start > Options.End) {
+            fprintf(stderr, "Invalid frame range, the clip has %" PRId64 " frames\n", NumFrames);
+            return 1;
+        }
+    }
+
+    std::string Colorspace = GetY4MColorspace(VP.VF);
+    if (Options.Y4M && Colorspace.empty()) {
+        fprintf(stderr, "The output format can't be represented in Y4M, use -R for raw output\n");
+        return 1;
+    }
+
+    // All planes are written back to back in Y, U, V or R, G, B order followed by alpha in raw mode
+    int BytesPerSample = GetBytesPerSample(VP.VF);
+    int NumPlanes = (VP.VF.ColorFamily == 1) ? 1 : 3;
+    bool HasAlpha = VP.VF.Alpha && !Options.Y4M;
+    size_t PlaneSizes[4] = {};
+    ptrdiff_t PlaneStrides[4] = {};
+    int PlaneHeights[4] = {};
+    size_t FrameSize = 0;
+    for (int p = 0; p < NumPlanes + (HasAlpha ? 1 : 0); p++) {
+        bool Chroma = (p == 1 || p == 2);
+        int Width = Chroma ? AV_CEIL_RSHIFT(VP.Width, VP.VF.SubSamplingW) : VP.Width;
+        int Height = Chroma ? AV_CEIL_RSHIFT(VP.Height, VP.VF.SubSamplingH) : VP.Height;
+        PlaneStrides[p] = static_cast<ptrdiff_t>(Width) * BytesPerSample;
+        PlaneHeights[p] = Height;
+        PlaneSizes[p] = PlaneStrides[p] * Height;
+        FrameSize += PlaneSizes[p];
+    }
+
+    FILE *OutFile = stdout;
+    if (Options.Output != "-") {
+        OutFile = fopen(Options.Output.c_str(), "wb");
+        if (!OutFile) {
+            fprintf(stderr, "Couldn't open '%s' for writing\n", Options.Output.c_str());
+            return 1;
+        }
+    } else {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    std::mutex ErrorMutex;
+    std::string Error;
+
+    BoundedQueue<std::shared_ptr<const BestVideoFrame>> DecodedQueue(Options.QueueDepth);
+    BoundedQueue<std::vector<uint8_t>> ExportedQueue(Options.QueueDepth);
+    BoundedQueue<std::vector<uint8_t>> FreeBuffers(Options.QueueDepth + 2);
+
+    for (size_t i = 0; i < Options.QueueDepth + 2; i++)
+        FreeBuffers.Push(std::vector<uint8_t>(FrameSize));
+
+    auto Abort = [&](const std::string &Message) {
+        {
+            std::lock_guard<std::mutex> Lock(ErrorMutex);
+            if (Error.empty())
+                Error = Message;
+        }
+        DecodedQueue.Close();
+        ExportedQueue.Close();
+        FreeBuffers.Close();
+    };
+
+    // Demuxing happens inside the decoder so the first stage covers both
+    std::thread DecodeThread([&]() {
+        try {
+            for (int64_t N = Options.Start; Options.End < 0 || N <= Options.End; N++) {
+                std::shared_ptr<const BestVideoFrame> Frame;
+                if (S) {
+                    Frame.reset(S->GetFrame(N));
+                    if (!Frame && S->IsEndOfStream())
+                        break;
+                } else if (Options.RFF) {
+                    Frame.reset(V->GetFrameWithRFF(N));
+                } else if (Options.FPSNum > 0) {
+                    Frame.reset(V->GetFrameByTime(VP.StartTime + static_cast<double>(N * FPS.Den) / FPS.Num));
+                } else {
+                    Frame = V->GetFrameRef(N);
+                }
+
+                if (!Frame) {
+                    Abort("No frame returned for frame number " + std::to_string(N));
+                    return;
+                }
+
+                if (!DecodedQueue.Push(std::move(Frame)))
+                    return;
+            }
+        } catch (std::exception &e) {
+            Abort(e.what());
+        } catch (...) {
+            Abort("Unknown error while decoding");
+        }
+        DecodedQueue.Close();
+    });
+
+    auto ExportFrames = [&]() {
+        std::shared_ptr<const BestVideoFrame> Frame;
+        std::vector<uint8_t> Buffer;
+        while (DecodedQueue.Pop(Frame)) {
+            if (Frame->Width != VP.Width || Frame->Height != VP.Height || Frame->VF.ColorFamily != VP.VF.ColorFamily || Frame->VF.Bits != VP.VF.Bits ||
+                Frame->VF.SubSamplingW != VP.VF.SubSamplingW || Frame->VF.SubSamplingH != VP.VF.SubSamplingH) {
+                Abort("Frame format differs from the first frame");
+                return;
+            }
+
+            if (!FreeBuffers.Pop(Buffer))
+                return;
+
+            uint8_t *Dsts[3] = {};
+            ptrdiff_t Strides[3] = {};
+            uint8_t *Ptr = Buffer.data();
+            for (int p = 0; p < 3; p++) {
+                Dsts[p] = (p < NumPlanes) ? Ptr : nullptr;
+                Strides[p] = PlaneStrides[p];
+                Ptr += PlaneSizes[p];
+            }
+
+            if (!Frame->ExportAsPlanar(Dsts, Strides, HasAlpha ? Ptr : nullptr, PlaneStrides[3])) {
+                Abort("Cannot export frame as planar");
+                return;
+            }
+
+            for (int p = 1; p < NumPlanes; p++)
+                ExtendPlaneEdges(Dsts[p], Strides[p], static_cast<int>(Strides[p] / BytesPerSample), PlaneHeights[p], VP.Width >> VP.VF.SubSamplingW, VP.Height >> VP.VF.SubSamplingH, BytesPerSample);
+
+            Frame.reset();
+            if (!ExportedQueue.Push(std::move(Buffer)))
+                return;
+        }
+        ExportedQueue.Close();
+    };
+
+    std::thread ExportThread([&]() {
+        try {
+            ExportFrames();
+        } catch (std::exception &e) {
+            Abort(e.what());
+        } catch (...) {
+            Abort("Unknown error while exporting");
+        }
+    });
+
+    auto Start = std::chrono::steady_clock::now();
+    int64_t FramesWritten = 0;
+
+    if (Options.Y4M)
+        fprintf(OutFile, "YUV4MPEG2 W%d H%d F%d:%d Ip A%d:%d C%s\n", VP.Width, VP.Height, FPS.Num, FPS.Den, std::max(VP.SAR.Num, 0), std::max(VP.SAR.Den, 0), Colorspace.c_str());
+
+    std::vector<uint8_t> Buffer;
+    while (ExportedQueue.Pop(Buffer)) {
+        if ((Options.Y4M && fputs("FRAME\n", OutFile) < 0) || fwrite(Buffer.data(), 1, Buffer.size(), OutFile) != Buffer.size()) {
+            Abort("Write failed");
+            break;
+        }
+        FramesWritten++;
+        FreeBuffers.Push(std::move(Buffer));
+    }
+
+    DecodeThread.join();
+    ExportThread.join();
+
+    if (OutFile != stdout)
+        fclose(OutFile);
+    else
+        fflush(stdout);
+
+    double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    fprintf(stderr, "Output %" PRId64 " frames in %.2f s (%.2f fps, %.1f MB/s)\n", FramesWritten, Elapsed,
+        FramesWritten / std::max(Elapsed, 0.001), FramesWritten * static_cast<double>(FrameSize) / (1024 * 1024 * std::max(Elapsed, 0.001)));
+
+    if (!Error.empty()) {
+        fprintf(stderr, "%s\n", Error.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+// Batch indexer, every file is a job where all selected tracks are indexed together from a single demuxing pass and jobs run concurrently
+
+#include "videosource.h"
+#include "audiosource.h"
+#include "version.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/log.h>
+}
+
+struct IndexJob {
+    int Track;
+    bool Video;
+};
+
+struct FileJob {
+    std::string Source;
+    std::vector<IndexJob> Tracks;
+};
+
+struct IndexOptions {
+    int Jobs = 0;
+    int Threads = 1;
+    bool AllTracks = false;
+    bool Statistics = false;
+    bool SampledHash = false;
+    bool Quiet = false;
+    std::vector<int> Tracks;
+    std::string CacheDir;
+};
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "BestSource %d.%d batch indexer\n"
+        "Usage: bsindex [options] file...\n"
+        "  -j <n>        number of files to index concurrently (default: number of cores)\n"
+        "  -t <n>        decoder threads per job, 0 = autodetect (default: 1)\n"
+        "  -T <track>    absolute track number to index, can be repeated (default: first video and audio track)\n"
+        "  -a            index all video and audio tracks\n"
+        "  -c <dir>      directory to mirror the absolute source paths in for the index files (default: next to the source)\n"
+        "  -s            compute statistics while indexing\n"
+        "  -H            identify video frames by sampled hashes, faster for very big frames\n"
+        "  -q            only print errors and the summary\n",
+        BEST_SOURCE_VERSION_MAJOR, BEST_SOURCE_VERSION_MINOR);
+}
+
+// The absolute path of the source is mirrored below CacheDir so files with the same name in different directories get different index files
+static std::string GetCachePath(const IndexOptions &Options, const std::string &Source) {
+    if (Options.CacheDir.empty())
+        return Source;
+    std::filesystem::path Absolute = std::filesystem::absolute(std::filesystem::u8path(Source)).lexically_normal();
+    // Only the drive letter or server name of the root is kept on Windows
+    std::string RootName = Absolute.root_name().u8string();
+    RootName.erase(std::remove_if(RootName.begin(), RootName.end(), [](char C) { return C == ':' || C == '/' || C == '\\'; }), RootName.end());
+    std::filesystem::path Result = std::filesystem::u8path(Options.CacheDir) / std::filesystem::u8path(RootName) / Absolute.relative_path();
+    std::error_code Error;
+    std::filesystem::create_directories(Result.parent_path(), Error);
+    return Result.u8string();
+}
+
+// Returns false if the file can't be opened
+static bool AddJobs(const IndexOptions &Options, const std::string &Source, std::vector<FileJob> &Jobs) {
+    AVFormatContext *FormatContext = nullptr;
+    if (avformat_open_input(&FormatContext, Source.c_str(), nullptr, nullptr) != 0)
+        return false;
+
+    if (avformat_find_stream_info(FormatContext, nullptr) < 0) {
+        avformat_close_input(&FormatContext);
+        return false;
+    }
+
+    bool HasVideo = false;
+    bool HasAudio = false;
+    FileJob Job = { Source, {} };
+
+    for (int i = 0; i < static_cast<int>(FormatContext->nb_streams); i++) {
+        AVMediaType Type = FormatContext->streams[i]->codecpar->codec_type;
+        if (Type != AVMEDIA_TYPE_VIDEO && Type != AVMEDIA_TYPE_AUDIO)
+            continue;
+        // Cover art and similar are flagged as attached pictures and aren't real video tracks
+        if (FormatContext->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC)
+            continue;
+
+        bool Video = (Type == AVMEDIA_TYPE_VIDEO);
+        bool Selected;
+        if (!Options.Tracks.empty())
+            Selected = std::find(Options.Tracks.begin(), Options.Tracks.end(), i) != Options.Tracks.end();
+        else
+            Selected = Options.AllTracks || (Video ? !HasVideo : !HasAudio);
+
+        if (Selected)
+            Job.Tracks.push_back({ i, Video });
+
+        HasVideo = HasVideo || Video;
+        HasAudio = HasAudio || !Video;
+    }
+
+    avformat_close_input(&FormatContext);
+    if (!Job.Tracks.empty())
+        Jobs.push_back(Job);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    IndexOptions Options;
+    std::vector<std::string> Files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string Arg = argv[i];
+        bool HasValue = (i + 1 < argc);
+        if (Arg == "-j" && HasValue) {
+            Options.Jobs = atoi(argv[++i]);
+        } else if (Arg == "-t" && HasValue) {
+            Options.Threads = atoi(argv[++i]);
+        } else if (Arg == "-T" && HasValue) {
+            Options.Tracks.push_back(atoi(argv[++i]));
+        } else if (Arg == "-c" && HasValue) {
+            Options.CacheDir = argv[++i];
+        } else if (Arg == "-a") {
+            Options.AllTracks = true;
+        } else if (Arg == "-s") {
+            Options.Statistics = true;
+        } else if (Arg == "-H") {
+            Options.SampledHash = true;
+        } else if (Arg == "-q") {
+            Options.Quiet = true;
+        } else if (Arg == "-h" || Arg == "--help" || (!Arg.empty() && Arg[0] == '-')) {
+            PrintUsage();
+            return 1;
+        } else {
+            Files.push_back(Arg);
+        }
+    }
+
+    if (Files.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    SetFFmpegLogLevel(AV_LOG_QUIET);
+
+    std::atomic<int> Failed(0);
+    std::vector<FileJob> Jobs;
+    for (const auto &Iter : Files) {
+        if (!AddJobs(Options, Iter, Jobs)) {
+            fprintf(stderr, "Couldn't open '%s'\n", Iter.c_str());
+            Failed++;
+        }
+    }
+
+    if (Options.Jobs < 1)
+        Options.Jobs = std::max(1u, std::thread::hardware_concurrency());
+    Options.Jobs = std::min<int>(Options.Jobs, static_cast<int>(Jobs.size()));
+
+    std::mutex OutputMutex;
+    std::atomic<size_t> NextJob(0);
+    std::atomic<int> Indexed(0);
+    std::atomic<int> Skipped(0);
+    int64_t IndexedBytes = 0;
+    auto Start = std::chrono::steady_clock::now();
+
+    // Runs in its own thread for every track of a file since the tracks share the packets read from the file
+    auto IndexTrack = [&](const std::string &Source, const std::string &CachePath, const IndexJob &Job, SharedPacketReader *Packets, std::atomic<bool> &FileIndexed) {
+        bool WasIndexed = false;
+        auto Progress = [&WasIndexed](int, int64_t, int64_t) { WasIndexed = true; };
+        auto JobStart = std::chrono::steady_clock::now();
+        std::string Error;
+
+        try {
+            std::map<std::string, std::string> Opts;
+            if (Job.Video)
+                BestVideoSource(Source, "", 0, Job.Track, false, Options.Threads, CachePath, &Opts, Options.Statistics, 0, Options.SampledHash, Progress, Packets);
+            else
+                BestAudioSource(Source, Job.Track, -2, false, Options.Threads, CachePath, &Opts, 0, Options.Statistics, Progress, Packets);
+        } catch (VideoException &e) {
+            Error = e.what();
+        } catch (AudioException &e) {
+            Error = e.what();
+        } catch (std::exception &e) {
+            Error = e.what();
+        }
+
+        // The other tracks would wait for this one to read the packets queued for it otherwise
+        if (Packets)
+            Packets->Release(Job.Track);
+
+        double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - JobStart).count();
+
+        std::lock_guard<std::mutex> Lock(OutputMutex);
+        if (!Error.empty()) {
+            Failed++;
+            fprintf(stderr, "Failed '%s' track #%d: %s\n", Source.c_str(), Job.Track, Error.c_str());
+        } else if (WasIndexed) {
+            Indexed++;
+            FileIndexed = true;
+            if (!Options.Quiet)
+                fprintf(stderr, "Indexed '%s' %s track #%d in %.2f s\n", Source.c_str(), Job.Video ? "video" : "audio", Job.Track, Elapsed);
+        } else {
+            Skipped++;
+            if (!Options.Quiet)
+                fprintf(stderr, "Skipped '%s' %s track #%d, index is already valid\n", Source.c_str(), Job.Video ? "video" : "audio", Job.Track);
+        }
+    };
+
+    auto Worker = [&]() {
+        for (size_t JobNum = NextJob++; JobNum < Jobs.size(); JobNum = NextJob++) {
+            const FileJob &Job = Jobs[JobNum];
+            std::string CachePath = GetCachePath(Options, Job.Source);
+
+            // A single track reads the file with its own decoder like any other source
+            std::unique_ptr<SharedPacketReader> Packets;
+            if (Job.Tracks.size() > 1) {
+                std::set<int> Tracks;
+                for (const auto &Iter : Job.Tracks)
+                    Tracks.insert(Iter.Track);
+                std::map<std::string, std::string> Opts;
+                Packets.reset(new SharedPacketReader(Job.Source, Tracks, &Opts));
+                if (!Packets->IsOpen())
+                    Packets.reset();
+            }
+
+            std::atomic<bool> FileIndexed(false);
+            std::vector<std::thread> TrackThreads;
+            for (const auto &Iter : Job.Tracks)
+                TrackThreads.emplace_back(IndexTrack, std::cref(Job.Source), std::cref(CachePath), std::cref(Iter), Packets.get(), std::ref(FileIndexed));
+            for (auto &Iter : TrackThreads)
+                Iter.join();
+
+            if (FileIndexed) {
+                std::lock_guard<std::mutex> Lock(OutputMutex);
+                IndexedBytes += GetFileSize(Job.Source);
+            }
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    for (int i = 0; i < Options.Jobs; i++)
+        Threads.emplace_back(Worker);
+    for (auto &Iter : Threads)
+        Iter.join();
+
+    double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    fprintf(stderr, "%d indexed, %d skipped, %d failed in %.2f s (%.1f MB/s of source files, %.2f tracks/s)\n", Indexed.load(), Skipped.load(), Failed.load(), Elapsed,
+        IndexedBytes / (1024 * 1024 * std::max(Elapsed, 0.001)), Indexed / std::max(Elapsed, 0.001));
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BSKERNELS_H
+#define BSKERNELS_H
+
+// Internal inner loops and index data exposed so they can be benchmarked and verified in isolation, not part of the public API
+
+#include "videosource.h"
+#include "audiosource.h"
+
+std::array<uint8_t, HashSize> GetVideoFrameHash(const AVFrame *Frame, bool Sampled = false);
+std::array<uint8_t, HashSize> GetAudioFrameHash(const AVFrame *Frame);
+int GetVideoFramePacketSize(const AVFrame *Frame); /* -1 if the frame wasn't returned by LWVideoDecoder */
+void PackChannels(const uint8_t **Src, uint8_t *&Dst, size_t Length, size_t Channels, size_t BytesPerSample);
+void UnpackChannels(const uint8_t *Src, uint8_t *Dst[], size_t Length, size_t Channels, size_t BytesPerSample);
+
+struct BSKernelAccess {
+    using VideoCache = BestVideoSource::Cache;
+    using AudioCache = BestAudioSource::Cache;
+    using AudioFrameInfo = BestAudioSource::AudioTrackIndex::FrameInfo;
+
+    static BestAudioSource::FrameRange GetFrameRangeBySamples(const std::vector<AudioFrameInfo> &Frames, int64_t NumSamples, int64_t Start, int64_t Count) {
+        return BestAudioSource::GetFrameRangeBySamples(Frames, NumSamples, Start, Count);
+    }
+
+    static bool GetIndexedKeyFrame(const BestVideoSource &Source, int64_t N) {
+        return Source.TrackIndex.Frames[N].KeyFrame;
+    }
+};
+
+#endif
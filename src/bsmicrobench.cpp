@@ -0,0 +1,328 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+// Times the inner loops on synthetic frames so changes can be measured without any source files
+
+#include "bskernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+}
+
+static double MinTime = 0.25;
+static std::string Filter;
+
+// Keeps the compiler from removing work whose result is otherwise unused
+static volatile uint64_t Sink;
+
+// Runs Func with an increasing number of iterations until the run takes at least MinTime
+template<typename T>
+static void Run(const std::string &Name, double BytesPerOp, T &&Func) {
+    if (!Filter.empty() && Name.find(Filter) == std::string::npos)
+        return;
+
+    Func(); // warm up
+    int64_t Iterations = 1;
+    double Elapsed = 0;
+    while (true) {
+        auto Start = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < Iterations; i++)
+            Func();
+        Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        if (Elapsed >= MinTime)
+            break;
+        Iterations *= (Elapsed > 0) ? std::min<int64_t>(std::max<int64_t>(2, static_cast<int64_t>(MinTime * 1.2 / Elapsed)), 100) : 100;
+    }
+
+    double NsPerOp = Elapsed * 1e9 / Iterations;
+    if (BytesPerOp > 0)
+        printf("%-56s %14.1f ns/op %10.2f GB/s\n", Name.c_str(), NsPerOp, BytesPerOp / NsPerOp);
+    else
+        printf("%-56s %14.1f ns/op\n", Name.c_str(), NsPerOp);
+    fflush(stdout);
+}
+
+static void FillRandom(uint8_t *Data, size_t Size, std::mt19937 &Gen) {
+    std::uniform_int_distribution<int> Dist(0, 255);
+    for (size_t i = 0; i < Size; i++)
+        Data[i] = static_cast<uint8_t>(Dist(Gen));
+}
+
+static AVFrame *CreateVideoFrame(AVPixelFormat Format, int Width, int Height, std::mt19937 &Gen) {
+    AVFrame *F = av_frame_alloc();
+    F->format = Format;
+    F->width = Width;
+    F->height = Height;
+    if (av_frame_get_buffer(F, 0) < 0)
+        throw VideoException("Failed to allocate synthetic video frame");
+
+    // High bit depth formats are filled with in range values so conversions behave like on real content
+    const AVPixFmtDescriptor *Desc = av_pix_fmt_desc_get(Format);
+    for (int p = 0; p < 4 && F->data[p]; p++) {
+        int PlaneHeight = (p == 1 || p == 2) ? AV_CEIL_RSHIFT(Height, Desc->log2_chroma_h) : Height;
+        FillRandom(F->data[p], static_cast<size_t>(F->linesize[p]) * PlaneHeight, Gen);
+        if (Desc->comp[0].depth > 8 && Desc->comp[0].depth < 16 && !(Desc->flags & AV_PIX_FMT_FLAG_FLOAT)) {
+            uint16_t *Data = reinterpret_cast<uint16_t *>(F->data[p]);
+            for (size_t i = 0; i < static_cast<size_t>(F->linesize[p]) * PlaneHeight / 2; i++)
+                Data[i] &= (1 << Desc->comp[0].depth) - 1;
+        }
+    }
+    return F;
+}
+
+static AVFrame *CreateAudioFrame(AVSampleFormat Format, int Channels, int Samples, std::mt19937 &Gen) {
+    AVFrame *F = av_frame_alloc();
+    F->format = Format;
+    F->nb_samples = Samples;
+    av_channel_layout_default(&F->ch_layout, Channels);
+    if (av_frame_get_buffer(F, 0) < 0)
+        throw AudioException("Failed to allocate synthetic audio frame");
+
+    size_t BytesPerSample = av_get_bytes_per_sample(Format);
+    if (av_sample_fmt_is_planar(Format)) {
+        for (int c = 0; c < Channels; c++)
+            FillRandom(F->extended_data[c], BytesPerSample * Samples, Gen);
+    } else {
+        FillRandom(F->extended_data[0], BytesPerSample * Samples * Channels, Gen);
+    }
+    return F;
+}
+
+static size_t GetVideoFrameBytes(const AVFrame *F) {
+    const AVPixFmtDescriptor *Desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(F->format));
+    size_t Bytes = 0;
+    for (int c = 0; c < Desc->nb_components; c++) {
+        bool Chroma = (c == 1 || c == 2) && !(Desc->flags & AV_PIX_FMT_FLAG_RGB);
+        size_t W = Chroma ? AV_CEIL_RSHIFT(F->width, Desc->log2_chroma_w) : F->width;
+        size_t H = Chroma ? AV_CEIL_RSHIFT(F->height, Desc->log2_chroma_h) : F->height;
+        Bytes += W * H * ((Desc->comp[c].depth + 7) / 8);
+    }
+    return Bytes;
+}
+
+static void BenchmarkVideoKernels(std::mt19937 &Gen) {
+    static const AVPixelFormat Formats[] = { AV_PIX_FMT_GRAY8, AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P10, AV_PIX_FMT_P010, AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV444P16, AV_PIX_FMT_YUVA420P, AV_PIX_FMT_RGB24, AV_PIX_FMT_GBRPF32 };
+    static const int Sizes[][2] = { { 720, 480 }, { 1920, 1080 }, { 3840, 2160 } };
+
+    for (const auto &Size : Sizes) {
+        for (AVPixelFormat Format : Formats) {
+            AVFrame *F = CreateVideoFrame(Format, Size[0], Size[1], Gen);
+            BestVideoFrame Frame(F);
+            BestVideoFrame FieldSrc(F);
+            double Bytes = static_cast<double>(GetVideoFrameBytes(F));
+            std::string Suffix = std::string(" ") + av_get_pix_fmt_name(Format) + " " + std::to_string(Size[0]) + "x" + std::to_string(Size[1]);
+
+            Run("GetHash (video)" + Suffix, Bytes, [&]() {
+                Sink = Sink + GetVideoFrameHash(F)[0];
+            });
+
+            Run("GetHash sampled (video)" + Suffix, Bytes, [&]() {
+                Sink = Sink + GetVideoFrameHash(F, true)[0];
+            });
+
+            int BytesPerSample = (Frame.VF.Bits + 7) / 8;
+            std::vector<std::vector<uint8_t>> Planes(4);
+            uint8_t *Dsts[3] = {};
+            ptrdiff_t Strides[3] = {};
+            for (int p = 0; p < 4; p++) {
+                bool Chroma = (p == 1 || p == 2);
+                ptrdiff_t Stride = static_cast<ptrdiff_t>(Chroma ? (Frame.Width >> Frame.VF.SubSamplingW) : Frame.Width) * BytesPerSample;
+                Planes[p].resize(Stride * (Chroma ? (Frame.Height >> Frame.VF.SubSamplingH) : Frame.Height));
+                if (p < 3) {
+                    Dsts[p] = Planes[p].data();
+                    Strides[p] = Stride;
+                }
+            }
+            ptrdiff_t AlphaStride = static_cast<ptrdiff_t>(Frame.Width) * BytesPerSample;
+            uint8_t *AlphaDst = Frame.VF.Alpha ? Planes[3].data() : nullptr;
+
+            Run("ExportAsPlanar" + Suffix, Bytes, [&]() {
+                Frame.ExportAsPlanar(Dsts, Strides, AlphaDst, AlphaStride);
+            });
+
+            // The destination is the only reference to its buffers so MergeField() doesn't have to copy it to make it writable
+            AVFrame *MergeF = CreateVideoFrame(Format, Size[0], Size[1], Gen);
+            BestVideoFrame MergeDst(MergeF);
+            av_frame_free(&MergeF);
+
+            Run("MergeField" + Suffix, Bytes / 2, [&]() {
+                MergeDst.MergeField(false, &FieldSrc);
+            });
+
+            av_frame_free(&F);
+        }
+    }
+}
+
+static void BenchmarkAudioKernels(std::mt19937 &Gen) {
+    static const AVSampleFormat Formats[] = { AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_DBLP };
+    static const int ChannelCounts[] = { 2, 6, 8 };
+    static const int SampleCounts[] = { 1024, 48000 };
+
+    for (int Samples : SampleCounts) {
+        for (int Channels : ChannelCounts) {
+            for (AVSampleFormat Format : Formats) {
+                AVFrame *F = CreateAudioFrame(Format, Channels, Samples, Gen);
+                size_t BytesPerSample = av_get_bytes_per_sample(Format);
+                double Bytes = static_cast<double>(BytesPerSample) * Samples * Channels;
+                std::string Suffix = std::string(" ") + av_get_sample_fmt_name(Format) + " " + std::to_string(Channels) + "ch " + std::to_string(Samples);
+
+                Run("GetHash (audio)" + Suffix, Bytes, [&]() {
+                    Sink = Sink + GetAudioFrameHash(F)[0];
+                });
+
+                std::vector<uint8_t> Packed(static_cast<size_t>(Bytes));
+                std::vector<std::vector<uint8_t>> Planar(Channels, std::vector<uint8_t>(BytesPerSample * Samples));
+
+                if (av_sample_fmt_is_planar(Format)) {
+                    Run("PackChannels" + Suffix, Bytes, [&]() {
+                        std::vector<const uint8_t *> Src(F->extended_data, F->extended_data + Channels);
+                        uint8_t *Dst = Packed.data();
+                        PackChannels(Src.data(), Dst, Samples, Channels, BytesPerSample);
+                    });
+                } else {
+                    Run("UnpackChannels" + Suffix, Bytes, [&]() {
+                        std::vector<uint8_t *> Dst;
+                        for (auto &Iter : Planar)
+                            Dst.push_back(Iter.data());
+                        UnpackChannels(F->extended_data[0], Dst.data(), Samples, Channels, BytesPerSample);
+                    });
+                }
+
+                av_frame_free(&F);
+            }
+        }
+    }
+}
+
+// Fills a cache of the given size and then requests frames at increasing distance from the most recently used one
+template<typename CacheType, typename T>
+static void BenchmarkCache(const std::string &Name, AVFrame *Template, size_t FrameBytes, size_t MaxSize, T &&Delete) {
+    CacheType Cache;
+    Cache.SetMaxSize(MaxSize);
+    int64_t Capacity = std::max<int64_t>(1, MaxSize / FrameBytes);
+    std::string Suffix = " " + std::to_string(MaxSize / (1024 * 1024)) + "MB (" + std::to_string(Capacity) + " frames)";
+
+    int64_t N = 0;
+    Run(Name + "::CacheFrame" + Suffix, 0, [&]() {
+        Cache.CacheFrame(N++, av_frame_clone(Template));
+    });
+
+    // Make sure the cache is full and in a known order before looking things up
+    Cache.Clear();
+    for (N = 0; N < Capacity; N++)
+        Cache.CacheFrame(N, av_frame_clone(Template));
+
+    for (int64_t Distance : { int64_t(0), Capacity / 2, Capacity - 1 }) {
+        // The requested frame moves to the front so requesting the frame at a fixed depth rotates the first Distance + 1 frames
+        int64_t Request = 0;
+        Run(Name + "::GetFrame" + Suffix + " depth " + std::to_string(Distance), 0, [&]() {
+            Delete(Cache.GetFrame(N - 1 - Distance + (Request++ % (Distance + 1))));
+        });
+
+        Cache.Clear();
+        for (N = 0; N < Capacity; N++)
+            Cache.CacheFrame(N, av_frame_clone(Template));
+    }
+
+    Run(Name + "::GetFrame" + Suffix + " miss", 0, [&]() {
+        Delete(Cache.GetFrame(-1));
+    });
+}
+
+static void BenchmarkCaches(std::mt19937 &Gen) {
+    static const size_t CacheSizes[] = { 16 * 1024 * 1024, 256 * 1024 * 1024, 1024 * 1024 * 1024 };
+
+    AVFrame *VideoTemplate = CreateVideoFrame(AV_PIX_FMT_YUV420P, 1920, 1080, Gen);
+    AVFrame *AudioTemplate = CreateAudioFrame(AV_SAMPLE_FMT_FLTP, 2, 1024, Gen);
+
+    for (size_t MaxSize : CacheSizes) {
+        BenchmarkCache<BSKernelAccess::VideoCache>("VideoCache", VideoTemplate, GetVideoFrameBytes(VideoTemplate), MaxSize, [](BestVideoFrame *F) { delete F; });
+        BenchmarkCache<BSKernelAccess::AudioCache>("AudioCache", AudioTemplate, 2 * 1024 * sizeof(float), MaxSize, [](BestAudioFrame *F) { delete F; });
+    }
+
+    av_frame_free(&VideoTemplate);
+    av_frame_free(&AudioTemplate);
+}
+
+static void BenchmarkFrameRange(std::mt19937 &Gen) {
+    static const int64_t FrameCounts[] = { 1000, 100000, 1000000 };
+
+    for (int64_t NumFrames : FrameCounts) {
+        std::vector<BSKernelAccess::AudioFrameInfo> Frames(NumFrames);
+        int64_t NumSamples = 0;
+        for (auto &Iter : Frames) {
+            Iter.Start = NumSamples;
+            Iter.Length = 1024;
+            NumSamples += Iter.Length;
+        }
+
+        std::uniform_int_distribution<int64_t> Dist(0, NumSamples - 1);
+        std::vector<int64_t> Positions(1024);
+        for (auto &Iter : Positions)
+            Iter = Dist(Gen);
+
+        size_t Next = 0;
+        Run("GetFrameRangeBySamples " + std::to_string(NumFrames) + " frames", 0, [&]() {
+            auto Range = BSKernelAccess::GetFrameRangeBySamples(Frames, NumSamples, Positions[Next++ % Positions.size()], 4096);
+            Sink = Sink + Range.First;
+        });
+    }
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string Arg = argv[i];
+        if (Arg == "-t" && i + 1 < argc) {
+            MinTime = atof(argv[++i]);
+        } else if (Arg.size() > 1 && Arg[0] == '-') {
+            fprintf(stderr, "Usage: bsmicrobench [-t seconds per benchmark] [name filter]\n");
+            return 1;
+        } else {
+            Filter = Arg;
+        }
+    }
+
+    std::mt19937 Gen(42);
+
+    try {
+        BenchmarkVideoKernels(Gen);
+        BenchmarkAudioKernels(Gen);
+        BenchmarkCaches(Gen);
+        BenchmarkFrameRange(Gen);
+    } catch (VideoException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    } catch (AudioException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
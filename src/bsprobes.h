@@ -0,0 +1,44 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#ifndef BSPROBES_H
+#define BSPROBES_H
+
+// USDT probes for attaching bpftrace and similar tools to a running process, they compile to a single nop
+// when nothing is attached and to nothing at all when sys/sdt.h isn't available
+
+#ifdef BS_USDT
+#include <sys/sdt.h>
+
+#define BS_PROBE(Name) DTRACE_PROBE(bestsource, Name)
+#define BS_PROBE1(Name, A) DTRACE_PROBE1(bestsource, Name, A)
+#define BS_PROBE2(Name, A, B) DTRACE_PROBE2(bestsource, Name, A, B)
+#define BS_PROBE3(Name, A, B, C) DTRACE_PROBE3(bestsource, Name, A, B, C)
+#define BS_PROBE4(Name, A, B, C, D) DTRACE_PROBE4(bestsource, Name, A, B, C, D)
+#else
+#define BS_PROBE(Name) do {} while (0)
+#define BS_PROBE1(Name, A) do {} while (0)
+#define BS_PROBE2(Name, A, B) do {} while (0)
+#define BS_PROBE3(Name, A, B, C) do {} while (0)
+#define BS_PROBE4(Name, A, B, C, D) do {} while (0)
+#endif
+
+#endif
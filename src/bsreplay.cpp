@@ -0,0 +1,216 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+// Replays a recorded access log against a source with different settings and reports the latency distribution
+
+#include "videosource.h"
+#include "audiosource.h"
+#include "version.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/log.h>
+}
+
+struct ReplayOptions {
+    int64_t CacheSize = -1;
+    int64_t PreRoll = -1;
+    int Decoders = 0;
+    int Threads = 0;
+    bool Linear = false;
+    bool Paced = false;
+    std::string CachePath;
+};
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "BestSource %d.%d access log replay\n"
+        "Usage: bsreplay [options] source log\n"
+        "  -m <n>        cache size in MB (default: library default)\n"
+        "  -p <n>        seek preroll in frames (default: library default)\n"
+        "  -d <n>        number of decoders, 1-4 (default: 4)\n"
+        "  -t <n>        decoder threads, 0 = autodetect (default: 0)\n"
+        "  -l            request all frames in linear mode\n"
+        "  -w            wait between requests like in the recording instead of issuing them back to back\n"
+        "  -c <path>     full path of the index file (default: next to the source)\n",
+        BEST_SOURCE_VERSION_MAJOR, BEST_SOURCE_VERSION_MINOR);
+}
+
+static void PrintDistribution(const char *Name, std::vector<int64_t> Values) {
+    if (Values.empty())
+        return;
+    std::sort(Values.begin(), Values.end());
+    double Sum = 0;
+    for (int64_t Iter : Values)
+        Sum += Iter;
+    auto Percentile = [&Values](double P) { return Values[std::min(Values.size() - 1, static_cast<size_t>(P * Values.size()))]; };
+    printf("%-10s mean %10.0f  min %8" PRId64 "  p50 %8" PRId64 "  p90 %8" PRId64 "  p99 %8" PRId64 "  max %8" PRId64 " us\n", Name,
+        Sum / Values.size(), Values.front(), Percentile(0.5), Percentile(0.9), Percentile(0.99), Values.back());
+}
+
+static void PrintCounters(const DecodeCounters &Counters) {
+    printf("Requests %" PRId64 ", cache hits %" PRId64 ", seeks %" PRId64 ", decoded frames %" PRId64 ", decoders created %" PRId64 ", bad seeks %" PRId64 ", linear fallbacks %" PRId64 "\n",
+        Counters.Requests, Counters.CacheHits, Counters.Seeks, Counters.DecodedFrames, Counters.DecoderCreations, Counters.BadSeeks, Counters.LinearFallbacks);
+}
+
+int main(int argc, char **argv) {
+    ReplayOptions Options;
+    std::vector<std::string> Files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string Arg = argv[i];
+        bool HasValue = (i + 1 < argc);
+        if (Arg == "-m" && HasValue) {
+            Options.CacheSize = atoll(argv[++i]);
+        } else if (Arg == "-p" && HasValue) {
+            Options.PreRoll = atoll(argv[++i]);
+        } else if (Arg == "-d" && HasValue) {
+            Options.Decoders = atoi(argv[++i]);
+        } else if (Arg == "-t" && HasValue) {
+            Options.Threads = atoi(argv[++i]);
+        } else if (Arg == "-l") {
+            Options.Linear = true;
+        } else if (Arg == "-w") {
+            Options.Paced = true;
+        } else if (Arg == "-c" && HasValue) {
+            Options.CachePath = argv[++i];
+        } else if (Arg.size() > 1 && Arg[0] == '-') {
+            PrintUsage();
+            return 1;
+        } else {
+            Files.push_back(Arg);
+        }
+    }
+
+    if (Files.size() != 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    bool Video;
+    int Track;
+    std::vector<AccessLog::Entry> Entries;
+    if (!AccessLog::Read(Files[1], Video, Track, Entries)) {
+        fprintf(stderr, "Couldn't read access log '%s'\n", Files[1].c_str());
+        return 1;
+    }
+
+    SetFFmpegLogLevel(AV_LOG_QUIET);
+
+    std::vector<int64_t> Recorded;
+    std::vector<int64_t> Replayed;
+    Recorded.reserve(Entries.size());
+    Replayed.reserve(Entries.size());
+    int Failed = 0;
+
+    try {
+        std::map<std::string, std::string> Opts;
+        std::unique_ptr<BestVideoSource> V;
+        std::unique_ptr<BestAudioSource> A;
+        std::vector<uint8_t> Buffer;
+        std::vector<uint8_t *> Planes;
+
+        if (Video) {
+            V.reset(new BestVideoSource(Files[0], "", 0, Track, false, Options.Threads, Options.CachePath, &Opts, false, 0, false));
+            if (Options.CacheSize >= 0)
+                V->SetMaxCacheSize(Options.CacheSize * 1024 * 1024);
+            if (Options.PreRoll >= 0)
+                V->SetSeekPreRoll(Options.PreRoll);
+            if (Options.Decoders > 0)
+                V->SetMaxDecoders(Options.Decoders);
+        } else {
+            A.reset(new BestAudioSource(Files[0], Track, -1, false, Options.Threads, Options.CachePath, &Opts, 0, false));
+            if (Options.CacheSize >= 0)
+                A->SetMaxCacheSize(Options.CacheSize * 1024 * 1024);
+            if (Options.PreRoll >= 0)
+                A->SetSeekPreRoll(Options.PreRoll);
+            if (Options.Decoders > 0)
+                A->SetMaxDecoders(Options.Decoders);
+        }
+
+        auto Origin = std::chrono::steady_clock::now();
+
+        for (const auto &Iter : Entries) {
+            if (Options.Paced)
+                std::this_thread::sleep_until(Origin + std::chrono::microseconds(Iter.Start));
+
+            auto Start = std::chrono::steady_clock::now();
+            bool Success = true;
+
+            switch (Iter.Type) {
+                case AccessLog::rtVideoFrame:
+                    Success = !!std::unique_ptr<BestVideoFrame>(V->GetFrame(Iter.Arg, Options.Linear));
+                    break;
+                case AccessLog::rtVideoFrameRFF:
+                    Success = !!std::unique_ptr<BestVideoFrame>(V->GetFrameWithRFF(Iter.Arg, Options.Linear));
+                    break;
+                case AccessLog::rtVideoFrameByTime: {
+                    double Time;
+                    memcpy(&Time, &Iter.Arg, sizeof(Time));
+                    Success = !!std::unique_ptr<BestVideoFrame>(V->GetFrameByTime(Time, Options.Linear));
+                    break;
+                }
+                case AccessLog::rtAudioFrame:
+                    Success = !!std::unique_ptr<BestAudioFrame>(A->GetFrame(Iter.Arg, Options.Linear));
+                    break;
+                case AccessLog::rtPackedAudio:
+                case AccessLog::rtPlanarAudio: {
+                    const AudioProperties &AP = A->GetAudioProperties();
+                    size_t PlaneSize = static_cast<size_t>(Iter.Count) * AP.AF.BytesPerSample;
+                    Buffer.resize(PlaneSize * AP.Channels);
+                    if (Iter.Type == AccessLog::rtPackedAudio) {
+                        A->GetPackedAudio(Buffer.data(), Iter.Arg, Iter.Count);
+                    } else {
+                        Planes.clear();
+                        for (int i = 0; i < AP.Channels; i++)
+                            Planes.push_back(Buffer.data() + i * PlaneSize);
+                        A->GetPlanarAudio(Planes.data(), Iter.Arg, Iter.Count);
+                    }
+                    break;
+                }
+            }
+
+            if (!Success)
+                Failed++;
+            Recorded.push_back(Iter.Duration);
+            Replayed.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count());
+        }
+
+        double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Origin).count();
+        printf("Replayed %zu %s requests in %.2f s, %d failed\n", Entries.size(), Video ? "video" : "audio", Elapsed, Failed);
+        PrintDistribution("Recorded", Recorded);
+        PrintDistribution("Replayed", Replayed);
+        PrintCounters(Video ? V->GetDecodeCounters() : A->GetDecodeCounters());
+    } catch (VideoException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    } catch (AudioException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return Failed ? 1 : 0;
+}
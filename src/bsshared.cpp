@@ -61,6 +61,77 @@ void BSDebugPrint(const std::string_view Message, int64_t RequestedN, int64_t Cu
     }
 }
 
+// Uses the JSON array format where every event is written immediately, viewers accept it without the closing bracket
+// so the trace is still usable if the process never stops tracing
+
+static std::atomic_bool TraceEnabled(false);
+static std::mutex TraceMutex;
+static file_ptr_t TraceFile;
+static std::chrono::steady_clock::time_point TraceOrigin;
+static bool TraceFirstEvent = true;
+
+bool SetBSTraceFile(const std::string &Filename) {
+    std::lock_guard<std::mutex> Lock(TraceMutex);
+    TraceEnabled = false;
+    if (TraceFile) {
+        fputs("\n]\n", TraceFile.get());
+        TraceFile.reset();
+    }
+
+    if (!Filename.empty()) {
+        TraceFile = OpenFile(Filename, true);
+        if (!TraceFile)
+            return false;
+        fputs("[\n", TraceFile.get());
+        TraceOrigin = std::chrono::steady_clock::now();
+        TraceFirstEvent = true;
+        TraceEnabled = true;
+    }
+
+    return true;
+}
+
+static int GetTraceThreadID() {
+    static std::atomic_int NextID(1);
+    thread_local int ID = NextID++;
+    return ID;
+}
+
+static void WriteTraceEvent(const char *Name, char Phase, std::chrono::steady_clock::time_point Start, std::chrono::steady_clock::time_point End, int64_t N) {
+    int ThreadID = GetTraceThreadID();
+    std::lock_guard<std::mutex> Lock(TraceMutex);
+    if (!TraceFile)
+        return;
+
+    double Timestamp = std::chrono::duration<double, std::micro>(Start - TraceOrigin).count();
+    fprintf(TraceFile.get(), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", TraceFirstEvent ? "" : ",\n", Name, Phase, Timestamp, ThreadID);
+    if (Phase == 'X')
+        fprintf(TraceFile.get(), ",\"dur\":%.3f", std::chrono::duration<double, std::micro>(End - Start).count());
+    else
+        fputs(",\"s\":\"t\"", TraceFile.get());
+    if (N >= 0)
+        fprintf(TraceFile.get(), ",\"args\":{\"frame\":%" PRId64 "}", N);
+    fputs("}", TraceFile.get());
+    TraceFirstEvent = false;
+}
+
+void BSTraceInstant(const char *Name, int64_t N) {
+    if (TraceEnabled.load(std::memory_order_relaxed)) {
+        auto Now = std::chrono::steady_clock::now();
+        WriteTraceEvent(Name, 'i', Now, Now, N);
+    }
+}
+
+BSTraceSpan::BSTraceSpan(const char *Name, int64_t N) : Name(Name), N(N), Active(TraceEnabled.load(std::memory_order_relaxed)) {
+    if (Active)
+        Start = std::chrono::steady_clock::now();
+}
+
+BSTraceSpan::~BSTraceSpan() {
+    if (Active)
+        WriteTraceEvent(Name, 'X', Start, std::chrono::steady_clock::now(), N);
+}
+
 #ifdef _WIN32
 #include <windows.h>
 
@@ -95,8 +166,36 @@ int64_t GetFileSize(const std::string &Filename) {
 #endif
 }
 
-file_ptr_t OpenCacheFile(const std::string &CachePath, int Track, bool Write) {
-    return OpenFile(CachePath + "." + std::to_string(Track) + ".bsindex", Write);
+bool RemoveFile(const std::string &Filename) {
+#ifdef _WIN32
+    return _wremove(Utf16FromUtf8(Filename).c_str()) == 0;
+#else
+    return remove(Filename.c_str()) == 0;
+#endif
+}
+
+std::string GetCacheFilePath(const std::string &CachePath, int Track, const char *Extension) {
+    return CachePath + "." + std::to_string(Track) + "." + Extension;
+}
+
+file_ptr_t OpenCacheFile(const std::string &CachePath, int Track, bool Write, const char *Extension) {
+    return OpenFile(GetCacheFilePath(CachePath, Track, Extension), Write);
+}
+
+int64_t GetFilePosition(file_ptr_t &F) {
+#ifdef _WIN32
+    return _ftelli64(F.get());
+#else
+    return ftello(F.get());
+#endif
+}
+
+bool SetFilePosition(file_ptr_t &F, int64_t Position) {
+#ifdef _WIN32
+    return _fseeki64(F.get(), Position, SEEK_SET) == 0;
+#else
+    return fseeko(F.get(), Position, SEEK_SET) == 0;
+#endif
 }
 
 void WriteInt(file_ptr_t &F, int Value) {
@@ -116,8 +215,12 @@ void WriteString(file_ptr_t &F, const std::string &Value) {
     fwrite(Value.c_str(), 1, Value.size(), F.get());
 }
 
-void WriteBSHeader(file_ptr_t &F, bool Video) {
-    fwrite(Video ? "BS2V" : "BS2A", 1, 4, F.get());
+static const char *GetBSMagic(bool Video, bool SampledHash) {
+    return Video ? (SampledHash ? "BS2S" : "BS2V") : "BS2A";
+}
+
+void WriteBSHeader(file_ptr_t &F, bool Video, bool SampledHash) {
+    fwrite(GetBSMagic(Video, SampledHash), 1, 4, F.get());
     WriteInt(F, (BEST_SOURCE_VERSION_MAJOR << 16) | BEST_SOURCE_VERSION_MINOR);
     WriteInt(F, avutil_version());
     WriteInt(F, avformat_version());
@@ -179,13 +282,199 @@ bool ReadCompareString(file_ptr_t &F, const std::string &Value) {
     return (Value == Value2);
 }
 
-bool ReadBSHeader(file_ptr_t &F, bool Video) {
+bool ReadBSHeader(file_ptr_t &F, bool Video, bool *SampledHash) {
     char Magic[4] = {};
     if (fread(Magic, 1, sizeof(Magic), F.get()) != sizeof(Magic))
         return false;
-    return !memcmp(Video ? "BS2V" : "BS2A", Magic, sizeof(Magic)) &&
+    bool IsSampledHash = Video && SampledHash && !memcmp(GetBSMagic(true, true), Magic, sizeof(Magic));
+    if (SampledHash)
+        *SampledHash = IsSampledHash;
+    return !memcmp(GetBSMagic(Video, IsSampledHash), Magic, sizeof(Magic)) &&
         ReadCompareInt(F, (BEST_SOURCE_VERSION_MAJOR << 16) | BEST_SOURCE_VERSION_MINOR) &&
         ReadCompareInt(F, avutil_version()) &&
         ReadCompareInt(F, avformat_version()) &&
         ReadCompareInt(F, avcodec_version());
-}
\ No newline at end of file
+}
+AccessLog::AccessLog(const std::string &Filename, bool Video, int Track) : F(OpenFile(Filename, true)), Origin(std::chrono::steady_clock::now()) {
+    if (F) {
+        fwrite("BSAL", 1, 4, F.get());
+        WriteInt(F, 1);
+        WriteInt(F, Video);
+        WriteInt(F, Track);
+    }
+}
+
+bool AccessLog::IsOpen() const {
+    return !!F;
+}
+
+void AccessLog::Write(RequestType Type, std::chrono::steady_clock::time_point Start, int64_t Arg, int64_t Count) {
+    auto End = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> Lock(Mutex);
+    uint8_t TypeByte = Type;
+    fwrite(&TypeByte, 1, 1, F.get());
+    WriteInt64(F, std::chrono::duration_cast<std::chrono::microseconds>(Start - Origin).count());
+    WriteInt64(F, std::chrono::duration_cast<std::chrono::microseconds>(End - Start).count());
+    WriteInt64(F, Arg);
+    WriteInt64(F, Count);
+}
+
+bool AccessLog::Read(const std::string &Filename, bool &Video, int &Track, std::vector<Entry> &Entries) {
+    file_ptr_t F = OpenFile(Filename, false);
+    if (!F)
+        return false;
+
+    char Magic[4] = {};
+    if (fread(Magic, 1, sizeof(Magic), F.get()) != sizeof(Magic) || memcmp("BSAL", Magic, sizeof(Magic)) || !ReadCompareInt(F, 1))
+        return false;
+    Video = !!ReadInt(F);
+    Track = ReadInt(F);
+
+    Entries.clear();
+    uint8_t TypeByte;
+    while (fread(&TypeByte, 1, 1, F.get()) == 1) {
+        Entry E;
+        E.Type = static_cast<RequestType>(TypeByte);
+        E.Start = ReadInt64(F);
+        E.Duration = ReadInt64(F);
+        E.Arg = ReadInt64(F);
+        E.Count = ReadInt64(F);
+        if (TypeByte > rtPlanarAudio)
+            return false;
+        // A log that wasn't closed properly can end with a partial entry
+        if (E.Duration < 0 || E.Count < 0)
+            break;
+        Entries.push_back(E);
+    }
+
+    return true;
+}
+
+static thread_local int AccessLogDepth = 0;
+
+AccessLogScope::AccessLogScope(AccessLog *Log, AccessLog::RequestType Type, int64_t Arg, int64_t Count) : Log(Log), Type(Type), Arg(Arg), Count(Count), Outermost(AccessLogDepth++ == 0) {
+    if (Log && Outermost)
+        Start = std::chrono::steady_clock::now();
+}
+
+AccessLogScope::~AccessLogScope() {
+    AccessLogDepth--;
+    if (Log && Outermost)
+        Log->Write(Type, Start, Arg, Count);
+}
+
+SharedPacketReader::SharedPacketReader(const std::string &SourceFile, const std::set<int> &Tracks, const std::map<std::string, std::string> *LAVFOpts) {
+    AVDictionary *Dict = nullptr;
+    if (LAVFOpts)
+        for (const auto &Iter : *LAVFOpts)
+            av_dict_set(&Dict, Iter.first.c_str(), Iter.second.c_str(), 0);
+    int OpenRet = avformat_open_input(&FormatContext, SourceFile.c_str(), nullptr, &Dict);
+    av_dict_free(&Dict);
+    if (OpenRet != 0)
+        return;
+
+    // Streams are numbered the same way as in the decoders which also probe them
+    if (avformat_find_stream_info(FormatContext, nullptr) < 0) {
+        avformat_close_input(&FormatContext);
+        return;
+    }
+
+    for (int i = 0; i < static_cast<int>(FormatContext->nb_streams); i++) {
+        if (Tracks.count(i))
+            Queues[i];
+        else
+            FormatContext->streams[i]->discard = AVDISCARD_ALL;
+    }
+    SourceSize = avio_size(FormatContext->pb);
+}
+
+SharedPacketReader::~SharedPacketReader() {
+    for (auto &Iter : Queues)
+        for (auto &Packet : Iter.second.Packets)
+            av_packet_free(&Packet);
+    avformat_close_input(&FormatContext);
+}
+
+bool SharedPacketReader::IsOpen() const {
+    return !!FormatContext;
+}
+
+bool SharedPacketReader::IsOtherTrackFull(int Track) const {
+    for (const auto &Iter : Queues)
+        if (Iter.first != Track && !Iter.second.Released && Iter.second.Bytes > MaxQueuedBytes)
+            return true;
+    return false;
+}
+
+bool SharedPacketReader::ReadPacket(int Track, AVPacket *Packet) {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    auto Queue = Queues.find(Track);
+    if (Queue == Queues.end() || Queue->second.Released)
+        return false;
+    TrackQueue &Q = Queue->second;
+
+    while (true) {
+        if (!Q.Packets.empty()) {
+            AVPacket *Queued = Q.Packets.front();
+            Q.Packets.pop_front();
+            Q.Bytes -= Queued->size;
+            av_packet_move_ref(Packet, Queued);
+            av_packet_free(&Queued);
+            Condition.notify_all();
+            return true;
+        }
+
+        if (EndOfFile)
+            return false;
+
+        // Only one thread reads at a time and nothing is read while a track that isn't being decoded right now has too much queued
+        if (Reading || IsOtherTrackFull(Track)) {
+            Condition.wait(Lock);
+            continue;
+        }
+
+        Reading = true;
+        Lock.unlock();
+        AVPacket *Read = av_packet_alloc();
+        bool Success = Read && av_read_frame(FormatContext, Read) >= 0;
+        int64_t Position = avio_tell(FormatContext->pb);
+        Lock.lock();
+        Reading = false;
+        SourcePosition = Position;
+
+        if (Success) {
+            auto Target = Queues.find(Read->stream_index);
+            if (Target != Queues.end() && !Target->second.Released) {
+                Target->second.Bytes += Read->size;
+                Target->second.Packets.push_back(Read);
+                Read = nullptr;
+            }
+        } else {
+            EndOfFile = true;
+        }
+        av_packet_free(&Read);
+        Condition.notify_all();
+    }
+}
+
+void SharedPacketReader::Release(int Track) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto Queue = Queues.find(Track);
+    if (Queue == Queues.end())
+        return;
+    for (auto &Iter : Queue->second.Packets)
+        av_packet_free(&Iter);
+    Queue->second.Packets.clear();
+    Queue->second.Bytes = 0;
+    Queue->second.Released = true;
+    Condition.notify_all();
+}
+
+int64_t SharedPacketReader::GetSourceSize() const {
+    return SourceSize;
+}
+
+int64_t SharedPacketReader::GetSourcePosition() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return SourcePosition;
+}
@@ -24,6 +24,13 @@
 #include <memory>
 #include <cstdio>
 #include <string>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
 
 constexpr size_t HashSize = 8;
 
@@ -39,6 +46,8 @@ namespace std {
 typedef std::unique_ptr<FILE> file_ptr_t;
 
 struct AVRational;
+struct AVFormatContext;
+struct AVPacket;
 
 struct BSRational {
     int Num;
@@ -53,14 +62,35 @@ int SetFFmpegLogLevel(int Level);
 void SetBSDebugOutput(bool DebugOutput);
 void BSDebugPrint(const std::string_view Message, int64_t RequestedN = -1, int64_t CurrentN = -1);
 
+/* Writes timed spans and events from all threads as Chrome trace event JSON which can be opened in chrome://tracing or Perfetto,
+ * pass an empty string to stop tracing and finish the file, returns false if the file couldn't be created */
+bool SetBSTraceFile(const std::string &Filename);
+void BSTraceInstant(const char *Name, int64_t N = -1);
+
+/* Records the time from construction to destruction as a span, only costs an atomic load when tracing is off */
+class BSTraceSpan {
+private:
+    const char *Name;
+    int64_t N;
+    bool Active;
+    std::chrono::steady_clock::time_point Start;
+public:
+    BSTraceSpan(const char *Name, int64_t N = -1);
+    ~BSTraceSpan();
+};
+
 file_ptr_t OpenFile(const std::string &Filename, bool Write);
 int64_t GetFileSize(const std::string &Filename);
-file_ptr_t OpenCacheFile(const std::string &CachePath, int Track, bool Write);
+bool RemoveFile(const std::string &Filename);
+std::string GetCacheFilePath(const std::string &CachePath, int Track, const char *Extension = "bsindex");
+file_ptr_t OpenCacheFile(const std::string &CachePath, int Track, bool Write, const char *Extension = "bsindex");
+int64_t GetFilePosition(file_ptr_t &F);
+bool SetFilePosition(file_ptr_t &F, int64_t Position);
 void WriteInt(file_ptr_t &F, int Value);
 void WriteInt64(file_ptr_t &F, int64_t Value);
 void WriteDouble(file_ptr_t &F, double Value);
 void WriteString(file_ptr_t &F, const std::string &Value);
-void WriteBSHeader(file_ptr_t &F, bool Video);
+void WriteBSHeader(file_ptr_t &F, bool Video, bool SampledHash = false); /* video indexes with sampled hashes use their own magic so they're never mixed up with full hash ones */
 int ReadInt(file_ptr_t &F);
 int64_t ReadInt64(file_ptr_t &F);
 double ReadDouble(file_ptr_t &F);
@@ -69,6 +99,92 @@ bool ReadCompareInt(file_ptr_t &F, int Value);
 bool ReadCompareInt64(file_ptr_t &F, int64_t Value);
 bool ReadCompareDouble(file_ptr_t &F, double Value);
 bool ReadCompareString(file_ptr_t &F, const std::string &Value);
-bool ReadBSHeader(file_ptr_t &F, bool Video);
+bool ReadBSHeader(file_ptr_t &F, bool Video, bool *SampledHash = nullptr); /* if SampledHash is set video indexes of both hash types are accepted and the type is returned in it */
+
+struct DecodeCounters {
+    int64_t Requests; /* frame requests including the ones made internally for RFF and sample ranges */
+    int64_t CacheHits;
+    int64_t SharedCacheHits; /* frames found in the shared cache after missing the normal cache */
+    int64_t Seeks;
+    int64_t DecodedFrames; /* includes frames only decoded to reach the requested one */
+    int64_t DecoderCreations;
+    int64_t BadSeeks; /* seek points that failed to decode or couldn't be identified from the hashes */
+    int64_t LinearFallbacks; /* requests that had to be decoded linearly from the start after seeking failed */
+};
+
+/* Records every frame and sample request with its start time and duration for replay with bsreplay */
+class AccessLog {
+public:
+    enum RequestType : uint8_t {
+        rtVideoFrame = 0,
+        rtVideoFrameRFF = 1,
+        rtVideoFrameByTime = 2,
+        rtAudioFrame = 3,
+        rtPackedAudio = 4,
+        rtPlanarAudio = 5
+    };
+
+    struct Entry {
+        RequestType Type;
+        int64_t Start; /* microseconds since the log was opened */
+        int64_t Duration; /* microseconds */
+        int64_t Arg; /* frame number or first sample, for rtVideoFrameByTime the bits of the time as a double */
+        int64_t Count; /* number of samples, otherwise 0 */
+    };
+private:
+    std::mutex Mutex;
+    file_ptr_t F;
+    std::chrono::steady_clock::time_point Origin;
+public:
+    AccessLog(const std::string &Filename, bool Video, int Track);
+    [[nodiscard]] bool IsOpen() const;
+    void Write(RequestType Type, std::chrono::steady_clock::time_point Start, int64_t Arg, int64_t Count);
+    static bool Read(const std::string &Filename, bool &Video, int &Track, std::vector<Entry> &Entries);
+};
+
+/* Logs a request when it goes out of scope, requests made from within another logged request are ignored */
+class AccessLogScope {
+private:
+    AccessLog *Log;
+    AccessLog::RequestType Type;
+    int64_t Arg;
+    int64_t Count;
+    bool Outermost;
+    std::chrono::steady_clock::time_point Start;
+public:
+    AccessLogScope(AccessLog *Log, AccessLog::RequestType Type, int64_t Arg, int64_t Count = 0);
+    ~AccessLogScope();
+};
+
+/* Demuxes a file once for several decoders reading different tracks of it at the same time, used to index all tracks of a file in a single pass.
+ * Packets are queued for every track until its decoder reads them and reading stops while another track has too much queued, so every track
+ * needs its own thread and has to call Release() once it doesn't need any more packets, otherwise the others stall. */
+class SharedPacketReader {
+private:
+    struct TrackQueue {
+        std::deque<AVPacket *> Packets;
+        size_t Bytes = 0;
+        bool Released = false;
+    };
+
+    static constexpr size_t MaxQueuedBytes = 64 * 1024 * 1024;
+    AVFormatContext *FormatContext = nullptr;
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    std::map<int, TrackQueue> Queues;
+    bool Reading = false;
+    bool EndOfFile = false;
+    int64_t SourceSize = -1;
+    int64_t SourcePosition = 0;
+    [[nodiscard]] bool IsOtherTrackFull(int Track) const;
+public:
+    SharedPacketReader(const std::string &SourceFile, const std::set<int> &Tracks, const std::map<std::string, std::string> *LAVFOpts);
+    ~SharedPacketReader();
+    [[nodiscard]] bool IsOpen() const;
+    [[nodiscard]] bool ReadPacket(int Track, AVPacket *Packet); /* moves the next packet of Track into Packet, false at the end of the file */
+    void Release(int Track); /* drops everything queued for Track and stops queuing more */
+    [[nodiscard]] int64_t GetSourceSize() const;
+    [[nodiscard]] int64_t GetSourcePosition();
+};
 
 #endif
\ No newline at end of file
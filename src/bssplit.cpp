@@ -0,0 +1,115 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+// Prints chunk boundaries for distributed encoding that all start on keyframes which can be seeked to directly
+
+#include "videosource.h"
+#include "version.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/log.h>
+}
+
+struct SplitOptions {
+    int Track = -1;
+    int64_t ChunkFrames = 0;
+    int64_t Chunks = 0;
+    bool Verify = true;
+    std::string CachePath;
+};
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "BestSource %d.%d chunk splitter\n"
+        "Usage: bssplit [options] file\n"
+        "  -T <track>    video track, negative values select the nth video track (default: -1)\n"
+        "  -f <n>        approximate number of frames per chunk\n"
+        "  -n <n>        approximate number of chunks, alternative to -f\n"
+        "  -N            don't test seek to the chosen keyframes\n"
+        "  -c <path>     full path of the index file (default: next to the source)\n"
+        "Prints one line per chunk with its first frame, number of frames, start time in seconds and estimated decoding cost\n",
+        BEST_SOURCE_VERSION_MAJOR, BEST_SOURCE_VERSION_MINOR);
+}
+
+int main(int argc, char **argv) {
+    SplitOptions Options;
+    std::vector<std::string> Files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string Arg = argv[i];
+        bool HasValue = (i + 1 < argc);
+        if (Arg == "-T" && HasValue) {
+            Options.Track = atoi(argv[++i]);
+        } else if (Arg == "-f" && HasValue) {
+            Options.ChunkFrames = atoll(argv[++i]);
+        } else if (Arg == "-n" && HasValue) {
+            Options.Chunks = atoll(argv[++i]);
+        } else if (Arg == "-N") {
+            Options.Verify = false;
+        } else if (Arg == "-c" && HasValue) {
+            Options.CachePath = argv[++i];
+        } else if (Arg.size() > 1 && Arg[0] == '-') {
+            PrintUsage();
+            return 1;
+        } else {
+            Files.push_back(Arg);
+        }
+    }
+
+    if (Files.size() != 1 || (Options.ChunkFrames < 1) == (Options.Chunks < 1)) {
+        PrintUsage();
+        return 1;
+    }
+
+    SetFFmpegLogLevel(AV_LOG_QUIET);
+
+    try {
+        std::map<std::string, std::string> Opts;
+        BestVideoSource V(Files[0], "", 0, Options.Track, false, 1, Options.CachePath, &Opts, false, 0, false);
+        const VideoProperties &VP = V.GetVideoProperties();
+
+        int64_t ChunkFrames = Options.ChunkFrames;
+        if (Options.Chunks > 0)
+            ChunkFrames = std::max<int64_t>(1, (VP.NumFrames + Options.Chunks - 1) / Options.Chunks);
+
+        std::vector<VideoSplitPoint> SplitPoints = V.GetSplitPoints(ChunkFrames, Options.Verify);
+        double TotalCost = 0;
+        for (const auto &Iter : SplitPoints)
+            TotalCost += Iter.Cost;
+
+        printf("# chunk\tstart\tframes\ttime\tcost\n");
+        for (size_t i = 0; i < SplitPoints.size(); i++) {
+            double Time = (SplitPoints[i].PTS == AV_NOPTS_VALUE) ? 0 : (SplitPoints[i].PTS * VP.TimeBase.Num / static_cast<double>(VP.TimeBase.Den) - VP.StartTime);
+            printf("%zu\t%" PRId64 "\t%" PRId64 "\t%.3f\t%.1f\n", i, SplitPoints[i].Start, SplitPoints[i].NumFrames, Time, SplitPoints[i].Cost);
+        }
+        fprintf(stderr, "%zu chunks, %" PRId64 " frames, total estimated cost %.1f\n", SplitPoints.size(), VP.NumFrames, TotalCost);
+    } catch (VideoException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,258 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+// Checks that frames requested in random order are bit identical to the ones a plain linear decode of the file produces
+
+#include "videosource.h"
+#include "bskernels.h"
+#include "version.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <random>
+#include <map>
+#include <set>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/log.h>
+}
+
+struct VerifyOptions {
+    int Track = -1;
+    int Threads = 0;
+    int64_t Samples = 200;
+    uint64_t Seed = 1;
+    int64_t CacheSize = -1;
+    int64_t PreRoll = -1;
+    int Decoders = 0;
+    bool Linear = false;
+    std::string CachePath;
+};
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "BestSource %d.%d seek verifier\n"
+        "Usage: bsverify [options] file...\n"
+        "  -T <track>    video track, negative values select the nth video track (default: -1)\n"
+        "  -t <n>        decoder threads, 0 = autodetect (default: 0)\n"
+        "  -n <n>        number of frames to request in random order (default: 200)\n"
+        "  -S <n>        random seed (default: 1)\n"
+        "  -m <n>        cache size in MB (default: library default)\n"
+        "  -p <n>        seek preroll in frames (default: library default)\n"
+        "  -d <n>        number of decoders, 1-4 (default: 4)\n"
+        "  -l            also check every frame returned by linear decoding in the library\n"
+        "  -c <path>     full path of the index file, only usable with a single file (default: next to the source)\n",
+        BEST_SOURCE_VERSION_MAJOR, BEST_SOURCE_VERSION_MINOR);
+}
+
+static void PrintDistribution(const char *Name, std::vector<int64_t> Values) {
+    if (Values.empty())
+        return;
+    std::sort(Values.begin(), Values.end());
+    double Sum = 0;
+    for (int64_t Iter : Values)
+        Sum += Iter;
+    auto Percentile = [&Values](double P) { return Values[std::min(Values.size() - 1, static_cast<size_t>(P * Values.size()))]; };
+    printf("  %-10s mean %10.0f  min %8" PRId64 "  p50 %8" PRId64 "  p90 %8" PRId64 "  p99 %8" PRId64 "  max %8" PRId64 " us\n", Name,
+        Sum / Values.size(), Values.front(), Percentile(0.5), Percentile(0.9), Percentile(0.99), Values.back());
+}
+
+static std::unique_ptr<BestVideoSource> OpenSource(const VerifyOptions &Options, const std::string &Source) {
+    std::map<std::string, std::string> Opts;
+    std::unique_ptr<BestVideoSource> V(new BestVideoSource(Source, "", 0, Options.Track, false, Options.Threads, Options.CachePath, &Opts, false, 0, false));
+    if (Options.CacheSize >= 0)
+        V->SetMaxCacheSize(Options.CacheSize * 1024 * 1024);
+    if (Options.PreRoll >= 0)
+        V->SetSeekPreRoll(Options.PreRoll);
+    if (Options.Decoders > 0)
+        V->SetMaxDecoders(Options.Decoders);
+    return V;
+}
+
+// Frames around keyframes are where open-GOP leading pictures and bad timestamps cause problems so they're always sampled in addition to random frames
+static std::vector<int64_t> GetSampledFrames(const VerifyOptions &Options, const BestVideoSource &V, std::mt19937_64 &Generator) {
+    int64_t NumFrames = V.GetVideoProperties().NumFrames;
+    std::set<int64_t> Frames = { 0, NumFrames - 1 };
+
+    std::vector<int64_t> KeyFrames;
+    for (int64_t i = 1; i < NumFrames; i++)
+        if (BSKernelAccess::GetIndexedKeyFrame(V, i))
+            KeyFrames.push_back(i);
+    std::shuffle(KeyFrames.begin(), KeyFrames.end(), Generator);
+    for (size_t i = 0; i < KeyFrames.size() && static_cast<int64_t>(i) < Options.Samples / 4; i++) {
+        for (int64_t N = KeyFrames[i] - 1; N <= KeyFrames[i] + 1; N++)
+            if (N < NumFrames)
+                Frames.insert(N);
+    }
+
+    std::uniform_int_distribution<int64_t> Distribution(0, NumFrames - 1);
+    for (int64_t Attempts = 0; static_cast<int64_t>(Frames.size()) < std::min(Options.Samples, NumFrames) && Attempts < Options.Samples * 10; Attempts++)
+        Frames.insert(Distribution(Generator));
+
+    std::vector<int64_t> Result(Frames.begin(), Frames.end());
+    std::shuffle(Result.begin(), Result.end(), Generator);
+    return Result;
+}
+
+typedef std::map<int64_t, std::array<uint8_t, HashSize>> ReferenceHashes;
+
+// The reference is decoded with a bare decoder from the start so it shares nothing with the seeking code, and all the frame data is hashed
+// since the index may only have sampled hashes which are also what seeking uses to identify frames
+static ReferenceHashes GetReferenceHashes(const VerifyOptions &Options, const std::string &Source, int Track, const std::set<int64_t> &Frames) {
+    ReferenceHashes Result;
+    if (Frames.empty())
+        return Result;
+    std::map<std::string, std::string> Opts;
+    LWVideoDecoder Decoder(Source, "", 0, Track, false, Options.Threads, Opts);
+    for (int64_t N = 0; N <= *Frames.rbegin(); N++) {
+        AVFrame *F = Decoder.GetNextFrame();
+        if (!F)
+            break;
+        if (Frames.count(N))
+            Result[N] = GetVideoFrameHash(F, false);
+        av_frame_free(&F);
+    }
+    return Result;
+}
+
+static int64_t CheckFrame(const ReferenceHashes &Reference, int64_t N, const BestVideoFrame *F) {
+    auto Iter = Reference.find(N);
+    if (!F) {
+        printf("  frame %" PRId64 ": no frame returned\n", N);
+        return 1;
+    } else if (Iter == Reference.end()) {
+        printf("  frame %" PRId64 ": not reached by linear decoding\n", N);
+        return 1;
+    } else if (GetVideoFrameHash(F->GetAVFrame(), false) != Iter->second) {
+        printf("  frame %" PRId64 ": differs from linear decoding\n", N);
+        return 1;
+    }
+    return 0;
+}
+
+// Returns the number of bad frames
+static int64_t VerifyFile(const VerifyOptions &Options, const std::string &Source) {
+    printf("%s\n", Source.c_str());
+
+    std::unique_ptr<BestVideoSource> V = OpenSource(Options, Source);
+    std::mt19937_64 Generator(Options.Seed);
+    std::vector<int64_t> Frames = GetSampledFrames(Options, *V, Generator);
+    int64_t NumFrames = V->GetVideoProperties().NumFrames;
+
+    std::set<int64_t> ReferenceFrames(Frames.begin(), Frames.end());
+    if (Options.Linear)
+        for (int64_t N = 0; N < NumFrames; N++)
+            ReferenceFrames.insert(N);
+    auto ReferenceStart = std::chrono::steady_clock::now();
+    ReferenceHashes Reference = GetReferenceHashes(Options, Source, V->GetTrack(), ReferenceFrames);
+    printf("  reference: %zu frames hashed in %.1f s\n", Reference.size(), std::chrono::duration<double>(std::chrono::steady_clock::now() - ReferenceStart).count());
+
+    std::vector<int64_t> Latency;
+    Latency.reserve(Frames.size());
+    int64_t Bad = 0;
+
+    for (int64_t N : Frames) {
+        auto Start = std::chrono::steady_clock::now();
+        std::unique_ptr<BestVideoFrame> F(V->GetFrame(N));
+        Latency.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count());
+        Bad += CheckFrame(Reference, N, F.get());
+    }
+
+    const DecodeCounters &Counters = V->GetDecodeCounters();
+    printf("  random access: %zu frames, %" PRId64 " bad, %" PRId64 " seeks, %" PRId64 " bad seek points, %" PRId64 " linear fallbacks, %" PRId64 " decoded frames\n",
+        Frames.size(), Bad, Counters.Seeks, Counters.BadSeeks, Counters.LinearFallbacks, Counters.DecodedFrames);
+    PrintDistribution("latency", Latency);
+
+    if (Options.Linear) {
+        V = OpenSource(Options, Source);
+        int64_t LinearBad = 0;
+        auto Start = std::chrono::steady_clock::now();
+        for (int64_t N = 0; N < NumFrames; N++) {
+            std::unique_ptr<BestVideoFrame> F(V->GetFrame(N, true));
+            LinearBad += CheckFrame(Reference, N, F.get());
+        }
+        double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        printf("  linear: %" PRId64 " frames, %" PRId64 " bad, %.1f fps\n", NumFrames, LinearBad, NumFrames / Elapsed);
+        Bad += LinearBad;
+    }
+
+    return Bad;
+}
+
+int main(int argc, char **argv) {
+    VerifyOptions Options;
+    std::vector<std::string> Files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string Arg = argv[i];
+        bool HasValue = (i + 1 < argc);
+        if (Arg == "-T" && HasValue) {
+            Options.Track = atoi(argv[++i]);
+        } else if (Arg == "-t" && HasValue) {
+            Options.Threads = atoi(argv[++i]);
+        } else if (Arg == "-n" && HasValue) {
+            Options.Samples = atoll(argv[++i]);
+        } else if (Arg == "-S" && HasValue) {
+            Options.Seed = strtoull(argv[++i], nullptr, 10);
+        } else if (Arg == "-m" && HasValue) {
+            Options.CacheSize = atoll(argv[++i]);
+        } else if (Arg == "-p" && HasValue) {
+            Options.PreRoll = atoll(argv[++i]);
+        } else if (Arg == "-d" && HasValue) {
+            Options.Decoders = atoi(argv[++i]);
+        } else if (Arg == "-l") {
+            Options.Linear = true;
+        } else if (Arg == "-c" && HasValue) {
+            Options.CachePath = argv[++i];
+        } else if (Arg.size() > 1 && Arg[0] == '-') {
+            PrintUsage();
+            return 1;
+        } else {
+            Files.push_back(Arg);
+        }
+    }
+
+    if (Files.empty() || Options.Samples < 1 || (!Options.CachePath.empty() && Files.size() > 1)) {
+        PrintUsage();
+        return 1;
+    }
+
+    SetFFmpegLogLevel(AV_LOG_QUIET);
+
+    int Failed = 0;
+    for (const auto &Iter : Files) {
+        try {
+            if (VerifyFile(Options, Iter) > 0)
+                Failed++;
+        } catch (VideoException &e) {
+            fprintf(stderr, "%s\n", e.what());
+            Failed++;
+        }
+    }
+
+    if (Files.size() > 1)
+        printf("%zu of %zu files verified without errors\n", Files.size() - Failed, Files.size());
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "concatsource.h"
+#include <algorithm>
+#include <cmath>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+static AVRational ToAVRational(const BSRational &R) {
+    return { R.Num, R.Den };
+}
+
+BestVideoConcatSource::BestVideoConcatSource(const std::vector<std::string> &SourceFiles, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress) {
+    if (SourceFiles.empty())
+        throw VideoException("No source files given");
+
+    FirstFrames.push_back(0);
+    for (size_t i = 0; i < SourceFiles.size(); i++) {
+        // The track is resolved for every file separately so relative track numbers still work when the files have different track layouts
+        std::unique_ptr<BestVideoSource> Source(new BestVideoSource(SourceFiles[i], "", 0, Track, VariableFormat, Threads, CachePath.empty() ? "" : CachePath + "." + std::to_string(i), LAVFOpts, false, 0, false, Progress));
+        Source->CloseDecoders();
+        const VideoProperties &SVP = Source->GetVideoProperties();
+
+        if (i == 0) {
+            VP = SVP;
+            PTSOffsets.push_back(static_cast<int64_t>(std::llround(SVP.StartTime * SVP.TimeBase.Den / SVP.TimeBase.Num)));
+            VP.Duration = 0;
+            VP.NumFrames = 0;
+            VP.NumRFFFrames = 0;
+        } else {
+            if (!VariableFormat && (SVP.VF.ColorFamily != VP.VF.ColorFamily || SVP.VF.Bits != VP.VF.Bits || SVP.VF.Float != VP.VF.Float ||
+                SVP.VF.SubSamplingW != VP.VF.SubSamplingW || SVP.VF.SubSamplingH != VP.VF.SubSamplingH || SVP.VF.Alpha != VP.VF.Alpha ||
+                SVP.Width != VP.Width || SVP.Height != VP.Height))
+                throw VideoException("'" + SourceFiles[i] + "' doesn't have the same format and dimensions as the first file");
+            PTSOffsets.push_back(PTSOffsets.front() + VP.Duration);
+        }
+
+        FirstPTS.push_back(static_cast<int64_t>(std::llround(SVP.StartTime * SVP.TimeBase.Den / SVP.TimeBase.Num)));
+        VP.Duration += av_rescale_q(SVP.Duration, ToAVRational(SVP.TimeBase), ToAVRational(VP.TimeBase));
+        VP.NumFrames += SVP.NumFrames;
+        VP.NumRFFFrames += SVP.NumRFFFrames;
+        FirstFrames.push_back(VP.NumFrames);
+        Sources.push_back(std::move(Source));
+    }
+}
+
+void BestVideoConcatSource::SetMaxCacheSize(size_t Bytes) {
+    for (auto &Iter : Sources)
+        Iter->SetMaxCacheSize(Bytes);
+}
+
+void BestVideoConcatSource::SetSeekPreRoll(int64_t Frames) {
+    for (auto &Iter : Sources)
+        Iter->SetSeekPreRoll(Frames);
+}
+
+void BestVideoConcatSource::SetMaxOpenSources(size_t Count) {
+    std::vector<size_t> Evicted;
+    {
+        std::lock_guard<std::mutex> Lock(SourceMutex);
+        MaxOpenSources = std::max<size_t>(1, Count);
+        while (OpenSources.size() > MaxOpenSources) {
+            Evicted.push_back(OpenSources.back());
+            OpenSources.pop_back();
+        }
+    }
+
+    for (size_t Iter : Evicted)
+        Sources[Iter]->CloseDecoders();
+}
+
+const VideoProperties &BestVideoConcatSource::GetVideoProperties() const {
+    return VP;
+}
+
+size_t BestVideoConcatSource::GetNumSources() const {
+    return Sources.size();
+}
+
+int64_t BestVideoConcatSource::GetSourceFirstFrame(size_t Index) const {
+    return FirstFrames.at(Index);
+}
+
+size_t BestVideoConcatSource::GetSourceIndex(int64_t N) const {
+    return std::upper_bound(FirstFrames.begin(), FirstFrames.end(), N) - FirstFrames.begin() - 1;
+}
+
+void BestVideoConcatSource::UseSource(size_t Index) {
+    // Closing waits for any decoding in progress in that file so it's done without holding the lock
+    std::vector<size_t> Evicted;
+    {
+        std::lock_guard<std::mutex> Lock(SourceMutex);
+        auto Iter = std::find(OpenSources.begin(), OpenSources.end(), Index);
+        if (Iter != OpenSources.end()) {
+            OpenSources.splice(OpenSources.begin(), OpenSources, Iter);
+        } else {
+            OpenSources.push_front(Index);
+            while (OpenSources.size() > MaxOpenSources) {
+                Evicted.push_back(OpenSources.back());
+                OpenSources.pop_back();
+            }
+        }
+    }
+
+    for (size_t Iter : Evicted)
+        Sources[Iter]->CloseDecoders();
+}
+
+BestVideoFrame *BestVideoConcatSource::GetFrame(int64_t N, bool Linear) {
+    if (N < 0 || N >= VP.NumFrames)
+        return nullptr;
+
+    size_t Index = GetSourceIndex(N);
+    UseSource(Index);
+
+    BestVideoFrame *F = Sources[Index]->GetFrame(N - FirstFrames[Index], Linear);
+    if (F) {
+        AVRational SourceTimeBase = ToAVRational(Sources[Index]->GetVideoProperties().TimeBase);
+        if (F->Pts != AV_NOPTS_VALUE)
+            F->Pts = av_rescale_q(F->Pts - FirstPTS[Index], SourceTimeBase, ToAVRational(VP.TimeBase)) + PTSOffsets[Index];
+        F->Duration = av_rescale_q(F->Duration, SourceTimeBase, ToAVRational(VP.TimeBase));
+    }
+    return F;
+}
+
+bool BestVideoConcatSource::GetFrameIsTFF(int64_t N) {
+    if (N < 0 || N >= VP.NumFrames)
+        return false;
+    size_t Index = GetSourceIndex(N);
+    return Sources[Index]->GetFrameIsTFF(N - FirstFrames[Index]);
+}
@@ -0,0 +1,55 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#ifndef CONCATSOURCE_H
+#define CONCATSOURCE_H
+
+#include "videosource.h"
+#include <list>
+
+/* Presents an ordered list of files as a single clip with continuous frame numbers and timestamps. Every file keeps its own index
+ * and decoders but only the most recently used ones stay open. All files need the same format and dimensions unless VariableFormat is set.
+ * Timestamps and durations are converted to the time base of the first file. */
+class BestVideoConcatSource {
+private:
+    std::vector<std::unique_ptr<BestVideoSource>> Sources;
+    std::vector<int64_t> FirstFrames; /* the number of the first frame of every file followed by the total number of frames */
+    std::vector<int64_t> FirstPTS; /* the PTS of the first frame of every file in its own time base */
+    std::vector<int64_t> PTSOffsets; /* where every file starts in the time base of the first file */
+    VideoProperties VP = {};
+    std::list<size_t> OpenSources; /* most recently used first, the others have their decoders closed */
+    size_t MaxOpenSources = 2;
+    std::mutex SourceMutex;
+    [[nodiscard]] size_t GetSourceIndex(int64_t N) const;
+    void UseSource(size_t Index);
+public:
+    BestVideoConcatSource(const std::vector<std::string> &SourceFiles, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    void SetMaxCacheSize(size_t Bytes); /* applies to every open file separately */
+    void SetSeekPreRoll(int64_t Frames);
+    void SetMaxOpenSources(size_t Count); /* the number of files whose decoders and cache are kept around, default is 2 so going back and forth across a boundary is cheap */
+    [[nodiscard]] const VideoProperties &GetVideoProperties() const;
+    [[nodiscard]] size_t GetNumSources() const;
+    [[nodiscard]] int64_t GetSourceFirstFrame(size_t Index) const;
+    [[nodiscard]] BestVideoFrame *GetFrame(int64_t N, bool Linear = false);
+    [[nodiscard]] bool GetFrameIsTFF(int64_t N);
+};
+
+#endif
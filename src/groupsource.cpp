@@ -0,0 +1,134 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "groupsource.h"
+#include <algorithm>
+#include <exception>
+
+BestVideoGroupSource::BestVideoGroupSource(const std::vector<GroupMember> &Members, int Track, bool VariableFormat, int Threads, int Workers, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress) {
+    if (Members.empty())
+        throw VideoException("No files given");
+    if (Workers < 0)
+        throw VideoException("Workers must be 0 or greater");
+
+    for (size_t i = 0; i < Members.size(); i++) {
+        Sources.emplace_back(new BestVideoSource(Members[i].Source, "", 0, Track, VariableFormat, Threads, CachePath.empty() ? "" : CachePath + "." + std::to_string(i), LAVFOpts, false, 0, false, Progress));
+        Offsets.push_back(Members[i].Offset);
+        const VideoProperties &VP = Sources.back()->GetVideoProperties();
+        Duration = std::max(Duration, Members[i].Offset + VP.Duration * VP.TimeBase.ToDouble());
+    }
+
+    size_t NumWorkers = (Workers > 0) ? Workers : Members.size();
+    for (size_t i = 0; i < NumWorkers; i++)
+        WorkerThreads.emplace_back(&BestVideoGroupSource::Worker, this);
+}
+
+BestVideoGroupSource::~BestVideoGroupSource() {
+    {
+        std::lock_guard<std::mutex> Lock(JobMutex);
+        WorkerExit = true;
+    }
+    JobCondition.notify_all();
+    for (auto &Iter : WorkerThreads)
+        Iter.join();
+}
+
+void BestVideoGroupSource::Worker() {
+    std::unique_lock<std::mutex> Lock(JobMutex);
+    while (true) {
+        JobCondition.wait(Lock, [this] { return WorkerExit || !Jobs.empty(); });
+        if (WorkerExit)
+            return;
+
+        auto Job = std::move(Jobs.front());
+        Jobs.pop_front();
+        Lock.unlock();
+        Job();
+        Lock.lock();
+    }
+}
+
+void BestVideoGroupSource::SetMaxCacheSize(size_t Bytes) {
+    for (auto &Iter : Sources)
+        Iter->SetMaxCacheSize(Bytes);
+}
+
+void BestVideoGroupSource::SetSeekPreRoll(int64_t Frames) {
+    for (auto &Iter : Sources)
+        Iter->SetSeekPreRoll(Frames);
+}
+
+size_t BestVideoGroupSource::GetNumMembers() const {
+    return Sources.size();
+}
+
+double BestVideoGroupSource::GetDuration() const {
+    return Duration;
+}
+
+const VideoProperties &BestVideoGroupSource::GetVideoProperties(size_t Member) const {
+    return Sources.at(Member)->GetVideoProperties();
+}
+
+std::vector<std::unique_ptr<BestVideoFrame>> BestVideoGroupSource::GetFrames(double Time, bool Linear) {
+    std::vector<std::unique_ptr<BestVideoFrame>> Frames(Sources.size());
+    std::exception_ptr Error;
+    size_t Remaining = 0;
+    std::mutex DoneMutex;
+    std::condition_variable DoneCondition;
+
+    {
+        std::lock_guard<std::mutex> Lock(JobMutex);
+        for (size_t i = 0; i < Sources.size(); i++) {
+            const VideoProperties &VP = Sources[i]->GetVideoProperties();
+            double LocalTime = Time - Offsets[i];
+            if (LocalTime < 0 || LocalTime >= VP.Duration * VP.TimeBase.ToDouble())
+                continue;
+
+            Remaining++;
+            Jobs.push_back([&, i, LocalTime, Linear] {
+                // Anything thrown has to be caught here, otherwise Remaining never reaches 0 and GetFrames() waits forever
+                std::unique_ptr<BestVideoFrame> F;
+                std::exception_ptr JobError;
+                try {
+                    F.reset(Sources[i]->GetFrameByTime(Sources[i]->GetVideoProperties().StartTime + LocalTime, Linear));
+                } catch (...) {
+                    JobError = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> DoneLock(DoneMutex);
+                Frames[i] = std::move(F);
+                if (!Error)
+                    Error = JobError;
+                if (--Remaining == 0)
+                    DoneCondition.notify_one();
+            });
+        }
+    }
+    JobCondition.notify_all();
+
+    std::unique_lock<std::mutex> DoneLock(DoneMutex);
+    DoneCondition.wait(DoneLock, [&Remaining] { return Remaining == 0; });
+
+    if (Error)
+        std::rethrow_exception(Error);
+    return Frames;
+}
@@ -0,0 +1,63 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#ifndef GROUPSOURCE_H
+#define GROUPSOURCE_H
+
+#include "videosource.h"
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+struct GroupMember {
+    std::string Source;
+    double Offset; /* where the first frame of the file is on the group timeline in seconds */
+};
+
+/* Opens several recordings of the same event, like the angles of a multicam shoot, and returns the frames showing the same moment in
+ * all of them together. The files are decoded in parallel by a shared pool of worker threads so getting a set costs about as much as
+ * the slowest single seek instead of the sum of all of them. */
+class BestVideoGroupSource {
+private:
+    std::vector<std::unique_ptr<BestVideoSource>> Sources;
+    std::vector<double> Offsets;
+    double Duration = 0; /* the end of the last file on the group timeline in seconds */
+
+    std::vector<std::thread> WorkerThreads;
+    std::deque<std::function<void()>> Jobs;
+    std::mutex JobMutex;
+    std::condition_variable JobCondition;
+    bool WorkerExit = false;
+    void Worker();
+public:
+    BestVideoGroupSource(const std::vector<GroupMember> &Members, int Track, bool VariableFormat, int Threads, int Workers, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr); /* Workers is the size of the pool, 0 means one per file */
+    ~BestVideoGroupSource();
+    void SetMaxCacheSize(size_t Bytes); /* applies to every file separately */
+    void SetSeekPreRoll(int64_t Frames);
+    [[nodiscard]] size_t GetNumMembers() const;
+    [[nodiscard]] double GetDuration() const;
+    [[nodiscard]] const VideoProperties &GetVideoProperties(size_t Member) const;
+    /* Returns the frame closest to Time seconds on the group timeline from every file in the order they were passed in, files that don't
+     * cover Time get nullptr. If decoding throws for any of them the exception is passed on once all files are done. */
+    [[nodiscard]] std::vector<std::unique_ptr<BestVideoFrame>> GetFrames(double Time, bool Linear = false);
+};
+
+#endif
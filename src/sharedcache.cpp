@@ -0,0 +1,368 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "sharedcache.h"
+#include "videosource.h"
+#include <atomic>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+}
+
+static constexpr uint32_t SharedCacheMagic = 0x53435342; // BSCS
+static constexpr uint32_t SharedCacheVersion = 2;
+static constexpr uint64_t SharedCacheAlignment = 64;
+static constexpr size_t ProbeLength = 8;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Lock-free 64 bit atomics are required for sharing them between processes");
+
+struct SharedFrameCache::Header {
+    std::atomic<uint32_t> Magic; /* set last by the creating process */
+    uint32_t Version;
+    uint64_t NumEntries; /* power of 2 */
+    uint64_t DataSize;
+    std::atomic<uint64_t> WritePosition; /* total number of bytes ever reserved in the ring buffer */
+};
+
+/* A seqlock protects each entry, the sequence is odd while it's being written */
+struct SharedFrameCache::Entry {
+    std::atomic<uint64_t> Sequence;
+    std::atomic<uint64_t> Key;
+    std::atomic<int64_t> FrameNumber;
+    std::atomic<uint64_t> Position; /* absolute position in the ring buffer */
+    std::atomic<uint64_t> Size;
+};
+
+struct StoredFrame {
+    int Format;
+    int Width;
+    int Height;
+    int Flags;
+    int RepeatPict;
+    int PictType;
+    int ColorRange;
+    int ColorPrimaries;
+    int ColorTrc;
+    int Colorspace;
+    int ChromaLocation;
+    int SARNum;
+    int SARDen;
+    int NumSideData;
+    int64_t PTS;
+    int64_t Duration;
+    int Linesize[4];
+    uint64_t PlaneSize[4];
+};
+
+struct StoredSideData {
+    int Type;
+    uint64_t Size;
+};
+
+static uint64_t AlignSize(uint64_t Size) {
+    return (Size + SharedCacheAlignment - 1) & ~(SharedCacheAlignment - 1);
+}
+
+static uint64_t GetSlot(uint64_t Key, int64_t N, uint64_t NumEntries) {
+    uint64_t Hash = Key ^ (static_cast<uint64_t>(N) * 0x9E3779B97F4A7C15ULL);
+    Hash ^= Hash >> 31;
+    Hash *= 0xBF58476D1CE4E5B9ULL;
+    Hash ^= Hash >> 29;
+    return Hash & (NumEntries - 1);
+}
+
+#ifndef _WIN32
+
+// Every process holds a shared lock on the segment for as long as it uses it. Getting an exclusive lock therefore means
+// nobody else is using it, when opening this means it was left behind by a crashed process and it's recreated, when
+// closing it means this is the last user and it's removed.
+SharedFrameCache::SharedFrameCache(const std::string &Name, size_t Bytes) : Name(Name + "-" + std::to_string(getuid())) {
+    if (Name.size() < 2 || Name[0] != '/' || Name.find('/', 1) != std::string::npos)
+        throw VideoException("Shared cache names must start with / and not contain any other /");
+
+    bool Created = false;
+    for (int Attempt = 0; Attempt < 3 && FD < 0; Attempt++) {
+        FD = shm_open(this->Name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        Created = (FD >= 0);
+        if (Created) {
+            flock(FD, LOCK_EX);
+        } else {
+            FD = shm_open(this->Name.c_str(), O_RDWR, 0600);
+            if (FD >= 0 && flock(FD, LOCK_EX | LOCK_NB) == 0) {
+                shm_unlink(this->Name.c_str());
+                close(FD);
+                FD = -1;
+            } else if (FD >= 0) {
+                // Waits for the creating process to finish initializing it
+                flock(FD, LOCK_SH);
+            }
+        }
+    }
+    if (FD < 0)
+        throw VideoException("Couldn't open the shared cache '" + this->Name + "'");
+
+    uint64_t DataSize = AlignSize(std::max<uint64_t>(Bytes, 16 * 1024 * 1024));
+    uint64_t NumEntries = 1024;
+    while (NumEntries < (1 << 20) && NumEntries * 256 * 1024 < DataSize)
+        NumEntries *= 2;
+    size_t HeaderSize = AlignSize(sizeof(Header));
+
+    if (Created) {
+        MappedSize = HeaderSize + AlignSize(NumEntries * sizeof(Entry)) + DataSize;
+        if (ftruncate(FD, MappedSize) != 0) {
+            shm_unlink(this->Name.c_str());
+            close(FD);
+            throw VideoException("Couldn't allocate " + std::to_string(MappedSize) + " bytes for the shared cache '" + this->Name + "'");
+        }
+    } else {
+        struct stat Stat = {};
+        if (fstat(FD, &Stat) == 0)
+            MappedSize = Stat.st_size;
+    }
+
+    if (MappedSize > HeaderSize)
+        Mapping = mmap(nullptr, MappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+    if (!Mapping || Mapping == MAP_FAILED) {
+        Mapping = nullptr;
+        if (Created)
+            shm_unlink(this->Name.c_str());
+        close(FD);
+        throw VideoException("Couldn't map the shared cache '" + this->Name + "'");
+    }
+
+    // The mapping starts out zeroed which is a valid initial state for all the atomics
+    Shared = reinterpret_cast<Header *>(Mapping);
+    if (Created) {
+        Shared->Version = SharedCacheVersion;
+        Shared->NumEntries = NumEntries;
+        Shared->DataSize = DataSize;
+        Shared->Magic.store(SharedCacheMagic, std::memory_order_release);
+        flock(FD, LOCK_SH);
+    } else if (Shared->Magic.load(std::memory_order_acquire) != SharedCacheMagic || Shared->Version != SharedCacheVersion ||
+        MappedSize != HeaderSize + AlignSize(Shared->NumEntries * sizeof(Entry)) + Shared->DataSize) {
+        munmap(Mapping, MappedSize);
+        close(FD);
+        throw VideoException("The shared cache '" + this->Name + "' was created by an incompatible version");
+    }
+
+    Entries = reinterpret_cast<Entry *>(reinterpret_cast<uint8_t *>(Mapping) + HeaderSize);
+    Data = reinterpret_cast<uint8_t *>(Mapping) + HeaderSize + AlignSize(Shared->NumEntries * sizeof(Entry));
+}
+
+SharedFrameCache::~SharedFrameCache() {
+    munmap(Mapping, MappedSize);
+    if (flock(FD, LOCK_EX | LOCK_NB) == 0)
+        shm_unlink(Name.c_str());
+    close(FD);
+}
+
+#else
+
+SharedFrameCache::SharedFrameCache(const std::string &Name, size_t Bytes) {
+    throw VideoException("The shared cache isn't supported on this platform");
+}
+
+SharedFrameCache::~SharedFrameCache() {
+}
+
+#endif
+
+// The data is only valid if nothing reserved since then overlaps it, checked after copying since it can be overwritten at any time
+bool SharedFrameCache::CopyOut(uint64_t Position, uint64_t Size, std::vector<uint8_t> &Buffer) const {
+    if (Size > Shared->DataSize || Position % Shared->DataSize + Size > Shared->DataSize)
+        return false;
+    Buffer.resize(Size);
+    memcpy(Buffer.data(), Data + Position % Shared->DataSize, Size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return Shared->WritePosition.load(std::memory_order_relaxed) <= Position + Shared->DataSize;
+}
+
+AVFrame *SharedFrameCache::GetFrame(uint64_t Key, int64_t N) const {
+    std::vector<uint8_t> Buffer;
+    uint64_t Slot = GetSlot(Key, N, Shared->NumEntries);
+    bool Found = false;
+
+    for (size_t i = 0; i < ProbeLength && !Found; i++) {
+        Entry &E = Entries[(Slot + i) & (Shared->NumEntries - 1)];
+        uint64_t Sequence = E.Sequence.load(std::memory_order_acquire);
+        if ((Sequence & 1) || E.Key.load(std::memory_order_relaxed) != Key || E.FrameNumber.load(std::memory_order_relaxed) != N)
+            continue;
+        uint64_t Position = E.Position.load(std::memory_order_relaxed);
+        uint64_t Size = E.Size.load(std::memory_order_relaxed);
+        Found = CopyOut(Position, Size, Buffer) && E.Sequence.load(std::memory_order_relaxed) == Sequence;
+    }
+
+    if (!Found || Buffer.size() < sizeof(StoredFrame))
+        return nullptr;
+
+    StoredFrame SF;
+    memcpy(&SF, Buffer.data(), sizeof(SF));
+    const uint8_t *Src = Buffer.data() + sizeof(SF);
+    const uint8_t *End = Buffer.data() + Buffer.size();
+
+    const uint8_t *SrcPlanes[4] = {};
+    for (int p = 0; p < 4; p++) {
+        if (SF.PlaneSize[p] > static_cast<uint64_t>(End - Src))
+            return nullptr;
+        if (SF.PlaneSize[p])
+            SrcPlanes[p] = Src;
+        Src += SF.PlaneSize[p];
+    }
+
+    AVFrame *F = av_frame_alloc();
+    if (!F)
+        return nullptr;
+
+    F->format = SF.Format;
+    F->width = SF.Width;
+    F->height = SF.Height;
+    F->flags = SF.Flags;
+    F->repeat_pict = SF.RepeatPict;
+    F->pict_type = static_cast<AVPictureType>(SF.PictType);
+    F->color_range = static_cast<AVColorRange>(SF.ColorRange);
+    F->color_primaries = static_cast<AVColorPrimaries>(SF.ColorPrimaries);
+    F->color_trc = static_cast<AVColorTransferCharacteristic>(SF.ColorTrc);
+    F->colorspace = static_cast<AVColorSpace>(SF.Colorspace);
+    F->chroma_location = static_cast<AVChromaLocation>(SF.ChromaLocation);
+    F->sample_aspect_ratio = { SF.SARNum, SF.SARDen };
+    F->pts = SF.PTS;
+    F->duration = SF.Duration;
+
+    bool Success = (av_frame_get_buffer(F, 0) == 0);
+    if (Success)
+        av_image_copy(F->data, F->linesize, SrcPlanes, SF.Linesize, static_cast<AVPixelFormat>(SF.Format), SF.Width, SF.Height);
+
+    for (int i = 0; i < SF.NumSideData && Success; i++) {
+        StoredSideData SD;
+        Success = (static_cast<size_t>(End - Src) >= sizeof(SD));
+        if (Success) {
+            memcpy(&SD, Src, sizeof(SD));
+            Src += sizeof(SD);
+            Success = (SD.Size <= static_cast<uint64_t>(End - Src));
+        }
+        if (Success) {
+            AVFrameSideData *Dst = av_frame_new_side_data(F, static_cast<AVFrameSideDataType>(SD.Type), SD.Size);
+            Success = !!Dst;
+            if (Success)
+                memcpy(Dst->data, Src, SD.Size);
+            Src += SD.Size;
+        }
+    }
+
+    if (!Success)
+        av_frame_free(&F);
+    return F;
+}
+
+void SharedFrameCache::CacheFrame(uint64_t Key, int64_t N, const AVFrame *Frame) {
+    if (Frame->hw_frames_ctx)
+        return;
+
+    size_t PlaneSize[4] = {};
+    ptrdiff_t Linesize[4] = {};
+    for (int p = 0; p < 4; p++) {
+        if (Frame->linesize[p] < 0)
+            return;
+        Linesize[p] = Frame->linesize[p];
+    }
+    if (av_image_fill_plane_sizes(PlaneSize, static_cast<AVPixelFormat>(Frame->format), Frame->height, Linesize) < 0)
+        return;
+
+    uint64_t Size = sizeof(StoredFrame);
+    for (int p = 0; p < 4; p++)
+        Size += PlaneSize[p];
+    for (int i = 0; i < Frame->nb_side_data; i++)
+        Size += sizeof(StoredSideData) + Frame->side_data[i]->size;
+
+    uint64_t DataSize = Shared->DataSize;
+    uint64_t AlignedSize = AlignSize(Size);
+    if (AlignedSize > DataSize / 4)
+        return;
+
+    // Never let a frame wrap around the end of the buffer
+    uint64_t Current = Shared->WritePosition.load(std::memory_order_relaxed);
+    uint64_t Position;
+    do {
+        Position = Current;
+        if (Position % DataSize + AlignedSize > DataSize)
+            Position += DataSize - Position % DataSize;
+    } while (!Shared->WritePosition.compare_exchange_weak(Current, Position + AlignedSize, std::memory_order_relaxed));
+    // The new write position has to be visible before any of the data it overwrites changes, otherwise a reader copying out the old frame can't notice
+    std::atomic_thread_fence(std::memory_order_release);
+
+    StoredFrame SF = { Frame->format, Frame->width, Frame->height, Frame->flags, Frame->repeat_pict, Frame->pict_type,
+        Frame->color_range, Frame->color_primaries, Frame->color_trc, Frame->colorspace, Frame->chroma_location,
+        Frame->sample_aspect_ratio.num, Frame->sample_aspect_ratio.den, Frame->nb_side_data, Frame->pts, Frame->duration, {}, {} };
+    for (int p = 0; p < 4; p++) {
+        SF.Linesize[p] = Frame->linesize[p];
+        SF.PlaneSize[p] = PlaneSize[p];
+    }
+
+    uint8_t *Dst = Data + Position % DataSize;
+    memcpy(Dst, &SF, sizeof(SF));
+    Dst += sizeof(SF);
+    for (int p = 0; p < 4; p++) {
+        if (PlaneSize[p])
+            memcpy(Dst, Frame->data[p], PlaneSize[p]);
+        Dst += PlaneSize[p];
+    }
+    for (int i = 0; i < Frame->nb_side_data; i++) {
+        StoredSideData SD = { Frame->side_data[i]->type, Frame->side_data[i]->size };
+        memcpy(Dst, &SD, sizeof(SD));
+        Dst += sizeof(SD);
+        memcpy(Dst, Frame->side_data[i]->data, SD.Size);
+        Dst += SD.Size;
+    }
+
+    // Replace the same frame if it's already there, otherwise the entry pointing to the oldest data
+    uint64_t Slot = GetSlot(Key, N, Shared->NumEntries);
+    Entry *Target = nullptr;
+    for (size_t i = 0; i < ProbeLength; i++) {
+        Entry &E = Entries[(Slot + i) & (Shared->NumEntries - 1)];
+        if (E.Key.load(std::memory_order_relaxed) == Key && E.FrameNumber.load(std::memory_order_relaxed) == N) {
+            Target = &E;
+            break;
+        } else if (!Target || E.Position.load(std::memory_order_relaxed) < Target->Position.load(std::memory_order_relaxed)) {
+            Target = &E;
+        }
+    }
+
+    // Give up if another process is writing the entry right now, it's only a cache
+    uint64_t Sequence = Target->Sequence.load(std::memory_order_relaxed);
+    if ((Sequence & 1) || !Target->Sequence.compare_exchange_strong(Sequence, Sequence + 1, std::memory_order_acquire))
+        return;
+    std::atomic_thread_fence(std::memory_order_release);
+    Target->Key.store(Key, std::memory_order_relaxed);
+    Target->FrameNumber.store(N, std::memory_order_relaxed);
+    Target->Position.store(Position, std::memory_order_relaxed);
+    Target->Size.store(Size, std::memory_order_relaxed);
+    Target->Sequence.store(Sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,53 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#ifndef SHAREDCACHE_H
+#define SHAREDCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVFrame;
+
+/* A decoded frame cache in POSIX shared memory that all processes of the same user opening it with the same name use together.
+ * Frames are appended to a ring buffer so the oldest ones are overwritten first. Lookups never block, a frame that's
+ * overwritten while being read is detected and treated as a miss. Only software frames of up to a quarter of the size are stored. */
+class SharedFrameCache {
+private:
+    struct Header;
+    struct Entry;
+    std::string Name;
+    int FD = -1;
+    void *Mapping = nullptr;
+    size_t MappedSize = 0;
+    Header *Shared = nullptr;
+    Entry *Entries = nullptr;
+    uint8_t *Data = nullptr;
+    [[nodiscard]] bool CopyOut(uint64_t Position, uint64_t Size, std::vector<uint8_t> &Buffer) const;
+public:
+    SharedFrameCache(const std::string &Name, size_t Bytes); /* the user id is appended to Name, Bytes only matters for the process that creates the cache, it's deleted when the last process closes it or recreated by the next one if all users crashed */
+    ~SharedFrameCache();
+    [[nodiscard]] AVFrame *GetFrame(uint64_t Key, int64_t N) const; /* returns a new frame or nullptr */
+    void CacheFrame(uint64_t Key, int64_t N, const AVFrame *Frame);
+};
+
+#endif
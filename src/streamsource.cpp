@@ -0,0 +1,153 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "streamsource.h"
+#include "bskernels.h"
+#include "bsprobes.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+
+BestVideoStreamSource::BestVideoStreamSource(const std::string &SourceFile, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> *LAVFOpts) {
+    std::map<std::string, std::string> LAVFOptions;
+    if (LAVFOpts)
+        LAVFOptions = *LAVFOpts;
+
+    Decoder.reset(new LWVideoDecoder(SourceFile, "", 0, Track, VariableFormat, Threads, LAVFOptions));
+    VideoTrack = Decoder->GetTrack();
+    Counters.DecoderCreations++;
+    Decoder->GetVideoProperties(VP, &FirstFrame);
+    if (!FirstFrame)
+        throw VideoException("Couldn't decode the first frame of '" + SourceFile + "'");
+
+    VP.NumFrames = -1;
+    VP.NumRFFFrames = -1;
+    VP.Duration = -1;
+}
+
+BestVideoStreamSource::~BestVideoStreamSource() {
+    av_frame_free(&FirstFrame);
+}
+
+void BestVideoStreamSource::SetMaxCacheSize(size_t Bytes) {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    FrameCache.SetMaxSize(Bytes);
+}
+
+void BestVideoStreamSource::SetMaxWindowFrames(size_t Count) {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    MaxWindowFrames = std::max<size_t>(1, Count);
+    while (Window.size() > MaxWindowFrames) {
+        Window.pop_front();
+        WindowStart++;
+    }
+}
+
+int BestVideoStreamSource::GetTrack() const {
+    return VideoTrack;
+}
+
+const VideoProperties &BestVideoStreamSource::GetVideoProperties() const {
+    return VP;
+}
+
+int64_t BestVideoStreamSource::GetNumDecodedFrames() {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    return NextFrame;
+}
+
+bool BestVideoStreamSource::IsEndOfStream() {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    return EndOfStream;
+}
+
+void BestVideoStreamSource::AddFrame(AVFrame *Frame) {
+    Window.push_back({ Frame->pts, Frame->repeat_pict, !!(Frame->flags & AV_FRAME_FLAG_KEY), !!(Frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST), av_get_picture_type_char(Frame->pict_type), GetVideoFrameHash(Frame), 0, GetVideoFramePacketSize(Frame) });
+    if (Window.size() > MaxWindowFrames) {
+        Window.pop_front();
+        WindowStart++;
+    }
+    Counters.DecodedFrames++;
+    FrameCache.CacheFrame(NextFrame++, Frame);
+}
+
+BestVideoFrame *BestVideoStreamSource::GetFrame(int64_t N) {
+    if (N < 0)
+        return nullptr;
+
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+
+    Counters.Requests++;
+    BS_PROBE2(video_frame_request, VideoTrack, N);
+    BestVideoFrame *F = FrameCache.GetFrame(N);
+    if (F) {
+        Counters.CacheHits++;
+        BS_PROBE4(video_frame_done, VideoTrack, N, true, true);
+        return F;
+    }
+
+    if (N < NextFrame) {
+        BS_PROBE4(video_frame_done, VideoTrack, N, false, false);
+        throw VideoException("Frame " + std::to_string(N) + " is no longer cached, only frames after " + std::to_string(NextFrame - 1) + " can be decoded from a stream");
+    }
+
+    if (FirstFrame) {
+        AddFrame(FirstFrame);
+        FirstFrame = nullptr;
+    }
+
+    while (NextFrame <= N && !EndOfStream) {
+        AVFrame *Frame = Decoder->GetNextFrame();
+        if (!Frame) {
+            EndOfStream = true;
+            Decoder.reset();
+            break;
+        }
+        AddFrame(Frame);
+    }
+
+    // The requested frame is the most recently cached one so the cache can't have evicted it yet
+    F = (N < NextFrame) ? FrameCache.GetFrame(N) : nullptr;
+    BS_PROBE4(video_frame_done, VideoTrack, N, false, !!F);
+    return F;
+}
+
+bool BestVideoStreamSource::GetFrameIsTFF(int64_t N) {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    if (N < WindowStart || N >= WindowStart + static_cast<int64_t>(Window.size()))
+        return false;
+    return Window[N - WindowStart].TFF;
+}
+
+bool BestVideoStreamSource::GetFrameHash(int64_t N, std::array<uint8_t, HashSize> &Hash) {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    if (N < WindowStart || N >= WindowStart + static_cast<int64_t>(Window.size()))
+        return false;
+    Hash = Window[N - WindowStart].Hash;
+    return true;
+}
+
+DecodeCounters BestVideoStreamSource::GetDecodeCounters() {
+    std::lock_guard<std::mutex> Lock(DecodeMutex);
+    return Counters;
+}
@@ -0,0 +1,63 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#ifndef STREAMSOURCE_H
+#define STREAMSOURCE_H
+
+#include "videosource.h"
+#include <deque>
+
+/* Decodes a source that can only be read once from start to end, like a pipe or a FIFO. No index is created up front and only a single
+ * decoder is ever opened. Frames have to be requested in roughly increasing order, the most recently decoded ones are kept in a cache of
+ * limited size and requesting anything that has already left it throws an exception. The number of frames is unknown until the end is reached. */
+class BestVideoStreamSource {
+private:
+    using FrameInfo = BestVideoSource::VideoTrackIndex::FrameInfo;
+
+    std::unique_ptr<LWVideoDecoder> Decoder;
+    BestVideoSource::Cache FrameCache;
+    std::deque<FrameInfo> Window; /* index entries of the most recently decoded frames starting at WindowStart */
+    int64_t WindowStart = 0;
+    size_t MaxWindowFrames = 10000;
+    VideoProperties VP = {};
+    int VideoTrack = -1;
+    AVFrame *FirstFrame = nullptr; /* decoded to get the properties and handed to the cache on the first request */
+    int64_t NextFrame = 0;
+    bool EndOfStream = false;
+    DecodeCounters Counters = {};
+    std::mutex DecodeMutex;
+    void AddFrame(AVFrame *Frame);
+public:
+    BestVideoStreamSource(const std::string &SourceFile, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> *LAVFOpts);
+    ~BestVideoStreamSource();
+    void SetMaxCacheSize(size_t Bytes); /* the lookbehind cache, default is 1GB */
+    void SetMaxWindowFrames(size_t Count); /* the number of index entries kept for frame property and hash lookups, default is 10000 */
+    [[nodiscard]] int GetTrack() const;
+    [[nodiscard]] const VideoProperties &GetVideoProperties() const; /* NumFrames, NumRFFFrames and Duration are -1 */
+    [[nodiscard]] int64_t GetNumDecodedFrames();
+    [[nodiscard]] bool IsEndOfStream();
+    [[nodiscard]] BestVideoFrame *GetFrame(int64_t N); /* returns nullptr once N is past the end of the stream */
+    [[nodiscard]] bool GetFrameIsTFF(int64_t N);
+    [[nodiscard]] bool GetFrameHash(int64_t N, std::array<uint8_t, HashSize> &Hash); /* same hash as stored in the index of a normal source, false if N isn't in the window */
+    [[nodiscard]] DecodeCounters GetDecodeCounters();
+};
+
+#endif
@@ -0,0 +1,289 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#include "timelinesource.h"
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+BestVideoTimelineSource::BestVideoTimelineSource(const std::vector<TimelineSegment> &Segments, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress)
+    : VariableFormat(VariableFormat), Threads(Threads), CachePath(CachePath) {
+    if (Segments.empty())
+        throw VideoException("No segments given");
+    if (LAVFOpts)
+        LAVFOptions = *LAVFOpts;
+
+    std::map<std::string, size_t> SourceIndices;
+    FirstFrames.push_back(0);
+    for (const auto &Iter : Segments) {
+        auto Index = SourceIndices.find(Iter.Source);
+        if (Index == SourceIndices.end()) {
+            size_t i = Sources.size();
+            std::unique_ptr<BestVideoSource> Source(new BestVideoSource(Iter.Source, "", 0, Track, VariableFormat, Threads, CachePath.empty() ? "" : CachePath + "." + std::to_string(i), LAVFOpts, false, 0, false, Progress));
+            Source->CloseDecoders();
+            const VideoProperties &SVP = Source->GetVideoProperties();
+
+            if (i == 0) {
+                VP = SVP;
+            } else if (!VariableFormat && (SVP.VF.ColorFamily != VP.VF.ColorFamily || SVP.VF.Bits != VP.VF.Bits || SVP.VF.Float != VP.VF.Float ||
+                SVP.VF.SubSamplingW != VP.VF.SubSamplingW || SVP.VF.SubSamplingH != VP.VF.SubSamplingH || SVP.VF.Alpha != VP.VF.Alpha ||
+                SVP.Width != VP.Width || SVP.Height != VP.Height)) {
+                throw VideoException("'" + Iter.Source + "' doesn't have the same format and dimensions as the first file");
+            }
+
+            Index = SourceIndices.insert(std::make_pair(Iter.Source, i)).first;
+            Sources.push_back(std::move(Source));
+            SourceFiles.push_back(Iter.Source);
+        }
+
+        int64_t SourceFrames = Sources[Index->second]->GetVideoProperties().NumFrames;
+        if (Iter.Start < 0 || Iter.End < Iter.Start || Iter.End >= SourceFrames)
+            throw VideoException("Invalid segment " + std::to_string(Iter.Start) + "-" + std::to_string(Iter.End) + " of '" + Iter.Source + "' which has " + std::to_string(SourceFrames) + " frames");
+
+        SegmentSources.push_back(Index->second);
+        SegmentStarts.push_back(Iter.Start);
+        FirstFrames.push_back(FirstFrames.back() + Iter.End - Iter.Start + 1);
+    }
+
+    VP.NumFrames = FirstFrames.back();
+    VP.NumRFFFrames = VP.NumFrames;
+    VP.StartTime = 0;
+    VP.Duration = av_rescale_q(VP.NumFrames, { VP.FPS.Den, VP.FPS.Num }, { VP.TimeBase.Num, VP.TimeBase.Den });
+
+    PrefetchPool.resize(Sources.size());
+    SetMaxCacheSize(CacheSize);
+}
+
+BestVideoTimelineSource::~BestVideoTimelineSource() {
+    if (PrefetchThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lock(PrefetchMutex);
+            PrefetchExit = true;
+        }
+        PrefetchCondition.notify_one();
+        PrefetchThread.join();
+    }
+}
+
+size_t BestVideoTimelineSource::GetCacheShare() const {
+    return CacheSize / (MaxOpenSources + MaxPrefetchedSources);
+}
+
+void BestVideoTimelineSource::SetMaxCacheSize(size_t Bytes) {
+    size_t Share;
+    {
+        std::lock_guard<std::mutex> Lock(SourceMutex);
+        CacheSize = Bytes;
+        Share = GetCacheShare();
+        for (auto &Iter : Sources)
+            Iter->SetMaxCacheSize(Share);
+    }
+
+    std::lock_guard<std::mutex> Lock(PrefetchMutex);
+    for (auto &Iter : PrefetchedSources)
+        Iter.second->SetMaxCacheSize(Share);
+}
+
+void BestVideoTimelineSource::SetSeekPreRoll(int64_t Frames) {
+    for (auto &Iter : Sources)
+        Iter->SetSeekPreRoll(Frames);
+}
+
+void BestVideoTimelineSource::SetMaxOpenSources(size_t Count) {
+    std::vector<size_t> Evicted;
+    size_t Share;
+    {
+        std::lock_guard<std::mutex> Lock(SourceMutex);
+        MaxOpenSources = std::max<size_t>(1, Count);
+        while (OpenSources.size() > MaxOpenSources) {
+            Evicted.push_back(OpenSources.back());
+            OpenSources.pop_back();
+        }
+        Share = GetCacheShare();
+        for (auto &Iter : Sources)
+            Iter->SetMaxCacheSize(Share);
+    }
+
+    for (size_t Iter : Evicted)
+        Sources[Iter]->CloseDecoders();
+
+    std::lock_guard<std::mutex> Lock(PrefetchMutex);
+    for (auto &Iter : PrefetchedSources)
+        Iter.second->SetMaxCacheSize(Share);
+}
+
+void BestVideoTimelineSource::SetPrefetch(int64_t Distance, int64_t Frames) {
+    std::lock_guard<std::mutex> Lock(PrefetchMutex);
+    PrefetchDistance = std::max<int64_t>(0, Distance);
+    PrefetchFrames = std::max<int64_t>(0, Frames);
+}
+
+const VideoProperties &BestVideoTimelineSource::GetVideoProperties() const {
+    return VP;
+}
+
+size_t BestVideoTimelineSource::GetNumSegments() const {
+    return SegmentSources.size();
+}
+
+int64_t BestVideoTimelineSource::GetSegmentFirstFrame(size_t Index) const {
+    return FirstFrames.at(Index);
+}
+
+size_t BestVideoTimelineSource::GetSegmentIndex(int64_t N) const {
+    return std::upper_bound(FirstFrames.begin(), FirstFrames.end(), N) - FirstFrames.begin() - 1;
+}
+
+void BestVideoTimelineSource::UseSource(size_t Index) {
+    // Closing waits for any decoding in progress in that file so it's done without holding the lock
+    std::vector<size_t> Evicted;
+    {
+        std::lock_guard<std::mutex> Lock(SourceMutex);
+        auto Iter = std::find(OpenSources.begin(), OpenSources.end(), Index);
+        if (Iter != OpenSources.end()) {
+            OpenSources.splice(OpenSources.begin(), OpenSources, Iter);
+        } else {
+            OpenSources.push_front(Index);
+            while (OpenSources.size() > MaxOpenSources) {
+                Evicted.push_back(OpenSources.back());
+                OpenSources.pop_back();
+            }
+        }
+    }
+
+    for (size_t Iter : Evicted)
+        Sources[Iter]->CloseDecoders();
+}
+
+void BestVideoTimelineSource::RequestPrefetch(size_t Segment, int64_t N) {
+    std::lock_guard<std::mutex> Lock(PrefetchMutex);
+    if (PrefetchDistance <= 0 || PrefetchFrames <= 0 || Segment + 1 >= SegmentSources.size() || FirstFrames[Segment + 1] - N > PrefetchDistance || LastPrefetch == Segment + 1)
+        return;
+    LastPrefetch = Segment + 1;
+    PrefetchRequest = Segment + 1;
+    if (!PrefetchThread.joinable())
+        PrefetchThread = std::thread(&BestVideoTimelineSource::PrefetchWorker, this);
+    PrefetchCondition.notify_one();
+}
+
+void BestVideoTimelineSource::PrefetchWorker() {
+    std::unique_lock<std::mutex> Lock(PrefetchMutex);
+    while (true) {
+        PrefetchCondition.wait(Lock, [this] { return PrefetchExit || PrefetchRequest != SIZE_MAX; });
+        if (PrefetchExit)
+            return;
+
+        size_t Segment = PrefetchRequest;
+        int64_t Count = std::min(PrefetchFrames, FirstFrames[Segment + 1] - FirstFrames[Segment]);
+        PrefetchRequest = SIZE_MAX;
+        size_t Index = SegmentSources[Segment];
+        std::shared_ptr<BestVideoSource> Source = PrefetchPool[Index];
+        Lock.unlock();
+
+        // A separate instance of the file is used so the output can keep decoding the current segment meanwhile, even when it's from
+        // the same file, and the decoded frames and decoder position are kept in it for the output to continue from. It's only opened
+        // from the existing index once and then reused for every later segment of the file.
+        try {
+            size_t Share;
+            {
+                std::lock_guard<std::mutex> SourceLock(SourceMutex);
+                Share = GetCacheShare();
+            }
+            if (!Source) {
+                Source.reset(new BestVideoSource(SourceFiles[Index], "", 0, Sources[Index]->GetTrack(), VariableFormat, Threads, CachePath.empty() ? "" : CachePath + "." + std::to_string(Index), &LAVFOptions, false, 0, false));
+                Source->SetSeekPreRoll(0);
+            }
+            Source->SetMaxCacheSize(Share);
+            for (int64_t i = 0; i < Count; i++)
+                delete Source->GetFrame(SegmentStarts[Segment] + i);
+        } catch (std::exception &e) {
+            BSDebugPrint(std::string("Prefetching failed: ") + e.what(), SegmentStarts[Segment]);
+            Source.reset();
+        } catch (...) {
+            BSDebugPrint("Prefetching failed", SegmentStarts[Segment]);
+            Source.reset();
+        }
+
+        Lock.lock();
+        // The previous one is kept too since the output is still in that segment when the next cut is prefetched
+        std::shared_ptr<BestVideoSource> Evicted;
+        if (Source) {
+            PrefetchPool[Index] = Source;
+            PrefetchedSources.remove_if([Segment](const std::pair<size_t, std::shared_ptr<BestVideoSource>> &Iter) { return Iter.first == Segment; });
+            PrefetchedSources.emplace_front(Segment, Source);
+            if (PrefetchedSources.size() > MaxPrefetchedSources) {
+                Evicted = std::move(PrefetchedSources.back().second);
+                PrefetchedSources.pop_back();
+                for (const auto &Iter : PrefetchedSources)
+                    if (Iter.second == Evicted)
+                        Evicted.reset();
+            }
+        }
+
+        // Instances that aren't used for any of the recent segments only keep their index around
+        if (Evicted) {
+            Lock.unlock();
+            Evicted->CloseDecoders();
+            Lock.lock();
+        }
+    }
+}
+
+std::shared_ptr<BestVideoSource> BestVideoTimelineSource::GetPrefetchedSource(size_t Segment) {
+    std::lock_guard<std::mutex> Lock(PrefetchMutex);
+    for (const auto &Iter : PrefetchedSources)
+        if (Iter.first == Segment)
+            return Iter.second;
+    return nullptr;
+}
+
+BestVideoFrame *BestVideoTimelineSource::GetFrame(int64_t N, bool Linear) {
+    if (N < 0 || N >= VP.NumFrames)
+        return nullptr;
+
+    size_t Segment = GetSegmentIndex(N);
+    BestVideoFrame *F;
+    std::shared_ptr<BestVideoSource> Prefetched = GetPrefetchedSource(Segment);
+    if (Prefetched) {
+        F = Prefetched->GetFrame(SegmentStarts[Segment] + N - FirstFrames[Segment], Linear);
+    } else {
+        size_t Index = SegmentSources[Segment];
+        UseSource(Index);
+        F = Sources[Index]->GetFrame(SegmentStarts[Segment] + N - FirstFrames[Segment], Linear);
+    }
+    if (F) {
+        F->Pts = av_rescale_q(N, { VP.FPS.Den, VP.FPS.Num }, { VP.TimeBase.Num, VP.TimeBase.Den });
+        F->Duration = av_rescale_q(N + 1, { VP.FPS.Den, VP.FPS.Num }, { VP.TimeBase.Num, VP.TimeBase.Den }) - F->Pts;
+    }
+
+    RequestPrefetch(Segment, N);
+    return F;
+}
+
+bool BestVideoTimelineSource::GetFrameIsTFF(int64_t N) {
+    if (N < 0 || N >= VP.NumFrames)
+        return false;
+    size_t Segment = GetSegmentIndex(N);
+    return Sources[SegmentSources[Segment]]->GetFrameIsTFF(SegmentStarts[Segment] + N - FirstFrames[Segment]);
+}
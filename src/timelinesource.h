@@ -0,0 +1,91 @@
+//  Copyright (c) 2022-2024 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+#ifndef TIMELINESOURCE_H
+#define TIMELINESOURCE_H
+
+#include "videosource.h"
+#include <condition_variable>
+#include <list>
+#include <thread>
+
+struct TimelineSegment {
+    std::string Source;
+    int64_t Start;
+    int64_t End; /* inclusive */
+};
+
+/* Splices trims from any number of files into a single clip, every file is only indexed and opened once no matter how many segments use it.
+ * Only the most recently used files keep their decoders open and the cache size is shared between them. When a request gets close to
+ * the end of a segment the first frames of the next one are decoded in the background with a separate instance of that file which the
+ * output then continues to use for that segment, so the seek doesn't stall the output at the cut and doesn't hold up requests for the current segment either.
+ * Every file gets at most one such instance which is reused for all later segments of it.
+ * Timestamps are generated from the frame rate of the first file. */
+class BestVideoTimelineSource {
+private:
+    std::vector<std::unique_ptr<BestVideoSource>> Sources;
+    std::vector<std::string> SourceFiles;
+    bool VariableFormat;
+    int Threads;
+    std::string CachePath;
+    std::map<std::string, std::string> LAVFOptions;
+    std::vector<size_t> SegmentSources; /* index into Sources for every segment */
+    std::vector<int64_t> SegmentStarts; /* first source frame of every segment */
+    std::vector<int64_t> FirstFrames; /* the number of the first output frame of every segment followed by the total number of frames */
+    VideoProperties VP = {};
+    std::list<size_t> OpenSources; /* most recently used first, the others have their decoders closed */
+    size_t MaxOpenSources = 3;
+    size_t CacheSize = 1024 * 1024 * 1024;
+    std::mutex SourceMutex;
+
+    int64_t PrefetchDistance = 24;
+    int64_t PrefetchFrames = 4;
+    std::thread PrefetchThread;
+    std::mutex PrefetchMutex;
+    std::condition_variable PrefetchCondition;
+    size_t PrefetchRequest = SIZE_MAX; /* segment waiting to be prefetched */
+    size_t LastPrefetch = SIZE_MAX; /* most recently requested segment so every boundary is only prefetched once in a row */
+    bool PrefetchExit = false;
+    static constexpr size_t MaxPrefetchedSources = 2;
+    std::vector<std::shared_ptr<BestVideoSource>> PrefetchPool; /* one instance per file created the first time one of its segments is prefetched, only the ones in PrefetchedSources have decoders open */
+    std::list<std::pair<size_t, std::shared_ptr<BestVideoSource>>> PrefetchedSources; /* the pool instances positioned at the start of the most recently prefetched segments */
+    [[nodiscard]] size_t GetCacheShare() const; /* has to be called with SourceMutex held */
+    [[nodiscard]] std::shared_ptr<BestVideoSource> GetPrefetchedSource(size_t Segment);
+    void PrefetchWorker();
+    void RequestPrefetch(size_t Segment, int64_t N);
+
+    [[nodiscard]] size_t GetSegmentIndex(int64_t N) const;
+    void UseSource(size_t Index);
+public:
+    BestVideoTimelineSource(const std::vector<TimelineSegment> &Segments, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    ~BestVideoTimelineSource();
+    void SetMaxCacheSize(size_t Bytes); /* the total for all open files and the two most recently prefetched instances which all get the same share, default is 1GB */
+    void SetSeekPreRoll(int64_t Frames);
+    void SetMaxOpenSources(size_t Count); /* the number of files whose decoders and cache are kept around, default is 3 so the previous, current and next file can all be open */
+    void SetPrefetch(int64_t Distance, int64_t Frames); /* start decoding Frames frames of the next segment when a request is within Distance frames of the cut, 0 disables it, default is 24 and 4 */
+    [[nodiscard]] const VideoProperties &GetVideoProperties() const;
+    [[nodiscard]] size_t GetNumSegments() const;
+    [[nodiscard]] int64_t GetSegmentFirstFrame(size_t Index) const;
+    [[nodiscard]] BestVideoFrame *GetFrame(int64_t N, bool Linear = false);
+    [[nodiscard]] bool GetFrameIsTFF(int64_t N);
+};
+
+#endif
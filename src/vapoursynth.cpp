@@ -20,6 +20,10 @@
 
 #include "videosource.h"
 #include "audiosource.h"
+#include "concatsource.h"
+#include "timelinesource.h"
+#include "groupsource.h"
+#include "streamsource.h"
 #include "bsshared.h"
 #include "version.h"
 #include <VapourSynth4.h>
@@ -31,6 +35,9 @@
 #include <string>
 #include <chrono>
 #include <mutex>
+#include <functional>
+#include <list>
+#include <cmath>
 
 static std::once_flag BSInitOnce;
 
@@ -51,133 +58,151 @@ struct BestVideoSourceData {
     int64_t FPSNum;
     int64_t FPSDen;
     bool RFF;
+    bool Proxy;
 };
 
 
 
+// Converts the frame and sets all properties that only depend on the frame itself
+static VSFrame *ExportVideoFrame(const BestVideoFrame *Src, const VideoProperties &VP, int n, VSCore *Core, const VSAPI *vsapi) {
+    VSVideoFormat VideoFormat = {};
+    vsapi->queryVideoFormat(&VideoFormat, Src->VF.ColorFamily, Src->VF.Float ? stFloat : stInteger, Src->VF.Bits, Src->VF.SubSamplingW, Src->VF.SubSamplingH, Core);
+    VSVideoFormat AlphaFormat = {};
+    vsapi->queryVideoFormat(&AlphaFormat, cfGray, VideoFormat.sampleType, VideoFormat.bitsPerSample, 0, 0, Core);
+
+    VSFrame *Dst = vsapi->newVideoFrame(&VideoFormat, Src->Width, Src->Height, nullptr, Core);
+    uint8_t *DstPtrs[3] = {};
+    ptrdiff_t DstStride[3] = {};
+
+    for (int Plane = 0; Plane < VideoFormat.numPlanes; Plane++) {
+        DstPtrs[Plane] = vsapi->getWritePtr(Dst, Plane);
+        DstStride[Plane] = vsapi->getStride(Dst, Plane);
+    }
+
+    VSFrame *AlphaDst = nullptr;
+    ptrdiff_t AlphaStride = 0;
+    if (Src->VF.Alpha) {
+        AlphaDst = vsapi->newVideoFrame(&AlphaFormat, Src->Width, Src->Height, nullptr, Core);
+        AlphaStride = vsapi->getStride(AlphaDst, 0);
+        vsapi->mapSetInt(vsapi->getFramePropertiesRW(AlphaDst), "_ColorRange", 0, maAppend);
+    }
+
+    if (!Src->ExportAsPlanar(DstPtrs, DstStride, AlphaDst ? vsapi->getWritePtr(AlphaDst, 0) : nullptr, AlphaStride)) {
+        vsapi->freeFrame(Dst);
+        vsapi->freeFrame(AlphaDst);
+        throw VideoException("Cannot export to planar format for frame " + std::to_string(n));
+    }
+
+    VSMap *Props = vsapi->getFramePropertiesRW(Dst);
+    if (AlphaDst)
+        vsapi->mapConsumeFrame(Props, "_Alpha", AlphaDst, maAppend);
+
+    // Set AR variables
+    if (VP.SAR.Num > 0 && VP.SAR.Den > 0) {
+        vsapi->mapSetInt(Props, "_SARNum", VP.SAR.Num, maAppend);
+        vsapi->mapSetInt(Props, "_SARDen", VP.SAR.Den, maAppend);
+    }
+
+    vsapi->mapSetInt(Props, "_Matrix", Src->Matrix, maAppend);
+    vsapi->mapSetInt(Props, "_Primaries", Src->Primaries, maAppend);
+    vsapi->mapSetInt(Props, "_Transfer", Src->Transfer, maAppend);
+    if (Src->ChromaLocation > 0)
+        vsapi->mapSetInt(Props, "_ChromaLocation", Src->ChromaLocation - 1, maAppend);
+
+    if (Src->ColorRange == 1) // Hardcoded ffmpeg constants, nothing to see here
+        vsapi->mapSetInt(Props, "_ColorRange", 1, maAppend);
+    else if (Src->ColorRange == 2)
+        vsapi->mapSetInt(Props, "_ColorRange", 0, maAppend);
+    vsapi->mapSetData(Props, "_PictType", &Src->PictType, 1, dtUtf8, maAppend);
+
+    // Set field information
+    int FieldBased = 0;
+    if (Src->InterlacedFrame)
+        FieldBased = (Src->TopFieldFirst ? 2 : 1);
+    vsapi->mapSetInt(Props, "_FieldBased", FieldBased, maAppend);
+    vsapi->mapSetInt(Props, "RepeatField", Src->RepeatPict, maAppend);
+
+    // FIXME, use PTS difference between frames instead?
+    if (Src->Duration > 0) {
+        int64_t DurNum = VP.TimeBase.Num;
+        int64_t DurDen = VP.TimeBase.Den;
+        vsh::muldivRational(&DurNum, &DurDen, Src->Duration, 1);
+        vsapi->mapSetInt(Props, "_DurationNum", DurNum, maAppend);
+        vsapi->mapSetInt(Props, "_DurationDen", DurDen, maAppend);
+    }
+
+    if (Src->HasMasteringDisplayPrimaries) {
+        for (int i = 0; i < 3; i++) {
+            vsapi->mapSetFloat(Props, "MasteringDisplayPrimariesX", Src->MasteringDisplayPrimaries[i][0].ToDouble(), maAppend);
+            vsapi->mapSetFloat(Props, "MasteringDisplayPrimariesY", Src->MasteringDisplayPrimaries[i][1].ToDouble(), maAppend);
+        }
+        vsapi->mapSetFloat(Props, "MasteringDisplayWhitePointX", Src->MasteringDisplayWhitePoint[0].ToDouble(), maAppend);
+        vsapi->mapSetFloat(Props, "MasteringDisplayWhitePointY", Src->MasteringDisplayWhitePoint[1].ToDouble(), maAppend);
+    }
+
+    if (Src->HasMasteringDisplayLuminance) {
+        vsapi->mapSetFloat(Props, "MasteringDisplayMinLuminance", Src->MasteringDisplayMinLuminance.ToDouble(), maAppend);
+        vsapi->mapSetFloat(Props, "MasteringDisplayMaxLuminance", Src->MasteringDisplayMaxLuminance.ToDouble(), maAppend);
+    }
+
+    if (Src->HasContentLightLevel) {
+        vsapi->mapSetInt(Props, "ContentLightLevelMax", Src->ContentLightLevelMax, maAppend);
+        vsapi->mapSetInt(Props, "ContentLightLevelAverage", Src->ContentLightLevelAverage, maAppend);
+    }
+
+    if (Src->DolbyVisionRPU && Src->DolbyVisionRPUSize) {
+        vsapi->mapSetData(Props, "DolbyVisionRPU", reinterpret_cast<const char *>(Src->DolbyVisionRPU), static_cast<int>(Src->DolbyVisionRPUSize), dtBinary, maAppend);
+    }
+
+    if (Src->HDR10Plus && Src->HDR10PlusSize > 0) {
+        vsapi->mapSetData(Props, "HDR10Plus", reinterpret_cast<const char *>(Src->HDR10Plus), static_cast<int>(Src->HDR10PlusSize), dtBinary, maReplace);
+    }
+
+    vsapi->mapSetInt(Props, "FlipVertical", VP.FlipVerical, maAppend);
+    vsapi->mapSetInt(Props, "FlipHorizontal", VP.FlipHorizontal, maAppend);
+    vsapi->mapSetInt(Props, "Rotation", VP.Rotation, maAppend);
+
+    return Dst;
+}
+
 static const VSFrame *VS_CC BestVideoSourceGetFrame(int n, int ActivationReason, void *InstanceData, void **, VSFrameContext *FrameCtx, VSCore *Core, const VSAPI *vsapi) {
     BestVideoSourceData *D = reinterpret_cast<BestVideoSourceData *>(InstanceData);
 
     if (ActivationReason == arInitial) {
         VSFrame *Dst = nullptr;
-        VSFrame *AlphaDst = nullptr;
-        std::unique_ptr<BestVideoFrame> Src;
+        std::shared_ptr<const BestVideoFrame> Src;
         try {
-            if (D->RFF) {
+            if (D->Proxy) {
+                Src.reset(D->V->GetProxyFrame(std::min(n, D->VI.numFrames - 1)));
+            } else if (D->RFF) {
                 Src.reset(D->V->GetFrameWithRFF(std::min(n, D->VI.numFrames - 1)));
             } else if (D->FPSNum > 0) {
                 double currentTime = D->V->GetVideoProperties().StartTime +
                     (double)(std::min(n, D->VI.numFrames - 1) * D->FPSDen) / D->FPSNum;
                 Src.reset(D->V->GetFrameByTime(currentTime));
             } else {
-                Src.reset(D->V->GetFrame(std::min(n, D->VI.numFrames - 1)));
+                Src = D->V->GetFrameRef(std::min(n, D->VI.numFrames - 1));
             }
 
             if (!Src)
                 throw VideoException("No frame returned for frame number " + std::to_string(n) + ". This may be due to an FFmpeg bug. Delete index and retry with threads=1.");
 
-            VSVideoFormat VideoFormat = {};
-            vsapi->queryVideoFormat(&VideoFormat, Src->VF.ColorFamily, Src->VF.Float ? stFloat : stInteger, Src->VF.Bits, Src->VF.SubSamplingW, Src->VF.SubSamplingH, Core);
-            VSVideoFormat AlphaFormat = {};
-            vsapi->queryVideoFormat(&AlphaFormat, cfGray, VideoFormat.sampleType, VideoFormat.bitsPerSample, 0, 0, Core);
-
-            Dst = vsapi->newVideoFrame(&VideoFormat, Src->Width, Src->Height, nullptr, Core);
-            uint8_t *DstPtrs[3] = {};
-            ptrdiff_t DstStride[3] = {};
-
-            for (int Plane = 0; Plane < VideoFormat.numPlanes; Plane++) {
-                DstPtrs[Plane] = vsapi->getWritePtr(Dst, Plane);
-                DstStride[Plane] = vsapi->getStride(Dst, Plane);
-            }
-
-            ptrdiff_t AlphaStride = 0;
-            if (Src->VF.Alpha) {
-                AlphaDst = vsapi->newVideoFrame(&AlphaFormat, Src->Width, Src->Height, nullptr, Core);
-                AlphaStride = vsapi->getStride(AlphaDst, 0);
-                vsapi->mapSetInt(vsapi->getFramePropertiesRW(AlphaDst), "_ColorRange", 0, maAppend);
-            }
-
-            if (!Src->ExportAsPlanar(DstPtrs, DstStride, AlphaDst ? vsapi->getWritePtr(AlphaDst, 0) : nullptr, AlphaStride)) {
-                throw VideoException("Cannot export to planar format for frame " + std::to_string(n));
-            }
-
+            Dst = ExportVideoFrame(Src.get(), D->V->GetVideoProperties(), n, Core, vsapi);
         } catch (VideoException &e) {
-            vsapi->freeFrame(Dst);
-            vsapi->freeFrame(AlphaDst);
             vsapi->setFilterError(("VideoSource: " + std::string(e.what())).c_str(), FrameCtx);
             return nullptr;
         }
 
-        const VideoProperties &VP = D->V->GetVideoProperties();
-        VSMap *Props = vsapi->getFramePropertiesRW(Dst);
-        if (AlphaDst)
-            vsapi->mapConsumeFrame(Props, "_Alpha", AlphaDst, maAppend);
-
-        // Set AR variables
-        if (VP.SAR.Num > 0 && VP.SAR.Den > 0) {
-            vsapi->mapSetInt(Props, "_SARNum", VP.SAR.Num, maAppend);
-            vsapi->mapSetInt(Props, "_SARDen", VP.SAR.Den, maAppend);
-        }
-
-        vsapi->mapSetInt(Props, "_Matrix", Src->Matrix, maAppend);
-        vsapi->mapSetInt(Props, "_Primaries", Src->Primaries, maAppend);
-        vsapi->mapSetInt(Props, "_Transfer", Src->Transfer, maAppend);
-        if (Src->ChromaLocation > 0)
-            vsapi->mapSetInt(Props, "_ChromaLocation", Src->ChromaLocation - 1, maAppend);
-
-        if (Src->ColorRange == 1) // Hardcoded ffmpeg constants, nothing to see here
-            vsapi->mapSetInt(Props, "_ColorRange", 1, maAppend);
-        else if (Src->ColorRange == 2)
-            vsapi->mapSetInt(Props, "_ColorRange", 0, maAppend);
-        vsapi->mapSetData(Props, "_PictType", &Src->PictType, 1, dtUtf8, maAppend);
-
-        // Set field information
-        int FieldBased = 0;
-        if (Src->InterlacedFrame)
-            FieldBased = (Src->TopFieldFirst ? 2 : 1);
-        vsapi->mapSetInt(Props, "_FieldBased", FieldBased, maAppend);
-        vsapi->mapSetInt(Props, "RepeatField", Src->RepeatPict, maAppend);
-
-        // FIXME, use PTS difference between frames instead?
-        if (Src->Duration > 0) {
-            int64_t DurNum = VP.TimeBase.Num;
-            int64_t DurDen = VP.TimeBase.Den;
-            vsh::muldivRational(&DurNum, &DurDen, Src->Duration, 1);
-            vsapi->mapSetInt(Props, "_DurationNum", DurNum, maAppend);
-            vsapi->mapSetInt(Props, "_DurationDen", DurDen, maAppend);
-        }
-
-        if (Src->HasMasteringDisplayPrimaries) {
-            for (int i = 0; i < 3; i++) {
-                vsapi->mapSetFloat(Props, "MasteringDisplayPrimariesX", Src->MasteringDisplayPrimaries[i][0].ToDouble(), maAppend);
-                vsapi->mapSetFloat(Props, "MasteringDisplayPrimariesY", Src->MasteringDisplayPrimaries[i][1].ToDouble(), maAppend);
-            }
-            vsapi->mapSetFloat(Props, "MasteringDisplayWhitePointX", Src->MasteringDisplayWhitePoint[0].ToDouble(), maAppend);
-            vsapi->mapSetFloat(Props, "MasteringDisplayWhitePointY", Src->MasteringDisplayWhitePoint[1].ToDouble(), maAppend);
-        }
-
-        if (Src->HasMasteringDisplayLuminance) {
-            vsapi->mapSetFloat(Props, "MasteringDisplayMinLuminance", Src->MasteringDisplayMinLuminance.ToDouble(), maAppend);
-            vsapi->mapSetFloat(Props, "MasteringDisplayMaxLuminance", Src->MasteringDisplayMaxLuminance.ToDouble(), maAppend);
-        }
-
-        if (Src->HasContentLightLevel) {
-            vsapi->mapSetInt(Props, "ContentLightLevelMax", Src->ContentLightLevelMax, maAppend);
-            vsapi->mapSetInt(Props, "ContentLightLevelAverage", Src->ContentLightLevelAverage, maAppend);
+        if (!D->RFF && D->FPSNum <= 0 && D->V->HasStatistics()) {
+            const VideoStatistics &VS = D->V->GetFrameStatistics(std::min(n, D->VI.numFrames - 1));
+            VSMap *Props = vsapi->getFramePropertiesRW(Dst);
+            vsapi->mapSetInt(Props, "LumaMin", VS.LumaMin, maAppend);
+            vsapi->mapSetInt(Props, "LumaMax", VS.LumaMax, maAppend);
+            vsapi->mapSetFloat(Props, "LumaMean", VS.LumaMean, maAppend);
+            vsapi->mapSetFloat(Props, "LumaDiff", VS.LumaDiff, maAppend);
+            vsapi->mapSetData(Props, "LumaThumbnail", reinterpret_cast<const char *>(VS.Thumbnail.data()), static_cast<int>(VS.Thumbnail.size()), dtBinary, maAppend);
         }
 
-        if (Src->DolbyVisionRPU && Src->DolbyVisionRPUSize) {
-            vsapi->mapSetData(Props, "DolbyVisionRPU", reinterpret_cast<const char *>(Src->DolbyVisionRPU), static_cast<int>(Src->DolbyVisionRPUSize), dtBinary, maAppend);
-        }
-
-        if (Src->HDR10Plus && Src->HDR10PlusSize > 0) {
-            vsapi->mapSetData(Props, "HDR10Plus", reinterpret_cast<const char *>(Src->HDR10Plus), static_cast<int>(Src->HDR10PlusSize), dtBinary, maReplace);
-        }
-
-        vsapi->mapSetInt(Props, "FlipVertical", VP.FlipVerical, maAppend);
-        vsapi->mapSetInt(Props, "FlipHorizontal", VP.FlipHorizontal, maAppend);
-        vsapi->mapSetInt(Props, "Rotation", VP.Rotation, maAppend);
-
         return Dst;
     }
 
@@ -196,6 +221,7 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
     const char *CachePath = vsapi->mapGetData(In, "cachepath", 0, &err);
     const char *HWDevice = vsapi->mapGetData(In, "hwdevice", 0, &err);
     const char *Timecodes = vsapi->mapGetData(In, "timecodes", 0, &err);
+    const char *AccessLogPath = vsapi->mapGetData(In, "accesslog", 0, &err);
     int Track = vsapi->mapGetIntSaturated(In, "track", 0, &err);
     if (err)
         Track = -1;
@@ -212,8 +238,12 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
         Opts["enable_drefs"] = "1";
     if (vsapi->mapGetInt(In, "use_absolute_path", 0, &err))
         Opts["use_absolute_path"] = "1";
+    bool Statistics = !!vsapi->mapGetInt(In, "statistics", 0, &err);
+    int ProxyScale = vsapi->mapGetIntSaturated(In, "proxyscale", 0, &err);
+    bool SampledHash = !!vsapi->mapGetInt(In, "sampledhash", 0, &err);
 
     BestVideoSourceData *D = new BestVideoSourceData();
+    D->Proxy = (ProxyScale > 0);
 
     try {
         D->FPSNum = vsapi->mapGetInt(In, "fpsnum", 0, &err);
@@ -230,10 +260,13 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
         if (D->FPSNum > 0 && D->RFF)
             throw VideoException("Cannot combine CFR and RFF modes");
 
+        if (D->Proxy && (D->FPSNum > 0 || D->RFF))
+            throw VideoException("Cannot combine proxy output with CFR or RFF modes");
+
         if (ShowProgress) {
             auto NextUpdate = std::chrono::high_resolution_clock::now();
             int LastValue = -1;
-            D->V.reset(new BestVideoSource(Source, HWDevice ? HWDevice : "", ExtraHWFrames, Track, VariableFormat, Threads, CachePath ? CachePath : "", &Opts, 
+            D->V.reset(new BestVideoSource(Source, HWDevice ? HWDevice : "", ExtraHWFrames, Track, VariableFormat, Threads, CachePath ? CachePath : "", &Opts, Statistics, ProxyScale, SampledHash,
                 [vsapi, Core, &NextUpdate, &LastValue](int Track, int64_t Cur, int64_t Total) {
                     if (NextUpdate < std::chrono::high_resolution_clock::now()) {
                         if (Total == INT64_MAX && Cur == Total) {
@@ -250,7 +283,7 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
                     }));
             
         } else {
-            D->V.reset(new BestVideoSource(Source, HWDevice ? HWDevice : "", ExtraHWFrames, Track, VariableFormat, Threads, CachePath ? CachePath : "", &Opts));
+            D->V.reset(new BestVideoSource(Source, HWDevice ? HWDevice : "", ExtraHWFrames, Track, VariableFormat, Threads, CachePath ? CachePath : "", &Opts, Statistics, ProxyScale, SampledHash));
         }
 
         const VideoProperties &VP = D->V->GetVideoProperties();
@@ -260,6 +293,11 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
         D->VI.height = VP.Height;
         if (VariableFormat)
             D->VI = {};
+        if (D->Proxy) {
+            vsapi->queryVideoFormat(&D->VI.format, cfYUV, stInteger, 8, 1, 1, Core);
+            D->VI.width = D->V->GetProxyWidth();
+            D->VI.height = D->V->GetProxyHeight();
+        }
         D->VI.numFrames = vsh::int64ToIntS(VP.NumFrames);
         D->VI.fpsNum = VP.FPS.Num;
         D->VI.fpsDen = VP.FPS.Den;
@@ -285,6 +323,19 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
 
         if (Timecodes)
             D->V->WriteTimecodes(Timecodes);
+
+        if (AccessLogPath)
+            D->V->SetAccessLog(AccessLogPath);
+
+        // The shared cache is only an optimization so the clip works without it
+        int64_t SharedCacheSize = vsapi->mapGetInt(In, "sharedcachesize", 0, &err);
+        if (!err && SharedCacheSize > 0) {
+            try {
+                D->V->SetSharedCache("/bestsource", SharedCacheSize * 1024 * 1024);
+            } catch (VideoException &e) {
+                vsapi->logMessage(mtWarning, (std::string("VideoSource: Not using the shared cache, ") + e.what()).c_str(), Core);
+            }
+        }
     } catch (VideoException &e) {
         delete D;
         vsapi->mapSetError(Out, (std::string("VideoSource: ") + e.what()).c_str());
@@ -298,6 +349,412 @@ static void VS_CC CreateBestVideoSource(const VSMap *In, VSMap *Out, void *, VSC
     vsapi->createVideoFilter(Out, "VideoSource", &D->VI, BestVideoSourceGetFrame, BestVideoSourceFree, fmUnordered, nullptr, 0, D, Core);
 }
 
+struct BestVideoStreamSourceData {
+    VSVideoInfo VI = {};
+    std::unique_ptr<BestVideoStreamSource> S;
+};
+
+static const VSFrame *VS_CC BestVideoStreamSourceGetFrame(int n, int ActivationReason, void *InstanceData, void **, VSFrameContext *FrameCtx, VSCore *Core, const VSAPI *vsapi) {
+    BestVideoStreamSourceData *D = reinterpret_cast<BestVideoStreamSourceData *>(InstanceData);
+
+    if (ActivationReason == arInitial) {
+        try {
+            std::unique_ptr<BestVideoFrame> Src(D->S->GetFrame(n));
+            if (!Src)
+                throw VideoException("The stream ended after " + std::to_string(D->S->GetNumDecodedFrames()) + " frames, frame " + std::to_string(n) + " requested");
+            return ExportVideoFrame(Src.get(), D->S->GetVideoProperties(), n, Core, vsapi);
+        } catch (VideoException &e) {
+            vsapi->setFilterError(("StreamVideoSource: " + std::string(e.what())).c_str(), FrameCtx);
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+static void VS_CC BestVideoStreamSourceFree(void *InstanceData, VSCore *Core, const VSAPI *vsapi) {
+    delete reinterpret_cast<BestVideoStreamSourceData *>(InstanceData);
+}
+
+// The number of frames in a stream is only known once it has been decoded to the end so it has to be passed in
+static void VS_CC CreateBestVideoStreamSource(const VSMap *In, VSMap *Out, void *, VSCore *Core, const VSAPI *vsapi) {
+    BSInit();
+
+    int err;
+    const char *Source = vsapi->mapGetData(In, "source", 0, nullptr);
+    int NumFrames = vsapi->mapGetIntSaturated(In, "numframes", 0, nullptr);
+    int Track = vsapi->mapGetIntSaturated(In, "track", 0, &err);
+    if (err)
+        Track = -1;
+    bool VariableFormat = !!vsapi->mapGetInt(In, "variableformat", 0, &err);
+    int Threads = vsapi->mapGetIntSaturated(In, "threads", 0, &err);
+    std::map<std::string, std::string> Opts;
+    if (vsapi->mapGetInt(In, "enable_drefs", 0, &err))
+        Opts["enable_drefs"] = "1";
+    if (vsapi->mapGetInt(In, "use_absolute_path", 0, &err))
+        Opts["use_absolute_path"] = "1";
+
+    BestVideoStreamSourceData *D = new BestVideoStreamSourceData();
+
+    try {
+        if (NumFrames < 1)
+            throw VideoException("numframes must be 1 or greater");
+
+        D->S.reset(new BestVideoStreamSource(Source, Track, VariableFormat, Threads, &Opts));
+
+        const VideoProperties &VP = D->S->GetVideoProperties();
+        if (VP.VF.ColorFamily == 0 || !vsapi->queryVideoFormat(&D->VI.format, VP.VF.ColorFamily, VP.VF.Float, VP.VF.Bits, VP.VF.SubSamplingW, VP.VF.SubSamplingH, Core))
+            throw VideoException("Unsupported video format from decoder (probably less than 8 bit or palette)");
+        D->VI.width = VP.Width;
+        D->VI.height = VP.Height;
+        if (VariableFormat)
+            D->VI = {};
+        D->VI.numFrames = NumFrames;
+        D->VI.fpsNum = VP.FPS.Num;
+        D->VI.fpsDen = VP.FPS.Den;
+        vsh::reduceRational(&D->VI.fpsNum, &D->VI.fpsDen);
+    } catch (VideoException &e) {
+        delete D;
+        vsapi->mapSetError(Out, (std::string("StreamVideoSource: ") + e.what()).c_str());
+        return;
+    }
+
+    int64_t CacheSize = vsapi->mapGetInt(In, "cachesize", 0, &err);
+    if (!err && CacheSize >= 0)
+        D->S->SetMaxCacheSize(CacheSize * 1024 * 1024);
+
+    vsapi->createVideoFilter(Out, "StreamVideoSource", &D->VI, BestVideoStreamSourceGetFrame, BestVideoStreamSourceFree, fmUnordered, nullptr, 0, D, Core);
+}
+
+// ConcatVideoSource and TimelineVideoSource only differ in how the source is constructed
+template<typename T>
+struct BestVideoMultiSourceData {
+    VSVideoInfo VI = {};
+    std::unique_ptr<T> C;
+    std::string FilterName;
+};
+
+template<typename T>
+static const VSFrame *VS_CC BestVideoMultiSourceGetFrame(int n, int ActivationReason, void *InstanceData, void **, VSFrameContext *FrameCtx, VSCore *Core, const VSAPI *vsapi) {
+    BestVideoMultiSourceData<T> *D = reinterpret_cast<BestVideoMultiSourceData<T> *>(InstanceData);
+
+    if (ActivationReason == arInitial) {
+        try {
+            std::unique_ptr<BestVideoFrame> Src(D->C->GetFrame(std::min(n, D->VI.numFrames - 1)));
+            if (!Src)
+                throw VideoException("No frame returned for frame number " + std::to_string(n) + ". This may be due to an FFmpeg bug. Delete index and retry with threads=1.");
+            return ExportVideoFrame(Src.get(), D->C->GetVideoProperties(), n, Core, vsapi);
+        } catch (VideoException &e) {
+            vsapi->setFilterError((D->FilterName + ": " + e.what()).c_str(), FrameCtx);
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+template<typename T>
+static void VS_CC BestVideoMultiSourceFree(void *InstanceData, VSCore *Core, const VSAPI *vsapi) {
+    delete reinterpret_cast<BestVideoMultiSourceData<T> *>(InstanceData);
+}
+
+typedef std::function<void(int Track, int64_t Current, int64_t Total)> ProgressFunction;
+
+// Logs the indexing progress of the filters that open several files, at most once per second
+static ProgressFunction MakeProgressFunction(const std::string &Name, VSCore *Core, const VSAPI *vsapi) {
+    return [vsapi, Core, Name, NextUpdate = std::chrono::high_resolution_clock::now(), LastValue = -1](int Track, int64_t Cur, int64_t Total) mutable {
+        if (NextUpdate < std::chrono::high_resolution_clock::now()) {
+            if (Total == INT64_MAX && Cur == Total) {
+                vsapi->logMessage(mtInformation, (Name + " track #" + std::to_string(Track) + " indexing complete").c_str(), Core);
+            } else {
+                int PValue = (Total > 0) ? static_cast<int>((static_cast<double>(Cur) / static_cast<double>(Total)) * 100) : static_cast<int>(Cur / (1024 * 1024));
+                if (PValue != LastValue) {
+                    vsapi->logMessage(mtInformation, (Name + " track #" + std::to_string(Track) + " index progress " + std::to_string(PValue) + ((Total > 0) ? "%" : "MB")).c_str(), Core);
+                    LastValue = PValue;
+                    NextUpdate = std::chrono::high_resolution_clock::now() + std::chrono::seconds(1);
+                }
+            }
+        }
+    };
+}
+
+// Create is called with the common arguments and returns the new source, it may read and apply any additional arguments of its own
+template<typename T>
+static void CreateBestVideoMultiSource(const char *FilterName, const VSMap *In, VSMap *Out, VSCore *Core, const VSAPI *vsapi,
+    const std::function<T *(int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> &Opts, const ProgressFunction &Progress)> &Create) {
+    BSInit();
+
+    int err;
+    const char *CachePath = vsapi->mapGetData(In, "cachepath", 0, &err);
+    int Track = vsapi->mapGetIntSaturated(In, "track", 0, &err);
+    if (err)
+        Track = -1;
+    bool VariableFormat = !!vsapi->mapGetInt(In, "variableformat", 0, &err);
+    int Threads = vsapi->mapGetIntSaturated(In, "threads", 0, &err);
+    bool ShowProgress = !!vsapi->mapGetInt(In, "showprogress", 0, &err);
+    if (err)
+        ShowProgress = true;
+    std::map<std::string, std::string> Opts;
+    if (vsapi->mapGetInt(In, "enable_drefs", 0, &err))
+        Opts["enable_drefs"] = "1";
+    if (vsapi->mapGetInt(In, "use_absolute_path", 0, &err))
+        Opts["use_absolute_path"] = "1";
+
+    BestVideoMultiSourceData<T> *D = new BestVideoMultiSourceData<T>();
+    D->FilterName = FilterName;
+
+    try {
+        ProgressFunction Progress;
+        if (ShowProgress)
+            Progress = MakeProgressFunction(FilterName, Core, vsapi);
+
+        D->C.reset(Create(Track, VariableFormat, Threads, CachePath ? CachePath : "", Opts, Progress));
+
+        const VideoProperties &VP = D->C->GetVideoProperties();
+        if (VP.VF.ColorFamily == 0 || !vsapi->queryVideoFormat(&D->VI.format, VP.VF.ColorFamily, VP.VF.Float, VP.VF.Bits, VP.VF.SubSamplingW, VP.VF.SubSamplingH, Core))
+            throw VideoException("Unsupported video format from decoder (probably less than 8 bit or palette)");
+        D->VI.width = VP.Width;
+        D->VI.height = VP.Height;
+        if (VariableFormat)
+            D->VI = {};
+        D->VI.numFrames = vsh::int64ToIntS(VP.NumFrames);
+        D->VI.fpsNum = VP.FPS.Num;
+        D->VI.fpsDen = VP.FPS.Den;
+        vsh::reduceRational(&D->VI.fpsNum, &D->VI.fpsDen);
+
+        int SeekPreRoll = vsapi->mapGetIntSaturated(In, "seekpreroll", 0, &err);
+        if (!err)
+            D->C->SetSeekPreRoll(SeekPreRoll);
+    } catch (VideoException &e) {
+        delete D;
+        vsapi->mapSetError(Out, (std::string(FilterName) + ": " + e.what()).c_str());
+        return;
+    }
+
+    int64_t CacheSize = vsapi->mapGetInt(In, "cachesize", 0, &err);
+    if (!err && CacheSize >= 0)
+        D->C->SetMaxCacheSize(CacheSize * 1024 * 1024);
+
+    vsapi->createVideoFilter(Out, FilterName, &D->VI, BestVideoMultiSourceGetFrame<T>, BestVideoMultiSourceFree<T>, fmUnordered, nullptr, 0, D, Core);
+}
+
+static void VS_CC CreateBestVideoConcatSource(const VSMap *In, VSMap *Out, void *, VSCore *Core, const VSAPI *vsapi) {
+    std::vector<std::string> Sources;
+    int NumSources = vsapi->mapNumElements(In, "source");
+    for (int i = 0; i < NumSources; i++)
+        Sources.push_back(vsapi->mapGetData(In, "source", i, nullptr));
+
+    CreateBestVideoMultiSource<BestVideoConcatSource>("ConcatVideoSource", In, Out, Core, vsapi,
+        [&Sources](int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> &Opts, const ProgressFunction &Progress) {
+            return new BestVideoConcatSource(Sources, Track, VariableFormat, Threads, CachePath, &Opts, Progress);
+        });
+}
+
+static void VS_CC CreateBestVideoTimelineSource(const VSMap *In, VSMap *Out, void *, VSCore *Core, const VSAPI *vsapi) {
+    int NumSegments = vsapi->mapNumElements(In, "source");
+    if (vsapi->mapNumElements(In, "start") != NumSegments || vsapi->mapNumElements(In, "end") != NumSegments) {
+        vsapi->mapSetError(Out, "TimelineVideoSource: source, start and end must have the same number of elements");
+        return;
+    }
+    std::vector<TimelineSegment> Segments;
+    for (int i = 0; i < NumSegments; i++)
+        Segments.push_back({ vsapi->mapGetData(In, "source", i, nullptr), vsapi->mapGetInt(In, "start", i, nullptr), vsapi->mapGetInt(In, "end", i, nullptr) });
+
+    CreateBestVideoMultiSource<BestVideoTimelineSource>("TimelineVideoSource", In, Out, Core, vsapi,
+        [&Segments, In, vsapi](int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> &Opts, const ProgressFunction &Progress) {
+            std::unique_ptr<BestVideoTimelineSource> C(new BestVideoTimelineSource(Segments, Track, VariableFormat, Threads, CachePath, &Opts, Progress));
+            int err;
+            int64_t PrefetchDistance = vsapi->mapGetInt(In, "prefetch", 0, &err);
+            if (err)
+                PrefetchDistance = 24;
+            int64_t PrefetchFrames = vsapi->mapGetInt(In, "prefetchframes", 0, &err);
+            if (err)
+                PrefetchFrames = 4;
+            C->SetPrefetch(PrefetchDistance, PrefetchFrames);
+            return C.release();
+        });
+}
+
+// All clips returned by MulticamVideoSource share one group source so the files are decoded in parallel and every set only once
+struct BestVideoGroupSourceShared {
+    typedef std::vector<std::shared_ptr<const BestVideoFrame>> FrameSet;
+
+    std::unique_ptr<BestVideoGroupSource> G;
+    int64_t FPSNum;
+    int64_t FPSDen;
+    std::mutex GroupMutex;
+    std::list<std::pair<int, FrameSet>> RecentSets; /* most recently used first, the clips usually request the same n close together */
+    static constexpr size_t MaxRecentSets = 8;
+
+    FrameSet GetFrames(int n) {
+        std::lock_guard<std::mutex> Lock(GroupMutex);
+        for (auto Iter = RecentSets.begin(); Iter != RecentSets.end(); ++Iter) {
+            if (Iter->first == n) {
+                RecentSets.splice(RecentSets.begin(), RecentSets, Iter);
+                return Iter->second;
+            }
+        }
+
+        FrameSet Frames;
+        for (auto &Iter : G->GetFrames(static_cast<double>(n * FPSDen) / FPSNum))
+            Frames.emplace_back(std::move(Iter));
+        RecentSets.emplace_front(n, Frames);
+        if (RecentSets.size() > MaxRecentSets)
+            RecentSets.pop_back();
+        return Frames;
+    }
+};
+
+struct BestVideoGroupMemberData {
+    VSVideoInfo VI = {};
+    VSVideoFormat BlankFormat = {};
+    std::shared_ptr<BestVideoGroupSourceShared> S;
+    size_t Member;
+};
+
+// Used for the frames where a file doesn't cover the requested time
+static VSFrame *MakeBlankFrame(const VSVideoFormat &Format, int Width, int Height, VSCore *Core, const VSAPI *vsapi) {
+    VSFrame *Dst = vsapi->newVideoFrame(&Format, Width, Height, nullptr, Core);
+    for (int Plane = 0; Plane < Format.numPlanes; Plane++) {
+        int Value = 0;
+        if (Format.sampleType == stInteger && Format.colorFamily != cfRGB)
+            Value = (Plane == 0) ? (16 << (Format.bitsPerSample - 8)) : (1 << (Format.bitsPerSample - 1));
+        uint8_t *Ptr = vsapi->getWritePtr(Dst, Plane);
+        ptrdiff_t Stride = vsapi->getStride(Dst, Plane);
+        int PlaneWidth = vsapi->getFrameWidth(Dst, Plane);
+        int PlaneHeight = vsapi->getFrameHeight(Dst, Plane);
+        for (int y = 0; y < PlaneHeight; y++) {
+            if (Format.bytesPerSample == 1)
+                std::fill_n(Ptr, PlaneWidth, static_cast<uint8_t>(Value));
+            else if (Format.bytesPerSample == 2)
+                std::fill_n(reinterpret_cast<uint16_t *>(Ptr), PlaneWidth, static_cast<uint16_t>(Value));
+            else
+                std::fill_n(reinterpret_cast<float *>(Ptr), PlaneWidth, 0.f);
+            Ptr += Stride;
+        }
+    }
+    return Dst;
+}
+
+static const VSFrame *VS_CC BestVideoGroupMemberGetFrame(int n, int ActivationReason, void *InstanceData, void **, VSFrameContext *FrameCtx, VSCore *Core, const VSAPI *vsapi) {
+    BestVideoGroupMemberData *D = reinterpret_cast<BestVideoGroupMemberData *>(InstanceData);
+
+    if (ActivationReason == arInitial) {
+        VSFrame *Dst = nullptr;
+        try {
+            BestVideoGroupSourceShared::FrameSet Frames = D->S->GetFrames(std::min(n, D->VI.numFrames - 1));
+            const VideoProperties &VP = D->S->G->GetVideoProperties(D->Member);
+            if (Frames[D->Member])
+                Dst = ExportVideoFrame(Frames[D->Member].get(), VP, n, Core, vsapi);
+            else
+                Dst = MakeBlankFrame(D->BlankFormat, VP.Width, VP.Height, Core, vsapi);
+        } catch (VideoException &e) {
+            vsapi->setFilterError(("MulticamVideoSource: " + std::string(e.what())).c_str(), FrameCtx);
+            return nullptr;
+        }
+
+        // All clips are on the same timeline so the frame duration is the group frame rate and not the one of the file
+        VSMap *Props = vsapi->getFramePropertiesRW(Dst);
+        vsapi->mapSetInt(Props, "_DurationNum", D->S->FPSDen, maReplace);
+        vsapi->mapSetInt(Props, "_DurationDen", D->S->FPSNum, maReplace);
+        return Dst;
+    }
+
+    return nullptr;
+}
+
+static void VS_CC BestVideoGroupMemberFree(void *InstanceData, VSCore *Core, const VSAPI *vsapi) {
+    delete reinterpret_cast<BestVideoGroupMemberData *>(InstanceData);
+}
+
+static void VS_CC CreateBestVideoGroupSource(const VSMap *In, VSMap *Out, void *, VSCore *Core, const VSAPI *vsapi) {
+    BSInit();
+
+    int err;
+    const char *CachePath = vsapi->mapGetData(In, "cachepath", 0, &err);
+    int Track = vsapi->mapGetIntSaturated(In, "track", 0, &err);
+    if (err)
+        Track = -1;
+    bool VariableFormat = !!vsapi->mapGetInt(In, "variableformat", 0, &err);
+    int Threads = vsapi->mapGetIntSaturated(In, "threads", 0, &err);
+    int Workers = vsapi->mapGetIntSaturated(In, "workers", 0, &err);
+    bool ShowProgress = !!vsapi->mapGetInt(In, "showprogress", 0, &err);
+    if (err)
+        ShowProgress = true;
+    std::map<std::string, std::string> Opts;
+    if (vsapi->mapGetInt(In, "enable_drefs", 0, &err))
+        Opts["enable_drefs"] = "1";
+    if (vsapi->mapGetInt(In, "use_absolute_path", 0, &err))
+        Opts["use_absolute_path"] = "1";
+
+    int NumMembers = vsapi->mapNumElements(In, "source");
+    int NumOffsets = vsapi->mapNumElements(In, "offset");
+    if (NumOffsets > 0 && NumOffsets != NumMembers) {
+        vsapi->mapSetError(Out, "MulticamVideoSource: source and offset must have the same number of elements");
+        return;
+    }
+    std::vector<GroupMember> Members;
+    for (int i = 0; i < NumMembers; i++)
+        Members.push_back({ vsapi->mapGetData(In, "source", i, nullptr), (NumOffsets > 0) ? vsapi->mapGetFloat(In, "offset", i, nullptr) : 0 });
+
+    std::shared_ptr<BestVideoGroupSourceShared> S = std::make_shared<BestVideoGroupSourceShared>();
+    std::vector<std::unique_ptr<BestVideoGroupMemberData>> Clips;
+
+    try {
+        S->FPSNum = vsapi->mapGetInt(In, "fpsnum", 0, &err);
+        if (err)
+            S->FPSNum = -1;
+        S->FPSDen = vsapi->mapGetInt(In, "fpsden", 0, &err);
+        if (err)
+            S->FPSDen = 1;
+        if (S->FPSDen < 1)
+            throw VideoException("FPS denominator needs to be 1 or greater");
+
+        S->G.reset(new BestVideoGroupSource(Members, Track, VariableFormat, Threads, Workers, CachePath ? CachePath : "", &Opts, ShowProgress ? MakeProgressFunction("MulticamVideoSource", Core, vsapi) : nullptr));
+
+        if (S->FPSNum <= 0) {
+            S->FPSNum = S->G->GetVideoProperties(0).FPS.Num;
+            S->FPSDen = S->G->GetVideoProperties(0).FPS.Den;
+        }
+        vsh::reduceRational(&S->FPSNum, &S->FPSDen);
+        int NumFrames = std::max(1, vsh::int64ToIntS(static_cast<int64_t>(std::ceil(S->G->GetDuration() * S->FPSNum / S->FPSDen))));
+
+        for (size_t i = 0; i < S->G->GetNumMembers(); i++) {
+            const VideoProperties &VP = S->G->GetVideoProperties(i);
+            Clips.emplace_back(new BestVideoGroupMemberData());
+            BestVideoGroupMemberData *D = Clips.back().get();
+            if (VP.VF.ColorFamily == 0 || !vsapi->queryVideoFormat(&D->BlankFormat, VP.VF.ColorFamily, VP.VF.Float, VP.VF.Bits, VP.VF.SubSamplingW, VP.VF.SubSamplingH, Core))
+                throw VideoException("Unsupported video format from decoder (probably less than 8 bit or palette)");
+            if (!VariableFormat) {
+                D->VI.format = D->BlankFormat;
+                D->VI.width = VP.Width;
+                D->VI.height = VP.Height;
+            }
+            D->VI.numFrames = NumFrames;
+            D->VI.fpsNum = S->FPSNum;
+            D->VI.fpsDen = S->FPSDen;
+            D->S = S;
+            D->Member = i;
+        }
+
+        int SeekPreRoll = vsapi->mapGetIntSaturated(In, "seekpreroll", 0, &err);
+        if (!err)
+            S->G->SetSeekPreRoll(SeekPreRoll);
+    } catch (VideoException &e) {
+        vsapi->mapSetError(Out, (std::string("MulticamVideoSource: ") + e.what()).c_str());
+        return;
+    }
+
+    int64_t CacheSize = vsapi->mapGetInt(In, "cachesize", 0, &err);
+    if (!err && CacheSize >= 0)
+        S->G->SetMaxCacheSize(CacheSize * 1024 * 1024);
+
+    for (auto &Iter : Clips) {
+        BestVideoGroupMemberData *D = Iter.release();
+        vsapi->mapConsumeNode(Out, "clip", vsapi->createVideoFilter2("MulticamVideoSource", &D->VI, BestVideoGroupMemberGetFrame, BestVideoGroupMemberFree, fmUnordered, nullptr, 0, D, Core), maAppend);
+    }
+}
+
 struct BestAudioSourceData {
     VSAudioInfo AI = {};
     std::unique_ptr<BestAudioSource> A;
@@ -316,6 +773,18 @@ static const VSFrame *VS_CC BestAudioSourceGetFrame(int n, int ActivationReason,
             Tmp.push_back(vsapi->getWritePtr(Dst, Channel));
         try {
             D->A->GetPlanarAudio(Tmp.data(), n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES), SamplesOut);
+
+            if (D->A->HasStatistics()) {
+                VSMap *Props = vsapi->getFramePropertiesRW(Dst);
+                AudioStatistics AS = D->A->GetStatisticsBySamples(n * static_cast<int64_t>(VS_AUDIO_FRAME_SAMPLES), SamplesOut);
+                vsapi->mapSetFloat(Props, "Peak", AS.Peak, maAppend);
+                vsapi->mapSetFloat(Props, "RMS", AS.RMS, maAppend);
+                vsapi->mapSetFloat(Props, "ShortTermLoudness", AS.Loudness, maAppend);
+                const AudioStatistics &TS = D->A->GetTrackStatistics();
+                vsapi->mapSetFloat(Props, "TrackPeak", TS.Peak, maAppend);
+                vsapi->mapSetFloat(Props, "TrackRMS", TS.RMS, maAppend);
+                vsapi->mapSetFloat(Props, "TrackIntegratedLoudness", TS.Loudness, maAppend);
+            }
         } catch (AudioException &e) {
             vsapi->setFilterError(("AudioSource: " + std::string(e.what())).c_str(), FrameCtx);
             vsapi->freeFrame(Dst);
@@ -337,6 +806,7 @@ static void VS_CC CreateBestAudioSource(const VSMap *In, VSMap *Out, void *, VSC
     int err;
     const char *Source = vsapi->mapGetData(In, "source", 0, nullptr);
     const char *CachePath = vsapi->mapGetData(In, "cachepath", 0, &err);
+    const char *AccessLogPath = vsapi->mapGetData(In, "accesslog", 0, &err);
     int Track = vsapi->mapGetIntSaturated(In, "track", 0, &err);
     if (err)
         Track = -1;
@@ -355,6 +825,9 @@ static void VS_CC CreateBestAudioSource(const VSMap *In, VSMap *Out, void *, VSC
         Opts["use_absolute_path"] = "1";
 
     double DrcScale = vsapi->mapGetFloat(In, "drc_scale", 0, &err);
+    int OutputBits = vsapi->mapGetIntSaturated(In, "outputbits", 0, &err);
+    bool OutputFloat = !!vsapi->mapGetInt(In, "outputfloat", 0, &err);
+    bool Statistics = !!vsapi->mapGetInt(In, "statistics", 0, &err);
 
     BestAudioSourceData *D = new BestAudioSourceData();
 
@@ -362,7 +835,7 @@ static void VS_CC CreateBestAudioSource(const VSMap *In, VSMap *Out, void *, VSC
         if (ShowProgress) {
             auto NextUpdate = std::chrono::high_resolution_clock::now();
             int LastValue = -1;
-            D->A.reset(new BestAudioSource(Source, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale,
+            D->A.reset(new BestAudioSource(Source, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale, Statistics,
                 [vsapi, Core, &NextUpdate, &LastValue](int Track, int64_t Cur, int64_t Total) {
                     if (NextUpdate < std::chrono::high_resolution_clock::now()) {
                         if (Total == INT64_MAX && Cur == Total) {
@@ -379,9 +852,12 @@ static void VS_CC CreateBestAudioSource(const VSMap *In, VSMap *Out, void *, VSC
                 }));
 
         } else {
-            D->A.reset(new BestAudioSource(Source, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale));
+            D->A.reset(new BestAudioSource(Source, Track, AdjustDelay, false, Threads, CachePath ? CachePath : "", &Opts, DrcScale, Statistics));
         }
 
+        if (OutputBits > 0)
+            D->A->SetOutputFormat(OutputFloat, OutputBits);
+
         const AudioProperties &AP = D->A->GetAudioProperties();
         if (!vsapi->queryAudioFormat(&D->AI.format, AP.AF.Float, AP.AF.Bits, AP.ChannelLayout, Core))
             throw AudioException("Unsupported audio format from decoder (probably 8-bit)");
@@ -390,6 +866,9 @@ static void VS_CC CreateBestAudioSource(const VSMap *In, VSMap *Out, void *, VSC
         D->AI.numFrames = static_cast<int>((AP.NumSamples + VS_AUDIO_FRAME_SAMPLES - 1) / VS_AUDIO_FRAME_SAMPLES);
         if ((AP.NumSamples + VS_AUDIO_FRAME_SAMPLES - 1) / VS_AUDIO_FRAME_SAMPLES > std::numeric_limits<int>::max())
             throw AudioException("Too many audio samples, cut file into smaller parts");
+
+        if (AccessLogPath)
+            D->A->SetAccessLog(AccessLogPath);
     } catch (AudioException &e) {
         delete D;
         vsapi->mapSetError(Out, (std::string("AudioSource: ") + e.what()).c_str());
@@ -417,10 +896,70 @@ static void VS_CC SetLogLevel(const VSMap *in, VSMap *out, void *, VSCore *, con
     vsapi->mapSetInt(out, "level", SetFFmpegLogLevel(level), maReplace);
 }
 
+static void VS_CC SetTraceFile(const VSMap *in, VSMap *out, void *, VSCore *, const VSAPI *vsapi) {
+    BSInit();
+    const char *Filename = vsapi->mapGetData(in, "filename", 0, nullptr);
+    if (!SetBSTraceFile(Filename ? Filename : ""))
+        vsapi->mapSetError(out, (std::string("SetTraceFile: Couldn't open trace file '") + Filename + "'").c_str());
+}
+
+static void VS_CC GetFrameInfo(const VSMap *In, VSMap *Out, void *, VSCore *, const VSAPI *vsapi) {
+    BSInit();
+
+    int err;
+    const char *Source = vsapi->mapGetData(In, "source", 0, nullptr);
+    const char *CachePath = vsapi->mapGetData(In, "cachepath", 0, &err);
+    int Track = vsapi->mapGetIntSaturated(In, "track", 0, &err);
+    if (err)
+        Track = -1;
+    std::map<std::string, std::string> Opts;
+    if (vsapi->mapGetInt(In, "enable_drefs", 0, &err))
+        Opts["enable_drefs"] = "1";
+    if (vsapi->mapGetInt(In, "use_absolute_path", 0, &err))
+        Opts["use_absolute_path"] = "1";
+
+    std::vector<VideoFrameInfo> FrameInfo;
+    BSRational TimeBase;
+    try {
+        if (!BestVideoSource::GetIndexedFrameInfo(Source, Track, CachePath ? CachePath : "", &Opts, FrameInfo, TimeBase))
+            throw VideoException("No up to date index found, create one with VideoSource or bsindex first");
+    } catch (VideoException &e) {
+        vsapi->mapSetError(Out, (std::string("GetFrameInfo: ") + e.what()).c_str());
+        return;
+    }
+
+    std::vector<int64_t> Values(FrameInfo.size());
+    auto SetArray = [&](const char *Key, int64_t (*Get)(const VideoFrameInfo &)) {
+        std::transform(FrameInfo.begin(), FrameInfo.end(), Values.begin(), Get);
+        vsapi->mapSetIntArray(Out, Key, Values.data(), static_cast<int>(Values.size()));
+    };
+
+    SetArray("pts", [](const VideoFrameInfo &FI) -> int64_t { return FI.PTS; });
+    SetArray("duration", [](const VideoFrameInfo &FI) -> int64_t { return FI.Duration; });
+    SetArray("repeatpict", [](const VideoFrameInfo &FI) -> int64_t { return FI.RepeatPict; });
+    SetArray("keyframe", [](const VideoFrameInfo &FI) -> int64_t { return FI.KeyFrame; });
+    SetArray("tff", [](const VideoFrameInfo &FI) -> int64_t { return FI.TFF; });
+    SetArray("packetsize", [](const VideoFrameInfo &FI) -> int64_t { return FI.PacketSize; });
+
+    std::string PictTypes;
+    for (const auto &Iter : FrameInfo)
+        PictTypes += Iter.PictType;
+    vsapi->mapSetData(Out, "picttype", PictTypes.c_str(), static_cast<int>(PictTypes.size()), dtUtf8, maReplace);
+
+    int64_t TB[2] = { TimeBase.Num, TimeBase.Den };
+    vsapi->mapSetIntArray(Out, "timebase", TB, 2);
+}
+
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin("com.vapoursynth.bestsource", "bs", "Best Source 2", VS_MAKE_VERSION(BEST_SOURCE_VERSION_MAJOR, BEST_SOURCE_VERSION_MINOR), VS_MAKE_VERSION(VAPOURSYNTH_API_MAJOR, 0), 0, plugin);
-    vspapi->registerFunction("VideoSource", "source:data;track:int:opt;variableformat:int:opt;fpsnum:int:opt;fpsden:int:opt;rff:int:opt;threads:int:opt;seekpreroll:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachepath:data:opt;cachesize:int:opt;hwdevice:data:opt;extrahwframes:int:opt;timecodes:data:opt;showprogress:int:opt;", "clip:vnode;", CreateBestVideoSource, nullptr, plugin);
-    vspapi->registerFunction("AudioSource", "source:data;track:int:opt;adjustdelay:int:opt;threads:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;drc_scale:float:opt;cachepath:data:opt;cachesize:int:opt;showprogress:int:opt;", "clip:anode;", CreateBestAudioSource, nullptr, plugin);
+    vspapi->registerFunction("VideoSource", "source:data;track:int:opt;variableformat:int:opt;fpsnum:int:opt;fpsden:int:opt;rff:int:opt;threads:int:opt;seekpreroll:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachepath:data:opt;cachesize:int:opt;hwdevice:data:opt;extrahwframes:int:opt;timecodes:data:opt;statistics:int:opt;proxyscale:int:opt;sampledhash:int:opt;accesslog:data:opt;sharedcachesize:int:opt;showprogress:int:opt;", "clip:vnode;", CreateBestVideoSource, nullptr, plugin);
+    vspapi->registerFunction("StreamVideoSource", "source:data;numframes:int;track:int:opt;variableformat:int:opt;threads:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachesize:int:opt;", "clip:vnode;", CreateBestVideoStreamSource, nullptr, plugin);
+    vspapi->registerFunction("ConcatVideoSource", "source:data[];track:int:opt;variableformat:int:opt;threads:int:opt;seekpreroll:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachepath:data:opt;cachesize:int:opt;showprogress:int:opt;", "clip:vnode;", CreateBestVideoConcatSource, nullptr, plugin);
+    vspapi->registerFunction("TimelineVideoSource", "source:data[];start:int[];end:int[];track:int:opt;variableformat:int:opt;threads:int:opt;seekpreroll:int:opt;prefetch:int:opt;prefetchframes:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachepath:data:opt;cachesize:int:opt;showprogress:int:opt;", "clip:vnode;", CreateBestVideoTimelineSource, nullptr, plugin);
+    vspapi->registerFunction("MulticamVideoSource", "source:data[];offset:float[]:opt;fpsnum:int:opt;fpsden:int:opt;track:int:opt;variableformat:int:opt;threads:int:opt;workers:int:opt;seekpreroll:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachepath:data:opt;cachesize:int:opt;showprogress:int:opt;", "clip:vnode[];", CreateBestVideoGroupSource, nullptr, plugin);
+    vspapi->registerFunction("AudioSource", "source:data;track:int:opt;adjustdelay:int:opt;threads:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;drc_scale:float:opt;cachepath:data:opt;cachesize:int:opt;outputbits:int:opt;outputfloat:int:opt;statistics:int:opt;accesslog:data:opt;showprogress:int:opt;", "clip:anode;", CreateBestAudioSource, nullptr, plugin);
     vspapi->registerFunction("SetDebugOutput", "enable:int;", "", SetDebugOutput, nullptr, plugin);
     vspapi->registerFunction("SetFFmpegLogLevel", "level:int;", "level:int;", SetLogLevel, nullptr, plugin);
+    vspapi->registerFunction("SetTraceFile", "filename:data:opt;", "", SetTraceFile, nullptr, plugin);
+    vspapi->registerFunction("GetFrameInfo", "source:data;track:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;cachepath:data:opt;", "pts:int[];duration:int[];repeatpict:int[];keyframe:int[];tff:int[];packetsize:int[];picttype:data;timebase:int[];", GetFrameInfo, nullptr, plugin);
 }
@@ -22,6 +22,6 @@
 #define VERSION_H
 
 #define BEST_SOURCE_VERSION_MAJOR 2
-#define BEST_SOURCE_VERSION_MINOR 97
+#define BEST_SOURCE_VERSION_MINOR 99
 
 #endif
\ No newline at end of file
@@ -19,11 +19,16 @@
 //  THE SOFTWARE.
 
 #include "videosource.h"
+#include "bskernels.h"
+#include "bsprobes.h"
+#include "sharedcache.h"
 #include "version.h"
 #include <algorithm>
 #include <thread>
 #include <cassert>
 #include <iterator>
+#include <limits>
+#include <unordered_map>
 
 #include "../libp2p/p2p_api.h"
 
@@ -68,9 +73,19 @@ static int IsRealPlanar(const AVPixFmtDescriptor *Desc) {
 }
 
 bool LWVideoDecoder::ReadPacket() {
+    if (SharedPackets) {
+        if (!SharedPackets->ReadPacket(TrackNumber, Packet))
+            return false;
+        Packet->opaque = reinterpret_cast<void *>(static_cast<intptr_t>(Packet->size));
+        return true;
+    }
+
     while (av_read_frame(FormatContext, Packet) >= 0) {
-        if (Packet->stream_index == TrackNumber)
+        if (Packet->stream_index == TrackNumber) {
+            // Passed through to the decoded frame so its size can be stored in the index
+            Packet->opaque = reinterpret_cast<void *>(static_cast<intptr_t>(Packet->size));
             return true;
+        }
         av_packet_unref(Packet);
     }
     return false;
@@ -109,7 +124,7 @@ bool LWVideoDecoder::DecodeNextFrame(bool SkipOutput) {
     return false;
 }
 
-void LWVideoDecoder::OpenFile(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts) {
+void LWVideoDecoder::OpenFile(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts, const std::map<std::string, std::string> *CodecOpts) {
     TrackNumber = Track;
 
     AVHWDeviceType Type = AV_HWDEVICE_TYPE_NONE;
@@ -206,6 +221,8 @@ void LWVideoDecoder::OpenFile(const std::string &SourceFile, const std::string &
         CodecContext->flags |= AV_CODEC_FLAG_DROPCHANGED;
     }
 
+    CodecContext->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+
     // Full explanation by more clever person available here: https://github.com/Nevcairiel/LAVFilters/issues/113
     if (CodecContext->codec_id == AV_CODEC_ID_H264 && CodecContext->has_b_frames) {
         CodecContext->has_b_frames = 15; // the maximum possible value for h264
@@ -223,18 +240,27 @@ void LWVideoDecoder::OpenFile(const std::string &SourceFile, const std::string &
                 throw VideoException("Couldn't allocate frame");
     }
 
-    if (avcodec_open2(CodecContext, Codec, nullptr) < 0)
+    AVDictionary *CodecDict = nullptr;
+    if (CodecOpts)
+        for (const auto &Iter : *CodecOpts)
+            av_dict_set(&CodecDict, Iter.first.c_str(), Iter.second.c_str(), 0);
+
+    int OpenRet = avcodec_open2(CodecContext, Codec, &CodecDict);
+    av_dict_free(&CodecDict);
+    if (OpenRet < 0)
         throw VideoException("Could not open video codec");
 }
 
-LWVideoDecoder::LWVideoDecoder(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts) {
+LWVideoDecoder::LWVideoDecoder(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts, const std::map<std::string, std::string> *CodecOpts) {
+    BSTraceSpan Trace("open");
     try {
         Packet = av_packet_alloc();
-        OpenFile(SourceFile, HWDeviceName, ExtraHWFrames, Track, VariableFormat, Threads, LAVFOpts);
+        OpenFile(SourceFile, HWDeviceName, ExtraHWFrames, Track, VariableFormat, Threads, LAVFOpts, CodecOpts);
     } catch (...) {
         Free();
         throw;
     }
+    BS_PROBE1(video_decoder_open, TrackNumber);
 }
 
 void LWVideoDecoder::Free() {
@@ -247,6 +273,7 @@ void LWVideoDecoder::Free() {
 }
 
 LWVideoDecoder::~LWVideoDecoder() {
+    BS_PROBE1(video_decoder_close, TrackNumber);
     Free();
 }
 
@@ -255,6 +282,8 @@ int64_t LWVideoDecoder::GetSourceSize() const {
 }
 
 int64_t LWVideoDecoder::GetSourcePostion() const {
+    if (SharedPackets)
+        return SharedPackets->GetSourcePosition();
     return avio_tell(FormatContext->pb);
 }
 
@@ -262,6 +291,10 @@ int LWVideoDecoder::GetTrack() const {
     return TrackNumber;
 }
 
+void LWVideoDecoder::SetSharedPacketReader(SharedPacketReader *Reader) {
+    SharedPackets = Reader;
+}
+
 int64_t LWVideoDecoder::GetFrameNumber() const {
     return CurrentFrame;
 }
@@ -270,9 +303,11 @@ void LWVideoDecoder::SetFrameNumber(int64_t N) {
     CurrentFrame = N;
 }
 
-void LWVideoDecoder::GetVideoProperties(VideoProperties &VP) {
+void LWVideoDecoder::GetVideoProperties(VideoProperties &VP, AVFrame **FirstFrame) {
     assert(CurrentFrame == 0);
     VP = {};
+    if (FirstFrame)
+        *FirstFrame = nullptr;
     AVFrame *PropFrame = GetNextFrame();
     assert(PropFrame);
     if (!PropFrame)
@@ -392,9 +427,15 @@ void LWVideoDecoder::GetVideoProperties(VideoProperties &VP) {
                 VP.Rotation += 360;
         }
     }
+
+    if (FirstFrame)
+        *FirstFrame = PropFrame;
+    else
+        av_frame_free(&PropFrame);
 }
 
 AVFrame *LWVideoDecoder::GetNextFrame() {
+    BSTraceSpan Trace("decode", CurrentFrame);
     if (DecodeSuccess) {
         DecodeSuccess = DecodeNextFrame();
         if (DecodeSuccess) {
@@ -408,6 +449,7 @@ AVFrame *LWVideoDecoder::GetNextFrame() {
 }
 
 bool LWVideoDecoder::SkipFrames(int64_t Count) {
+    BSTraceSpan Trace("skip", CurrentFrame);
     while (Count-- > 0) {
         if (DecodeSuccess) {
             DecodeSuccess = DecodeNextFrame(true);
@@ -532,6 +574,7 @@ const AVFrame *BestVideoFrame::GetAVFrame() const {
 };
 
 void BestVideoFrame::MergeField(bool Top, const BestVideoFrame *AFieldSrc) {
+    BSTraceSpan Trace("merge field");
     const AVFrame *FieldSrc = AFieldSrc->GetAVFrame();
     if (Frame->format != FieldSrc->format || Frame->width != FieldSrc->width || Frame->height != FieldSrc->height)
         throw VideoException("Merged frames must have same format");
@@ -565,6 +608,7 @@ void BestVideoFrame::MergeField(bool Top, const BestVideoFrame *AFieldSrc) {
 }
 
 bool BestVideoFrame::ExportAsPlanar(uint8_t **Dsts, ptrdiff_t *Stride, uint8_t *AlphaDst, ptrdiff_t AlphaStride) const {
+    BSTraceSpan Trace("export");
     if (VF.ColorFamily == 0)
         return false;
     auto Desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(Frame->format));
@@ -676,7 +720,12 @@ bool BestVideoFrame::ExportAsPlanar(uint8_t **Dsts, ptrdiff_t *Stride, uint8_t *
     return true;
 }
 
-static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame) {
+// Sampled hashes only cover every nth row of each plane so at most SampledHashRows rows are read, the
+// dimensions and format are included since they're no longer implied by the amount of data hashed
+static constexpr int SampledHashRows = 64;
+
+static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame, bool Sampled) {
+    BSTraceSpan Trace("hash");
     std::array<uint8_t, HashSize> Result;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(Frame->format));
     int NumPlanes = 0;
@@ -690,6 +739,11 @@ static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame) {
     XXH3_state_t *hctx = XXH3_createState();
     XXH3_64bits_reset(hctx);
 
+    if (Sampled) {
+        int Geometry[3] = { Frame->width, Frame->height, Frame->format };
+        XXH3_64bits_update(hctx, Geometry, sizeof(Geometry));
+    }
+
     for (int p = 0; p < NumPlanes; p++) {
         int Width = Frame->width;
         int Height = Frame->height;
@@ -700,9 +754,15 @@ static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame) {
         Width *= SampleSize[p];
         assert(Width <= Frame->linesize[p]);
         const uint8_t *Data = Frame->data[p];
-        for (int h = 0; h < Height; h++) {
-            XXH3_64bits_update(hctx, Data, Width);
-            Data += Frame->linesize[p];
+        if (Sampled && Height > SampledHashRows) {
+            int Step = Height / SampledHashRows;
+            for (int h = Step / 2; h < Height; h += Step)
+                XXH3_64bits_update(hctx, Data + static_cast<ptrdiff_t>(h) * Frame->linesize[p], Width);
+        } else {
+            for (int h = 0; h < Height; h++) {
+                XXH3_64bits_update(hctx, Data, Width);
+                Data += Frame->linesize[p];
+            }
         }
     }
 
@@ -715,6 +775,315 @@ static std::array<uint8_t, HashSize> GetHash(const AVFrame *Frame) {
     return Result;
 }
 
+// The decoder passes the size set in ReadPacket() through in opaque
+static int GetPacketSize(const AVFrame *Frame) {
+    intptr_t Size = reinterpret_cast<intptr_t>(Frame->opaque);
+    return (Size > 0) ? static_cast<int>(Size) : -1;
+}
+
+std::array<uint8_t, HashSize> GetVideoFrameHash(const AVFrame *Frame, bool Sampled) {
+    return GetHash(Frame, Sampled);
+}
+
+int GetVideoFramePacketSize(const AVFrame *Frame) {
+    return GetPacketSize(Frame);
+}
+
+// Collects luma statistics in the indexing pass. Frames are only read one row at a time and
+// the inner loops are kept free of branches so the compiler can vectorize them.
+
+namespace {
+    template<typename T>
+    static void LumaRangeStatistics(const T *Src, int Width, unsigned &Min, unsigned &Max, uint64_t &Sum) {
+        T RangeMin = Src[0];
+        T RangeMax = Src[0];
+        uint64_t RangeSum = 0;
+        for (int x = 0; x < Width; x++) {
+            RangeMin = std::min(RangeMin, Src[x]);
+            RangeMax = std::max(RangeMax, Src[x]);
+            RangeSum += Src[x];
+        }
+        Min = std::min<unsigned>(Min, RangeMin);
+        Max = std::max<unsigned>(Max, RangeMax);
+        Sum += RangeSum;
+    }
+
+    template<typename T>
+    static uint64_t LumaAbsDiff(const T *Src, const T *Prev, int Width) {
+        uint64_t Sum = 0;
+        for (int x = 0; x < Width; x++)
+            Sum += static_cast<unsigned>(std::abs(static_cast<int>(Src[x]) - static_cast<int>(Prev[x])));
+        return Sum;
+    }
+
+    class VideoStatisticsCollector {
+    private:
+        static constexpr int TS = VideoStatistics::ThumbnailSize;
+        AVFrame *Prev = nullptr;
+
+        template<typename T>
+        void ProcessPlane(const AVFrame *F, int Depth, VideoStatistics &Result) {
+            int Width = F->width;
+            int Height = F->height;
+            bool HasPrev = Prev && Prev->format == F->format && Prev->width == Width && Prev->height == Height;
+
+            int BlockX[TS + 1];
+            for (int i = 0; i <= TS; i++)
+                BlockX[i] = (i * Width) / TS;
+
+            uint64_t BlockSums[TS * TS] = {};
+            unsigned Min = std::numeric_limits<unsigned>::max();
+            unsigned Max = 0;
+            uint64_t DiffSum = 0;
+
+            for (int y = 0; y < Height; y++) {
+                const T *Src = reinterpret_cast<const T *>(F->data[0] + y * static_cast<ptrdiff_t>(F->linesize[0]));
+                uint64_t *RowBlocks = BlockSums + ((y * TS) / Height) * TS;
+                for (int bx = 0; bx < TS; bx++) {
+                    if (BlockX[bx + 1] > BlockX[bx])
+                        LumaRangeStatistics(Src + BlockX[bx], BlockX[bx + 1] - BlockX[bx], Min, Max, RowBlocks[bx]);
+                }
+                if (HasPrev)
+                    DiffSum += LumaAbsDiff(Src, reinterpret_cast<const T *>(Prev->data[0] + y * static_cast<ptrdiff_t>(Prev->linesize[0])), Width);
+            }
+
+            uint64_t Sum = 0;
+            for (int by = 0; by < TS; by++) {
+                int64_t BlockHeight = ((by + 1) * Height) / TS - (by * Height) / TS;
+                for (int bx = 0; bx < TS; bx++) {
+                    Sum += BlockSums[by * TS + bx];
+                    int64_t Count = BlockHeight * (BlockX[bx + 1] - BlockX[bx]);
+                    uint64_t Average = Count > 0 ? (BlockSums[by * TS + bx] + Count / 2) / Count : 0;
+                    Result.Thumbnail[by * TS + bx] = static_cast<uint8_t>(std::min<uint64_t>(255, (Depth >= 8) ? (Average >> (Depth - 8)) : (Average << (8 - Depth))));
+                }
+            }
+
+            double NumPixels = static_cast<double>(Width) * Height;
+            Result.LumaMin = static_cast<int>(Min);
+            Result.LumaMax = static_cast<int>(Max);
+            Result.LumaMean = Sum / NumPixels;
+            Result.LumaDiff = HasPrev ? DiffSum / NumPixels : 0;
+        }
+    public:
+        ~VideoStatisticsCollector() {
+            av_frame_free(&Prev);
+        }
+
+        VideoStatistics Process(const AVFrame *F) {
+            VideoStatistics Result = {};
+            Result.LumaMin = -1;
+            Result.LumaMax = -1;
+
+            const AVPixFmtDescriptor *Desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(F->format));
+            if (!Desc || F->width <= 0 || F->height <= 0)
+                return Result;
+
+            const AVComponentDescriptor &Luma = Desc->comp[0];
+            int BytesPerSample = (Luma.depth > 8) ? 2 : 1;
+            bool Supported = GetColorFamily(Desc) != 2 && !(Desc->flags & (AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_FLOAT)) &&
+                Luma.plane == 0 && Luma.offset == 0 && Luma.shift == 0 && Luma.step == BytesPerSample && Luma.depth <= 16;
+
+            if (!Supported) {
+                av_frame_free(&Prev);
+                return Result;
+            }
+
+            if (BytesPerSample == 1)
+                ProcessPlane<uint8_t>(F, Luma.depth, Result);
+            else
+                ProcessPlane<uint16_t>(F, Luma.depth, Result);
+
+            av_frame_free(&Prev);
+            Prev = av_frame_clone(F);
+            return Result;
+        }
+    };
+}
+
+// Proxy files store every frame as a separate 8 bit 4:2:0 MJPEG image followed by a table with the offset of every image so any
+// frame can be located directly from its number and decoded on its own. Every output pixel is the average of the source pixels it covers.
+
+namespace {
+    constexpr int ProxyQuality = 3; /* MJPEG quantizer from 2 to 31 where lower is better */
+
+    template<typename T>
+    static void DownscalePlane(const uint8_t *Src, ptrdiff_t Stride, int SrcWidth, int SrcHeight, int Depth, uint8_t *Dst, ptrdiff_t DstStride, int DstWidth, int DstHeight) {
+        std::vector<int> Left(DstWidth);
+        std::vector<int> Right(DstWidth);
+        for (int x = 0; x < DstWidth; x++) {
+            Left[x] = std::min(static_cast<int>((x * static_cast<int64_t>(SrcWidth)) / DstWidth), SrcWidth - 1);
+            Right[x] = std::min(std::max(Left[x] + 1, static_cast<int>(((x + 1) * static_cast<int64_t>(SrcWidth)) / DstWidth)), SrcWidth);
+        }
+        std::vector<uint64_t> Sums(DstWidth);
+
+        for (int y = 0; y < DstHeight; y++) {
+            int Top = static_cast<int>((y * static_cast<int64_t>(SrcHeight)) / DstHeight);
+            int Bottom = std::max(Top + 1, static_cast<int>(((y + 1) * static_cast<int64_t>(SrcHeight)) / DstHeight));
+            Top = std::min(Top, SrcHeight - 1);
+            Bottom = std::min(Bottom, SrcHeight);
+
+            std::fill(Sums.begin(), Sums.end(), 0);
+            for (int sy = Top; sy < Bottom; sy++) {
+                const T *Row = reinterpret_cast<const T *>(Src + sy * Stride);
+                for (int x = 0; x < DstWidth; x++) {
+                    uint64_t Sum = 0;
+                    for (int sx = Left[x]; sx < Right[x]; sx++)
+                        Sum += Row[sx];
+                    Sums[x] += Sum;
+                }
+            }
+
+            for (int x = 0; x < DstWidth; x++) {
+                int64_t Count = static_cast<int64_t>(Bottom - Top) * (Right[x] - Left[x]);
+                uint64_t Average = (Sums[x] + Count / 2) / Count;
+                Dst[x] = static_cast<uint8_t>(std::min<uint64_t>(255, (Depth >= 8) ? (Average >> (Depth - 8)) : (Average << (8 - Depth))));
+            }
+            Dst += DstStride;
+        }
+    }
+
+    class VideoProxyWriter {
+    private:
+        std::string Path;
+        file_ptr_t F;
+        int Width;
+        int Height;
+        bool HeaderWritten = false;
+        bool Finished = false;
+        AVCodecContext *Encoder = nullptr;
+        AVFrame *Buffer = nullptr;
+        AVPacket *Packet = nullptr;
+        std::vector<int64_t> Offsets;
+
+        void Free() {
+            av_packet_free(&Packet);
+            av_frame_free(&Buffer);
+            avcodec_free_context(&Encoder);
+        }
+    public:
+        VideoProxyWriter(const std::string &CachePath, int Track, int Scale, int Width, int Height, int64_t SourceSize) : Path(GetCacheFilePath(CachePath, Track, "bsproxy")), Width(Width), Height(Height) {
+            try {
+                const AVCodec *Codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+                if (!Codec)
+                    throw VideoException("MJPEG encoder not found, proxies can't be created");
+
+                Encoder = avcodec_alloc_context3(Codec);
+                if (!Encoder)
+                    throw VideoException("Could not allocate proxy encoder context");
+
+                // The samples are stored as they are and the actual range is kept in the proxy header
+                Encoder->width = Width;
+                Encoder->height = Height;
+                Encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+                Encoder->color_range = AVCOL_RANGE_JPEG;
+                Encoder->time_base = { 1, 25 };
+                Encoder->flags |= AV_CODEC_FLAG_QSCALE;
+                Encoder->global_quality = ProxyQuality * FF_QP2LAMBDA;
+                if (avcodec_open2(Encoder, Codec, nullptr) < 0)
+                    throw VideoException("Could not open proxy encoder");
+
+                Buffer = av_frame_alloc();
+                Packet = av_packet_alloc();
+                if (!Buffer || !Packet)
+                    throw VideoException("Couldn't allocate proxy frame");
+                Buffer->format = AV_PIX_FMT_YUV420P;
+                Buffer->width = Width;
+                Buffer->height = Height;
+                Buffer->color_range = AVCOL_RANGE_JPEG;
+                if (av_frame_get_buffer(Buffer, 0) < 0)
+                    throw VideoException("Couldn't allocate proxy frame");
+
+                F = OpenFile(Path, true);
+                if (!F)
+                    throw VideoException("Couldn't create the proxy file");
+            } catch (...) {
+                Free();
+                throw;
+            }
+
+            WriteBSHeader(F, true);
+            WriteInt64(F, SourceSize);
+            WriteInt(F, Track);
+            WriteInt(F, Scale);
+            WriteInt(F, Width);
+            WriteInt(F, Height);
+        }
+
+        // A proxy that wasn't finished is never left behind
+        ~VideoProxyWriter() {
+            Free();
+            if (!Finished) {
+                F.reset();
+                RemoveFile(Path);
+            }
+        }
+
+        // Returns false if the frame's format can't be used to create a proxy
+        bool Process(const AVFrame *Frame) {
+            const AVPixFmtDescriptor *Desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(Frame->format));
+            if (!Desc || GetColorFamily(Desc) == 2 || !IsRealPlanar(Desc) || (Desc->flags & (AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_FLOAT)))
+                return false;
+
+            int Depth = Desc->comp[0].depth;
+            int BytesPerSample = (Depth > 8) ? 2 : 1;
+            for (int i = 0; i < std::min<int>(Desc->nb_components, 3); i++)
+                if (Desc->comp[i].step != BytesPerSample || Desc->comp[i].shift != 0 || Desc->comp[i].offset != 0)
+                    return false;
+
+            if (!HeaderWritten) {
+                WriteInt(F, Frame->colorspace);
+                WriteInt(F, Frame->color_primaries);
+                WriteInt(F, Frame->color_trc);
+                WriteInt(F, Frame->chroma_location);
+                WriteInt(F, Frame->color_range);
+                HeaderWritten = true;
+            }
+
+            // The encoder may still hold a reference to the previous frame
+            if (av_frame_make_writable(Buffer) < 0)
+                throw VideoException("Couldn't allocate proxy frame");
+
+            auto Downscale = (BytesPerSample == 1) ? DownscalePlane<uint8_t> : DownscalePlane<uint16_t>;
+            Downscale(Frame->data[0], Frame->linesize[0], Frame->width, Frame->height, Depth, Buffer->data[0], Buffer->linesize[0], Width, Height);
+
+            int ChromaWidth = -((-Frame->width) >> Desc->log2_chroma_w);
+            int ChromaHeight = -((-Frame->height) >> Desc->log2_chroma_h);
+            for (int p = 1; p < 3; p++) {
+                if (Desc->nb_components >= 3) {
+                    Downscale(Frame->data[p], Frame->linesize[p], ChromaWidth, ChromaHeight, Depth, Buffer->data[p], Buffer->linesize[p], Width / 2, Height / 2);
+                } else {
+                    for (int y = 0; y < Height / 2; y++)
+                        memset(Buffer->data[p] + y * static_cast<ptrdiff_t>(Buffer->linesize[p]), 128, Width / 2);
+                }
+            }
+
+            Buffer->quality = Encoder->global_quality;
+            if (avcodec_send_frame(Encoder, Buffer) < 0 || avcodec_receive_packet(Encoder, Packet) < 0)
+                throw VideoException("Failed to encode proxy frame");
+
+            Offsets.push_back(GetFilePosition(F));
+            fwrite(Packet->data, 1, Packet->size, F.get());
+            av_packet_unref(Packet);
+            return true;
+        }
+
+        // Writes the offset table which is followed by its own offset at the very end of the file
+        void Finish() {
+            int64_t TableOffset = GetFilePosition(F);
+            WriteInt64(F, static_cast<int64_t>(Offsets.size()));
+            for (const auto &Iter : Offsets)
+                WriteInt64(F, Iter);
+            WriteInt64(F, TableOffset);
+
+            bool Success = !ferror(F.get()) && fflush(F.get()) == 0;
+            F.reset();
+            if (!Success)
+                throw VideoException("Failed to write the proxy file");
+            Finished = true;
+        }
+    };
+}
+
 BestVideoSource::Cache::CacheBlock::CacheBlock(int64_t FrameNumber, AVFrame *Frame) : FrameNumber(FrameNumber), Frame(Frame) {
     for (int i = 0; i < 4; i++)
         if (Frame->buf[i])
@@ -727,6 +1096,7 @@ BestVideoSource::Cache::CacheBlock::~CacheBlock() {
 
 void BestVideoSource::Cache::ApplyMaxSize() {
     while (Size > MaxSize) {
+        BSTraceInstant("cache evict", Data.back().FrameNumber);
         Size -= Data.back().Size;
         Data.pop_back();
     }
@@ -759,40 +1129,90 @@ void BestVideoSource::Cache::CacheFrame(int64_t FrameNumber, AVFrame *Frame) {
     ApplyMaxSize();
 }
 
-BestVideoFrame *BestVideoSource::Cache::GetFrame(int64_t N) {
+BestVideoSource::Cache::CacheBlock *BestVideoSource::Cache::GetBlock(int64_t N) {
     for (auto Iter = Data.begin(); Iter != Data.end(); ++Iter) {
         if (Iter->FrameNumber == N) {
-            AVFrame *F = Iter->Frame;
             Data.splice(Data.begin(), Data, Iter);
-            return new BestVideoFrame(F);
+            return &Data.front();
         }
     }
     return nullptr;
 }
 
-BestVideoSource::BestVideoSource(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress)
-    : Source(SourceFile), HWDevice(HWDeviceName), ExtraHWFrames(ExtraHWFrames), VideoTrack(Track), VariableFormat(VariableFormat), Threads(Threads) {
+BestVideoFrame *BestVideoSource::Cache::GetFrame(int64_t N) {
+    CacheBlock *Block = GetBlock(N);
+    BSTraceInstant(Block ? "cache hit" : "cache miss", N);
+    return Block ? new BestVideoFrame(Block->Frame) : nullptr;
+}
+
+std::shared_ptr<const BestVideoFrame> BestVideoSource::Cache::GetFrameRef(int64_t N) {
+    CacheBlock *Block = GetBlock(N);
+    BSTraceInstant(Block ? "cache hit" : "cache miss", N);
+    if (Block && !Block->Ref)
+        Block->Ref = std::make_shared<const BestVideoFrame>(Block->Frame);
+    return Block ? Block->Ref : nullptr;
+}
+
+BestVideoFrame *BestVideoSource::Cache::GetNearestFrame(int64_t N) {
+    auto Nearest = Data.end();
+    for (auto Iter = Data.begin(); Iter != Data.end(); ++Iter) {
+        if (Nearest == Data.end() || std::abs(Iter->FrameNumber - N) < std::abs(Nearest->FrameNumber - N))
+            Nearest = Iter;
+    }
+    return (Nearest != Data.end()) ? new BestVideoFrame(Nearest->Frame) : nullptr;
+}
+
+BestVideoSource::BestVideoSource(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, bool ComputeStatistics, int ProxyScale, bool SampledHash, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress, SharedPacketReader *IndexPackets)
+    : Source(SourceFile), HWDevice(HWDeviceName), ExtraHWFrames(ExtraHWFrames), VideoTrack(Track), VariableFormat(VariableFormat), Threads(Threads), ComputeStatistics(ComputeStatistics), ProxyScale(ProxyScale), SampledHash(SampledHash) {
     if (LAVFOpts)
         LAVFOptions = *LAVFOpts;
 
     if (ExtraHWFrames < 0)
         throw VideoException("ExtraHWFrames must be 0 or greater");
 
+    if (ProxyScale < 0)
+        throw VideoException("ProxyScale must be 0 or greater");
+
     std::unique_ptr<LWVideoDecoder> Decoder(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions));
 
     Decoder->GetVideoProperties(VP);
     VideoTrack = Decoder->GetTrack();
-    
-    if (!ReadVideoTrackIndex(CachePath.empty() ? SourceFile : CachePath)) {
-        if (!IndexTrack(Progress))
+
+    if (ProxyScale > 0) {
+        ProxyWidth = std::max(2, (VP.Width / ProxyScale) & ~1);
+        ProxyHeight = std::max(2, (VP.Height / ProxyScale) & ~1);
+    }
+
+    const std::string &IndexPath = CachePath.empty() ? SourceFile : CachePath;
+
+    bool IndexLoaded = ReadVideoTrackIndex(IndexPath);
+    BS_PROBE3(video_index_load, VideoTrack, IndexLoaded, TrackIndex.Frames.size());
+
+    if (!IndexLoaded) {
+        TrackIndex = {};
+        BS_PROBE1(video_index_build_start, VideoTrack);
+        bool Indexed = IndexTrack(IndexPath, Progress, IndexPackets);
+        BS_PROBE3(video_index_build_done, VideoTrack, Indexed, TrackIndex.Frames.size());
+        if (!Indexed)
             throw VideoException("Indexing of '" + SourceFile + "' track #" + std::to_string(VideoTrack) + " failed");
 
-        WriteVideoTrackIndex(CachePath.empty() ? SourceFile : CachePath);
+        WriteVideoTrackIndex(IndexPath);
+    } else if (ProxyScale > 0 && !OpenProxyFile(IndexPath)) {
+        // The index is still good so only the proxy has to be created again
+        if (!CreateProxyFile(IndexPath, Progress))
+            throw VideoException("Creating the proxy for '" + SourceFile + "' track #" + std::to_string(VideoTrack) + " failed");
     }
 
+    if (ProxyScale > 0 && !HasProxy() && !OpenProxyFile(IndexPath))
+        throw VideoException("Failed to open the proxy file for '" + SourceFile + "' track #" + std::to_string(VideoTrack));
+
     if (TrackIndex.Frames[0].RepeatPict < 0)
         throw VideoException("Found an unexpected RFF quirk, please submit a bug report and attach the source file");
 
+    for (size_t i = 0; i < TrackIndex.Frames.size(); i++)
+        if (TrackIndex.Frames[i].KeyFrame && TrackIndex.Frames[i].MatchLength == MatchLengthNever)
+            BadSeekLocations.insert(i);
+
     VP.NumFrames = TrackIndex.Frames.size();
     VP.Duration = (TrackIndex.Frames.back().PTS - TrackIndex.Frames.front().PTS) + std::max<int64_t>(1, TrackIndex.LastFrameDuration);
 
@@ -809,24 +1229,120 @@ BestVideoSource::BestVideoSource(const std::string &SourceFile, const std::strin
     Decoders[0] = std::move(Decoder);
 }
 
+BestVideoSource::~BestVideoSource() {
+    if (ProgressiveThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lock(ProgressiveMutex);
+            ProgressiveExit = true;
+        }
+        ProgressiveCondition.notify_one();
+        ProgressiveThread.join();
+    }
+    avcodec_free_context(&ProxyDecoder);
+}
+
 int BestVideoSource::GetTrack() const {
     return VideoTrack;
 }
 
 void BestVideoSource::SetMaxCacheSize(size_t Bytes) {
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
     FrameCache.SetMaxSize(Bytes);
+    PreviewCache.SetMaxSize(Bytes);
 }
 
 void BestVideoSource::SetSeekPreRoll(int64_t Frames) {
     if (Frames < 0 || Frames > 40)
         throw VideoException("SeekPreRoll must be between 0 and 40");
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
     PreRoll = Frames;
 }
 
-bool BestVideoSource::IndexTrack(const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress) {
+void BestVideoSource::SetMaxDecoders(int Count) {
+    if (Count < 1 || Count > MaxVideoSources)
+        throw VideoException("MaxDecoders must be between 1 and " + std::to_string(MaxVideoSources));
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    MaxDecoders = Count;
+    for (int i = MaxDecoders; i < MaxVideoSources; i++)
+        Decoders[i].reset();
+}
+
+void BestVideoSource::CloseDecoders() {
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    FrameCache.Clear();
+    PreviewCache.Clear();
+    for (int i = 0; i < MaxVideoSources; i++) {
+        Decoders[i].reset();
+        PreviewDecoders[i].reset();
+    }
+    KeyFrameDecoder.reset();
+}
+
+void BestVideoSource::SetAccessLog(const std::string &Filename) {
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    RequestLog.reset();
+    if (!Filename.empty()) {
+        RequestLog.reset(new AccessLog(Filename, true, VideoTrack));
+        if (!RequestLog->IsOpen()) {
+            RequestLog.reset();
+            throw VideoException("Couldn't open access log '" + Filename + "' for writing");
+        }
+    }
+}
+
+void BestVideoSource::SetSharedCache(const std::string &Name, size_t Bytes) {
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    SharedCache.reset();
+    if (!Name.empty()) {
+        // Keyed by the index content so different paths to the same file share frames, the hash check on every hit makes collisions harmless
+        XXH3_state_t *hctx = XXH3_createState();
+        XXH3_64bits_reset(hctx);
+        XXH3_64bits_update(hctx, HWDevice.c_str(), HWDevice.size());
+        for (const auto &Iter : TrackIndex.Frames)
+            XXH3_64bits_update(hctx, Iter.Hash.data(), Iter.Hash.size());
+        SharedCacheKey = XXH3_64bits_digest(hctx);
+        XXH3_freeState(hctx);
+        SharedCache.reset(new SharedFrameCache(Name, Bytes));
+    }
+}
+
+BestVideoFrame *BestVideoSource::GetSharedFrame(int64_t N) {
+    AVFrame *F = SharedCache->GetFrame(SharedCacheKey, N);
+    if (!F)
+        return nullptr;
+    if (GetHash(F, SampledHash) != TrackIndex.Frames[N].Hash) {
+        BSDebugPrint("Shared cache frame doesn't match the index", N);
+        av_frame_free(&F);
+        return nullptr;
+    }
+    Counters.SharedCacheHits++;
+    BestVideoFrame *Result = new BestVideoFrame(F);
+    FrameCache.CacheFrame(N, F);
+    return Result;
+}
+
+const DecodeCounters &BestVideoSource::GetDecodeCounters() const {
+    return Counters;
+}
+
+void BestVideoSource::ResetDecodeCounters() {
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    Counters = {};
+}
+
+bool BestVideoSource::IndexTrack(const std::string &CachePath, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress, SharedPacketReader *Packets) {
+    BSTraceSpan Trace("index");
     std::unique_ptr<LWVideoDecoder> Decoder(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions));
+    if (Packets)
+        Decoder->SetSharedPacketReader(Packets);
 
-    int64_t FileSize = Progress ? Decoder->GetSourceSize() : -1;
+    std::unique_ptr<VideoProxyWriter> Proxy;
+    if (ProxyScale > 0) {
+        ProxyFile.reset();
+        Proxy.reset(new VideoProxyWriter(CachePath, VideoTrack, ProxyScale, ProxyWidth, ProxyHeight, GetFileSize(Source)));
+    }
+
+    int64_t FileSize = Progress ? (Packets ? Packets->GetSourceSize() : Decoder->GetSourceSize()) : -1;
 
     TrackIndex.LastFrameDuration = 0;
 
@@ -838,6 +1354,10 @@ bool BestVideoSource::IndexTrack(const std::function<void(int Track, int64_t Cur
     int Height = -1;
     */
 
+    std::unique_ptr<VideoStatisticsCollector> Statistics;
+    if (ComputeStatistics)
+        Statistics.reset(new VideoStatisticsCollector());
+
     while (true) {
         AVFrame *F = Decoder->GetNextFrame();
         if (!F)
@@ -853,21 +1373,101 @@ bool BestVideoSource::IndexTrack(const std::function<void(int Track, int64_t Cur
         */
 
         //if (VariableFormat || (Format == F->format && Width == F->width && Height == F->height)) {
-        TrackIndex.Frames.push_back({ F->pts, F->repeat_pict, !!(F->flags & AV_FRAME_FLAG_KEY), !!(F->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST), GetHash(F) });
+        TrackIndex.Frames.push_back({ F->pts, F->repeat_pict, !!(F->flags & AV_FRAME_FLAG_KEY), !!(F->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST), av_get_picture_type_char(F->pict_type), GetHash(F, SampledHash), 0, GetPacketSize(F) });
         TrackIndex.LastFrameDuration = F->duration;
+        if (Statistics)
+            TrackIndex.Statistics.push_back(Statistics->Process(F));
+        bool ProxySupported = !Proxy || Proxy->Process(F);
         //}
 
         av_frame_free(&F);
+        if (!ProxySupported)
+            throw VideoException("Proxies can only be created from planar YUV and gray formats");
         if (Progress)
             Progress(VideoTrack, Decoder->GetSourcePostion(), FileSize);
     };
 
+    ComputeMatchLengths();
+
+    if (Proxy && !TrackIndex.Frames.empty())
+        Proxy->Finish();
+
     if (Progress)
         Progress(VideoTrack, INT64_MAX, INT64_MAX);
 
     return !TrackIndex.Frames.empty();
 }
 
+bool BestVideoSource::CreateProxyFile(const std::string &CachePath, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress) {
+    BSTraceSpan Trace("proxy");
+    std::unique_ptr<LWVideoDecoder> Decoder(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions));
+    ProxyFile.reset();
+    VideoProxyWriter Proxy(CachePath, VideoTrack, ProxyScale, ProxyWidth, ProxyHeight, GetFileSize(Source));
+
+    int64_t FileSize = Progress ? Decoder->GetSourceSize() : -1;
+    size_t NumFrames = 0;
+
+    while (NumFrames <= TrackIndex.Frames.size()) {
+        AVFrame *F = Decoder->GetNextFrame();
+        if (!F)
+            break;
+        bool ProxySupported = Proxy.Process(F);
+        av_frame_free(&F);
+        if (!ProxySupported)
+            throw VideoException("Proxies can only be created from planar YUV and gray formats");
+        NumFrames++;
+        if (Progress)
+            Progress(VideoTrack, Decoder->GetSourcePostion(), FileSize);
+    }
+
+    // Every proxy frame has to line up with the index
+    if (NumFrames != TrackIndex.Frames.size())
+        return false;
+
+    Proxy.Finish();
+
+    if (Progress)
+        Progress(VideoTrack, INT64_MAX, INT64_MAX);
+
+    return true;
+}
+
+// Finds the shortest run of hashes starting at every keyframe that doesn't occur anywhere else in the track. Candidates
+// are narrowed down one frame at a time so it's cheap unless there are long runs of identical frames.
+void BestVideoSource::ComputeMatchLengths() {
+    auto HashKey = [](const std::array<uint8_t, HashSize> &Hash) {
+        uint64_t Key;
+        static_assert(sizeof(Key) == HashSize);
+        memcpy(&Key, Hash.data(), sizeof(Key));
+        return Key;
+    };
+
+    std::unordered_map<uint64_t, std::vector<int64_t>> Positions;
+    int64_t NumFrames = TrackIndex.Frames.size();
+    for (int64_t i = 0; i < NumFrames; i++)
+        Positions[HashKey(TrackIndex.Frames[i].Hash)].push_back(i);
+
+    std::vector<int64_t> Candidates;
+    for (int64_t K = 0; K < NumFrames; K++) {
+        auto &Frame = TrackIndex.Frames[K];
+        Frame.MatchLength = 0;
+        if (!Frame.KeyFrame)
+            continue;
+
+        Candidates = Positions[HashKey(Frame.Hash)];
+        int64_t Length = 1;
+        while (Candidates.size() > 1 && Length < MaxMatchLength && K + Length < NumFrames) {
+            const auto &Next = TrackIndex.Frames[K + Length].Hash;
+            Candidates.erase(std::remove_if(Candidates.begin(), Candidates.end(), [&](int64_t C) {
+                return C + Length >= NumFrames || TrackIndex.Frames[C + Length].Hash != Next;
+            }), Candidates.end());
+            Length++;
+        }
+
+        Frame.MatchLength = (Candidates.size() == 1) ? static_cast<uint8_t>(Length) : MatchLengthNever;
+    }
+}
+
 const VideoProperties &BestVideoSource::GetVideoProperties() const {
     return VP;
 }
@@ -877,19 +1477,447 @@ const VideoProperties &BestVideoSource::GetVideoProperties() const {
 //    Determine if a decoder is "close" based on whether or not it is already in the optimal zone based on the existing keyframes
 // 2. If a decoder isn't nearby and the seek destination is within the first 100 frames simply start with a fresh decoder to avoid the seek to start issue (technically almost always fresh)
 // 3. Seek with an existing or new decoder. Seek to the nearest keyframe at or before frame N-preroll using PTS. If no such point exists more than 100 frames after the start don't seek.
-//    After seeking match the hash of the decoded frame. For duplicate hashes match a string of up to 10 frame hashes.
+//    After seeking match the hash of the decoded frame. For duplicate hashes match a string of up to 10 frame hashes, or as many as the index says are needed to identify the seek frame.
+//    Keyframes that can't be identified this way at all are never used as seek points.
 // 4. If the frame is determined to not exist, be beyond the target frame to decode or simply in a string of frames that aren't uniquely identifiable by hashes mark the keyframe as unusable and retry seeking to
 //    at least 100 frames earlier.
 // 5. If linear decoding after seeking fails handle it the same way as #4 and flag it as a bad seek point and retry from at least 100 frames earlier.
 
+// Does everything GetFrame() and GetFrameRef() have in common. Returns the cache entry of the frame if it's cached and also sets Decoded
+// if it had to be decoded, a decoded frame that didn't end up in the cache is only returned in Decoded. Has to be called with DecodeMutex held.
+BestVideoSource::Cache::CacheBlock *BestVideoSource::RequestFrame(int64_t N, bool Linear, std::unique_ptr<BestVideoFrame> &Decoded) {
+    Counters.Requests++;
+    BS_PROBE2(video_frame_request, VideoTrack, N);
+    Cache::CacheBlock *Block = FrameCache.GetBlock(N);
+    bool CacheHit = !!Block;
+    BSTraceInstant(CacheHit ? "cache hit" : "cache miss", N);
+    if (CacheHit) {
+        Counters.CacheHits++;
+    } else {
+        if (SharedCache)
+            Decoded.reset(GetSharedFrame(N));
+        if (!Decoded) {
+            Decoded.reset(Linear ? GetFrameLinearInternal(N) : GetFrameInternal(N));
+            if (Decoded && SharedCache)
+                SharedCache->CacheFrame(SharedCacheKey, N, Decoded->GetAVFrame());
+        }
+        // The decoded frame normally ends up in the cache too
+        if (Decoded)
+            Block = FrameCache.GetBlock(N);
+    }
+
+    BS_PROBE4(video_frame_done, VideoTrack, N, CacheHit, Block || Decoded);
+    return Block;
+}
+
 BestVideoFrame *BestVideoSource::GetFrame(int64_t N, bool Linear) {
     if (N < 0 || N >= VP.NumFrames)
         return nullptr;
 
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtVideoFrame, N);
+
+    std::unique_ptr<BestVideoFrame> Decoded;
+    Cache::CacheBlock *Block = RequestFrame(N, Linear, Decoded);
+    if (!Decoded && Block)
+        Decoded.reset(new BestVideoFrame(Block->Frame));
+    return Decoded.release();
+}
+
+std::shared_ptr<const BestVideoFrame> BestVideoSource::GetFrameRef(int64_t N, bool Linear) {
+    if (N < 0 || N >= VP.NumFrames)
+        return nullptr;
+
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtVideoFrame, N);
+
+    std::unique_ptr<BestVideoFrame> Decoded;
+    Cache::CacheBlock *Block = RequestFrame(N, Linear, Decoded);
+    if (!Block)
+        return std::move(Decoded);
+    // A freshly decoded frame becomes the shared one so its properties aren't parsed a second time
+    if (!Block->Ref)
+        Block->Ref = Decoded ? std::move(Decoded) : std::make_shared<const BestVideoFrame>(Block->Frame);
+    return Block->Ref;
+}
+
+void BestVideoSource::SetPreviewOptions(int LowRes, bool SkipLoopFilter, bool SkipIDCT) {
+    if (LowRes < 0 || LowRes > 3)
+        throw VideoException("LowRes must be between 0 and 3");
+
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+    PreviewOptions.clear();
+    if (LowRes > 0)
+        PreviewOptions["lowres"] = std::to_string(LowRes);
+    if (SkipLoopFilter)
+        PreviewOptions["skip_loop_filter"] = "all";
+    if (SkipIDCT)
+        PreviewOptions["skip_idct"] = "nonref";
+
+    PreviewCache.Clear();
+    for (auto &Iter : PreviewDecoders)
+        Iter.reset();
+}
+
+bool BestVideoSource::SeekPreviewDecoder(std::unique_ptr<LWVideoDecoder> &Decoder, int64_t SeekFrame) {
+    if (!Decoder->Seek(TrackIndex.Frames[SeekFrame].PTS))
+        return false;
+
+    AVFrame *Frame = Decoder->GetNextFrame();
+    if (!Frame)
+        return false;
+
+    // Preview frames can't be hash verified so the first frame is identified by a unique PTS match close to the seek point
+    int64_t Match = -1;
+    for (int64_t i = std::max<int64_t>(0, SeekFrame - 100); i < std::min<int64_t>(VP.NumFrames, SeekFrame + 100); i++) {
+        if (TrackIndex.Frames[i].PTS == Frame->pts) {
+            if (Match >= 0) {
+                Match = -1;
+                break;
+            }
+            Match = i;
+        }
+    }
+
+    if (Match < 0) {
+        av_frame_free(&Frame);
+        return false;
+    }
+
+    Decoder->SetFrameNumber(Match + 1);
+    PreviewCache.CacheFrame(Match, Frame);
+    return true;
+}
+
+BestVideoFrame *BestVideoSource::GetPreviewFrame(int64_t N) {
+    if (N < 0 || N >= VP.NumFrames)
+        return nullptr;
+
+    // The preview decoders and cache are also used by the progressive worker
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+
+    std::unique_ptr<BestVideoFrame> F(PreviewCache.GetFrame(N));
+    if (F)
+        return F.release();
+
+    int64_t SeekFrame = GetSeekFrame(N);
+
+    // Use the decoder closest to the frame if it doesn't have to decode further than a seek would
+    int Index = -1;
+    for (int i = 0; i < MaxVideoSources; i++) {
+        if (PreviewDecoders[i] && PreviewDecoders[i]->GetFrameNumber() <= N && (Index < 0 || PreviewDecoders[Index]->GetFrameNumber() < PreviewDecoders[i]->GetFrameNumber()))
+            Index = i;
+    }
+
+    if (Index >= 0 && SeekFrame > PreviewDecoders[Index]->GetFrameNumber())
+        Index = -1;
+
+    if (Index < 0) {
+        Index = 0;
+        for (int i = 0; i < MaxVideoSources; i++) {
+            if (!PreviewDecoders[i]) {
+                Index = i;
+                break;
+            }
+            if (PreviewDecoderLastUse[i] < PreviewDecoderLastUse[Index])
+                Index = i;
+        }
+
+        PreviewDecoders[Index].reset(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions, &PreviewOptions));
+        if (SeekFrame >= 0 && (!SeekPreviewDecoder(PreviewDecoders[Index], SeekFrame) || PreviewDecoders[Index]->GetFrameNumber() > N + 1)) {
+            BSDebugPrint("Preview seek failed, decoding linearly from the start", N, SeekFrame);
+            PreviewDecoders[Index].reset(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions, &PreviewOptions));
+        }
+    }
+
+    PreviewDecoderLastUse[Index] = DecoderSequenceNum++;
+    std::unique_ptr<LWVideoDecoder> &Decoder = PreviewDecoders[Index];
+
+    while (Decoder->GetFrameNumber() <= N) {
+        int64_t FrameNumber = Decoder->GetFrameNumber();
+        if (FrameNumber < N - PreRoll) {
+            if (!Decoder->SkipFrames(1))
+                break;
+            continue;
+        }
+
+        AVFrame *Frame = Decoder->GetNextFrame();
+        if (!Frame)
+            break;
+        PreviewCache.CacheFrame(FrameNumber, Frame);
+    }
+
+    if (!Decoder->HasMoreFrames())
+        Decoder.reset();
+
+    return PreviewCache.GetFrame(N);
+}
+
+std::vector<int64_t> BestVideoSource::GetKeyFrames() const {
+    std::vector<int64_t> Result;
+    for (size_t i = 0; i < TrackIndex.Frames.size(); i++)
+        if (TrackIndex.Frames[i].KeyFrame)
+            Result.push_back(i);
+    return Result;
+}
+
+BestVideoFrame *BestVideoSource::GetKeyFrame(int64_t N) {
+    if (N < 0 || N >= VP.NumFrames || !TrackIndex.Frames[N].KeyFrame)
+        return nullptr;
+
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+
     std::unique_ptr<BestVideoFrame> F(FrameCache.GetFrame(N));
-    if (!F)
-        F.reset(Linear ? GetFrameLinearInternal(N) : GetFrameInternal(N));
+    if (F)
+        return F.release();
+
+    // Same restrictions as for normal seeking, the frame is instead retrieved the normal way
+    if (N < 100 || TrackIndex.Frames[N].PTS == AV_NOPTS_VALUE || BadSeekLocations.count(N))
+        return GetFrame(N);
+
+    // A single thread since frame threading only adds latency when decoding isolated frames
+    if (!KeyFrameDecoder) {
+        std::map<std::string, std::string> CodecOpts = { { "skip_frame", "nokey" } };
+        KeyFrameDecoder.reset(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, 1, LAVFOptions, &CodecOpts));
+    }
+
+    if (KeyFrameDecoder->Seek(TrackIndex.Frames[N].PTS)) {
+        for (int i = 0; i < KeyFrameSearchLimit; i++) {
+            AVFrame *Frame = KeyFrameDecoder->GetNextFrame();
+            if (!Frame)
+                break;
+
+            if (Frame->pts == TrackIndex.Frames[N].PTS) {
+                if (GetHash(Frame, SampledHash) == TrackIndex.Frames[N].Hash)
+                    F.reset(new BestVideoFrame(Frame));
+                av_frame_free(&Frame);
+                break;
+            }
+
+            bool Passed = (Frame->pts > TrackIndex.Frames[N].PTS);
+            av_frame_free(&Frame);
+            if (Passed)
+                break;
+        }
+    }
+
+    if (F)
+        return F.release();
+
+    BSDebugPrint("Keyframe decoding failed, falling back to normal decoding", N);
+    KeyFrameDecoder.reset();
+    return GetFrame(N);
+}
+
+// The seek has to land exactly on N and the frames from there have to be enough to tell the position apart from every other place in the track
+bool BestVideoSource::IsSplitPointSafe(int64_t N, std::unique_ptr<LWVideoDecoder> &Decoder) {
+    if (N == 0)
+        return true;
+    if (N < 100 || TrackIndex.Frames[N].PTS == AV_NOPTS_VALUE || TrackIndex.Frames[N].MatchLength == MatchLengthNever || BadSeekLocations.count(N))
+        return false;
+
+    if (!Decoder)
+        Decoder.reset(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, 1, LAVFOptions));
+
+    if (!Decoder->Seek(TrackIndex.Frames[N].PTS)) {
+        Decoder.reset();
+        return false;
+    }
+
+    // The first decoded frame has to be N itself since a worker starting here with no preroll can't skip anything, and the
+    // frames after it have to identify the position uniquely the same way SeekAndDecode() does with at most the same number of frames
+    int64_t NumFrames = TrackIndex.Frames.size();
+    size_t MatchLimit = std::max<size_t>(DefaultMatchLimit, TrackIndex.Frames[N].MatchLength);
+    std::vector<int64_t> Candidates;
+    for (int64_t Length = 0; Length < static_cast<int64_t>(MatchLimit) && N + Length < NumFrames; Length++) {
+        AVFrame *Frame = Decoder->GetNextFrame();
+        if (!Frame)
+            return false;
+        auto Hash = GetHash(Frame, SampledHash);
+        av_frame_free(&Frame);
+        if (Hash != TrackIndex.Frames[N + Length].Hash)
+            return false;
+
+        if (Length == 0) {
+            for (int64_t i = 0; i < NumFrames; i++)
+                if (TrackIndex.Frames[i].Hash == Hash)
+                    Candidates.push_back(i);
+        } else {
+            Candidates.erase(std::remove_if(Candidates.begin(), Candidates.end(), [&](int64_t C) {
+                return C + Length >= NumFrames || TrackIndex.Frames[C + Length].Hash != Hash;
+            }), Candidates.end());
+        }
+
+        if (Candidates.size() == 1)
+            return true;
+    }
+
+    // Reaching the end of the stream before the limit identifies the position as well since only the end of the track can match then
+    if (N + static_cast<int64_t>(MatchLimit) <= NumFrames)
+        return false;
+    AVFrame *Frame = Decoder->GetNextFrame();
+    if (!Frame)
+        return true;
+    av_frame_free(&Frame);
+    return false;
+}
+
+static double GetFrameDecodeCost(char PictType) {
+    switch (PictType) {
+        case 'I':
+        case 'i':
+            return 2;
+        case 'B':
+        case 'b':
+            return 0.6;
+        default:
+            return 1;
+    }
+}
+
+std::vector<VideoSplitPoint> BestVideoSource::GetSplitPoints(int64_t ChunkFrames, bool Verify) {
+    if (ChunkFrames < 1)
+        throw VideoException("Chunk length must be at least 1 frame");
+
+    std::lock_guard<std::recursive_mutex> Lock(DecodeMutex);
+
+    std::vector<int64_t> Candidates;
+    for (int64_t i = 1; i < VP.NumFrames; i++)
+        if (TrackIndex.Frames[i].KeyFrame && i >= 100 && TrackIndex.Frames[i].PTS != AV_NOPTS_VALUE && !BadSeekLocations.count(i))
+            Candidates.push_back(i);
+
+    std::unique_ptr<LWVideoDecoder> Decoder;
+    std::vector<int64_t> Starts = { 0 };
+    while (Starts.back() + ChunkFrames + ChunkFrames / 2 < VP.NumFrames) {
+        int64_t Boundary = Starts.back() + ChunkFrames;
+        // Try the closest keyframes after the previous start first and only a limited number of them since every verification is a seek
+        auto After = std::lower_bound(Candidates.begin(), Candidates.end(), Boundary);
+        auto Before = After;
+        int64_t Found = -1;
+        for (int Attempts = 0; Attempts < KeyFrameSearchLimit && Found < 0; Attempts++) {
+            bool HasBefore = (Before != Candidates.begin() && *(Before - 1) > Starts.back());
+            bool HasAfter = (After != Candidates.end());
+            if (!HasBefore && !HasAfter)
+                break;
+            int64_t N;
+            if (HasBefore && (!HasAfter || Boundary - *(Before - 1) <= *After - Boundary))
+                N = *--Before;
+            else
+                N = *After++;
+            if (!Verify || IsSplitPointSafe(N, Decoder)) {
+                Found = N;
+            } else {
+                BSDebugPrint("Keyframe isn't safe to split at, added as bad seek location", N);
+                BadSeekLocations.insert(N);
+                Counters.BadSeeks++;
+            }
+        }
+        if (Found < 0)
+            break;
+        Starts.push_back(Found);
+    }
+
+    std::vector<VideoSplitPoint> Result;
+    for (size_t i = 0; i < Starts.size(); i++) {
+        int64_t End = (i + 1 < Starts.size()) ? Starts[i + 1] : VP.NumFrames;
+        double Cost = 0;
+        for (int64_t N = Starts[i]; N < End; N++)
+            Cost += GetFrameDecodeCost(TrackIndex.Frames[N].PictType);
+        Result.push_back({ Starts[i], TrackIndex.Frames[Starts[i]].PTS, End - Starts[i], Cost });
+    }
+    return Result;
+}
+
+void BestVideoSource::ProgressiveWorker() {
+    std::unique_lock<std::mutex> Lock(ProgressiveMutex);
+    while (true) {
+        ProgressiveCondition.wait(Lock, [this] { return ProgressiveExit || ProgressiveRequest >= 0; });
+        if (ProgressiveExit)
+            return;
+
+        int64_t N = ProgressiveRequest;
+        bool KeyFrameFirst = ProgressiveKeyFrame;
+        auto Callback = std::move(ProgressiveCallback);
+        ProgressiveRequest = -1;
+        ProgressiveKeyFrame = false;
+        ProgressiveCallback = nullptr;
+        Lock.unlock();
+
+        if (KeyFrameFirst) {
+            int64_t KeyFrame = N;
+            while (KeyFrame > 0 && !TrackIndex.Frames[KeyFrame].KeyFrame)
+                KeyFrame--;
+
+            if (KeyFrame != N) {
+                BestVideoFrame *Frame = nullptr;
+                try {
+                    Frame = GetKeyFrame(KeyFrame);
+                } catch (std::exception &e) {
+                    BSDebugPrint(std::string("Progressive keyframe decoding failed: ") + e.what(), KeyFrame);
+                } catch (...) {
+                    BSDebugPrint("Progressive keyframe decoding failed", KeyFrame);
+                }
+                if (Frame)
+                    Callback(N, Frame, false);
+
+                // A newer request replaces this one as usual
+                Lock.lock();
+                if (ProgressiveExit || ProgressiveRequest >= 0)
+                    continue;
+                Lock.unlock();
+            }
+        }
+
+        BestVideoFrame *Frame = nullptr;
+        try {
+            Frame = GetFrame(N);
+        } catch (std::exception &e) {
+            BSDebugPrint(std::string("Progressive decoding failed: ") + e.what(), N);
+        } catch (...) {
+            BSDebugPrint("Progressive decoding failed", N);
+        }
+        Callback(N, Frame, true);
+
+        Lock.lock();
+    }
+}
+
+BestVideoFrame *BestVideoSource::GetFrameProgressive(int64_t N, const std::function<void(int64_t N, BestVideoFrame *Frame, bool Exact)> &Callback, bool &Exact) {
+    Exact = false;
+    if (N < 0 || N >= VP.NumFrames)
+        return nullptr;
+
+    std::unique_ptr<BestVideoFrame> F;
 
+    // Only look at the caches when the worker isn't busy, waiting for it would defeat the purpose
+    std::unique_lock<std::recursive_mutex> DecodeLock(DecodeMutex, std::try_to_lock);
+    if (DecodeLock.owns_lock()) {
+        F.reset(FrameCache.GetFrame(N));
+        if (F) {
+            Exact = true;
+            return F.release();
+        }
+    }
+
+    if (HasProxy())
+        F.reset(GetProxyFrame(N));
+
+    if (!F && DecodeLock.owns_lock()) {
+        F.reset(FrameCache.GetNearestFrame(N));
+        if (!F)
+            F.reset(PreviewCache.GetNearestFrame(N));
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(ProgressiveMutex);
+        ProgressiveRequest = N;
+        ProgressiveKeyFrame = !F;
+        ProgressiveCallback = Callback;
+        if (!ProgressiveThread.joinable())
+            ProgressiveThread = std::thread(&BestVideoSource::ProgressiveWorker, this);
+    }
+
+    ProgressiveCondition.notify_one();
     return F.release();
 }
 
@@ -897,6 +1925,8 @@ void BestVideoSource::SetLinearMode() {
     assert(!LinearMode);
     if (!LinearMode) {
         BSDebugPrint("Linear mode is now forced");
+        Counters.LinearFallbacks++;
+        BS_PROBE1(video_linear_mode, VideoTrack);
         LinearMode = true;
         FrameCache.Clear();
         for (size_t i = 0; i < MaxVideoSources; i++)
@@ -924,8 +1954,8 @@ namespace {
             Data.clear();
         }
 
-        void push_back(AVFrame *F) {
-            Data.push_back(std::make_pair(F, GetHash(F)));
+        void push_back(AVFrame *F, bool SampledHash) {
+            Data.push_back(std::make_pair(F, GetHash(F, SampledHash)));
         }
 
         size_t size() {
@@ -954,8 +1984,12 @@ namespace {
 }
 
 BestVideoFrame *BestVideoSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std::unique_ptr<LWVideoDecoder> &Decoder, size_t Depth) {
+    BSTraceSpan Trace("seek", N);
+    BS_PROBE4(video_seek, VideoTrack, N, SeekFrame, Depth);
+    Counters.Seeks++;
     if (!Decoder->Seek(TrackIndex.Frames[SeekFrame].PTS)) {
         BSDebugPrint("Unseekable file", N);
+        BS_PROBE4(video_seek_failed, VideoTrack, N, SeekFrame, Depth);
         SetLinearMode();
         return GetFrameLinearInternal(N);
     }
@@ -964,13 +1998,18 @@ BestVideoFrame *BestVideoSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
 
     while (true) {
         AVFrame *F = Decoder->GetNextFrame();
+        if (F)
+            Counters.DecodedFrames++;
         if (!F && MatchFrames.empty()) {
             BadSeekLocations.insert(SeekFrame);
+            Counters.BadSeeks++;
+            BS_PROBE4(video_seek_failed, VideoTrack, N, SeekFrame, Depth);
             BSDebugPrint("No frame could be decoded after seeking, added as bad seek location", N, SeekFrame);
             if (Depth < RetrySeekAttempts) {
                 int64_t SeekFrameNext = GetSeekFrame(SeekFrame - 100);
                 BSDebugPrint("Retrying seeking with", N, SeekFrameNext);
                 if (SeekFrameNext < 100) { // #2 again
+                    Counters.LinearFallbacks++;
                     Decoder.reset();
                     return GetFrameLinearInternal(N);
                 } else {
@@ -986,7 +2025,7 @@ BestVideoFrame *BestVideoSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
         std::set<int64_t> Matches;
 
         if (F) {
-            MatchFrames.push_back(F);
+            MatchFrames.push_back(F, SampledHash);
 
             for (size_t i = 0; i <= TrackIndex.Frames.size() - MatchFrames.size(); i++) {
                 bool HashMatch = true;
@@ -1010,7 +2049,9 @@ BestVideoFrame *BestVideoSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
             if (iter <= N) // Do we care about preroll or is it just a nice thing to have? With seeking it's a lot less important anyway...
                 SuitableCandidate = true;
 
-        bool UndeterminableLocation = (Matches.size() > 1 && (!F || MatchFrames.size() >= 10));
+        // Landing on the seek frame itself is certain to be identified after MatchLength frames, anywhere else falls back to the default limit
+        size_t MatchLimit = std::max<size_t>(DefaultMatchLimit, (TrackIndex.Frames[SeekFrame].MatchLength != MatchLengthNever) ? TrackIndex.Frames[SeekFrame].MatchLength : 0);
+        bool UndeterminableLocation = (Matches.size() > 1 && (!F || MatchFrames.size() >= MatchLimit));
 
 #ifndef NDEBUG
         if (!SuitableCandidate && Matches.size() > 0)
@@ -1025,11 +2066,14 @@ BestVideoFrame *BestVideoSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
         if (!SuitableCandidate || UndeterminableLocation) {
             BSDebugPrint("No destination frame number could be determined after seeking, added as bad seek location", N, SeekFrame);
             BadSeekLocations.insert(SeekFrame);
+            Counters.BadSeeks++;
+            BS_PROBE4(video_seek_failed, VideoTrack, N, SeekFrame, Depth);
             MatchFrames.clear();
             if (Depth < RetrySeekAttempts) {
                 int64_t SeekFrameNext = GetSeekFrame(SeekFrame - 100);
                 BSDebugPrint("Retrying seeking with", N, SeekFrameNext);
                 if (SeekFrameNext < 100) { // #2 again
+                    Counters.LinearFallbacks++;
                     Decoder.reset();
                     return GetFrameLinearInternal(N);
                 } else {
@@ -1045,6 +2089,7 @@ BestVideoFrame *BestVideoSource::SeekAndDecode(int64_t N, int64_t SeekFrame, std
 
         if (Matches.size() == 1) {
             int64_t MatchedN = *Matches.begin();
+            BS_PROBE4(video_seek_done, VideoTrack, N, SeekFrame, MatchedN);
 
 #ifndef NDEBUG
             if (MatchedN < 100)
@@ -1095,7 +2140,7 @@ BestVideoFrame *BestVideoSource::GetFrameInternal(int64_t N) {
         return GetFrameLinearInternal(N);
 
     // # 1 A suitable linear decoder exists and seeking is out of the question
-    for (int i = 0; i < MaxVideoSources; i++) {
+    for (int i = 0; i < MaxDecoders; i++) {
         if (Decoders[i] && Decoders[i]->GetFrameNumber() <= N && Decoders[i]->GetFrameNumber() >= SeekFrame)
             return GetFrameLinearInternal(N);
     }
@@ -1105,7 +2150,7 @@ BestVideoFrame *BestVideoSource::GetFrameInternal(int64_t N) {
     // Grab/create a new decoder to use for seeking, the position is irrelevant
     int EmptySlot = -1;
     int LeastRecentlyUsed = 0;
-    for (int i = 0; i < MaxVideoSources; i++) {
+    for (int i = 0; i < MaxDecoders; i++) {
         if (!Decoders[i])
             EmptySlot = i;
         if (Decoders[i] && DecoderLastUse[i] < DecoderLastUse[LeastRecentlyUsed])
@@ -1113,8 +2158,10 @@ BestVideoFrame *BestVideoSource::GetFrameInternal(int64_t N) {
     }
 
     int Index = (EmptySlot >= 0) ? EmptySlot : LeastRecentlyUsed;
-    if (!Decoders[Index])
+    if (!Decoders[Index]) {
         Decoders[Index].reset(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions));
+        Counters.DecoderCreations++;
+    }
 
     DecoderLastUse[Index] = DecoderSequenceNum++;
 
@@ -1127,7 +2174,7 @@ BestVideoFrame *BestVideoSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
     int Index = -1;
     int EmptySlot = -1;
     int LeastRecentlyUsed = 0;
-    for (int i = 0; i < MaxVideoSources; i++) {
+    for (int i = 0; i < MaxDecoders; i++) {
         if (Decoders[i] && (!ForceUnseeked || !Decoders[i]->HasSeeked()) && Decoders[i]->GetFrameNumber() <= N && (Index < 0 || Decoders[Index]->GetFrameNumber() < Decoders[i]->GetFrameNumber()))
             Index = i;
         if (!Decoders[i])
@@ -1140,6 +2187,7 @@ BestVideoFrame *BestVideoSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
     if (Index < 0) {
         Index = (EmptySlot >= 0) ? EmptySlot : LeastRecentlyUsed;
         Decoders[Index].reset(new LWVideoDecoder(Source, HWDevice, ExtraHWFrames, VideoTrack, VariableFormat, Threads, LAVFOptions));
+        Counters.DecoderCreations++;
     }
 
     std::unique_ptr<LWVideoDecoder> &Decoder = Decoders[Index];
@@ -1151,22 +2199,26 @@ BestVideoFrame *BestVideoSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
         int64_t FrameNumber = Decoder->GetFrameNumber();
         if (FrameNumber >= N - PreRoll) {
             AVFrame *Frame = Decoder->GetNextFrame();
+            if (Frame)
+                Counters.DecodedFrames++;
 
             // This is the most central sanity check. It primarily exists to catch the case
             // when a decoder has successfully seeked and had its location identified but
             // still returns frames out of order. Possibly open gop related but hard to tell.
 
-            if (!Frame || TrackIndex.Frames[FrameNumber].Hash != GetHash(Frame)) {
+            if (!Frame || TrackIndex.Frames[FrameNumber].Hash != GetHash(Frame, SampledHash)) {
                 av_frame_free(&Frame);
 
                 if (Decoder->HasSeeked()) {
                     BSDebugPrint("Decoded frame does not match hash in GetFrameLinearInternal() or no frame produced at all, added as bad seek location", N, FrameNumber);
                     assert(SeekFrame >= 0);
                     BadSeekLocations.insert(SeekFrame);
+                    Counters.BadSeeks++;
                     if (Depth < RetrySeekAttempts) {
                         int64_t SeekFrameNext = GetSeekFrame(SeekFrame - 100);
                         BSDebugPrint("Retrying seeking with", N, SeekFrameNext);
                         if (SeekFrameNext < 100) { // #2 again
+                            Counters.LinearFallbacks++;
                             Decoder.reset();
                             return GetFrameLinearInternal(N);
                         } else {
@@ -1189,6 +2241,7 @@ BestVideoFrame *BestVideoSource::GetFrameLinearInternal(int64_t N, int64_t SeekF
             FrameCache.CacheFrame(FrameNumber, Frame);
         } else if (FrameNumber < N) {
             Decoder->SkipFrames(N - PreRoll - FrameNumber);
+            Counters.DecodedFrames += Decoder->GetFrameNumber() - FrameNumber;
         }
 
         if (!Decoder->HasMoreFrames())
@@ -1238,6 +2291,7 @@ bool BestVideoSource::InitializeRFF() {
 }
 
 BestVideoFrame *BestVideoSource::GetFrameWithRFF(int64_t N, bool Linear) {
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtVideoFrameRFF, N);
     if (RFFState == rffUninitialized)
         InitializeRFF();
     if (RFFState == rffUnused) {
@@ -1267,6 +2321,11 @@ BestVideoFrame *BestVideoSource::GetFrameWithRFF(int64_t N, bool Linear) {
 }
 
 BestVideoFrame *BestVideoSource::GetFrameByTime(double Time, bool Linear) {
+    int64_t TimeBits;
+    static_assert(sizeof(TimeBits) == sizeof(Time));
+    memcpy(&TimeBits, &Time, sizeof(Time));
+    AccessLogScope LogScope(RequestLog.get(), AccessLog::rtVideoFrameByTime, TimeBits);
+
     int64_t PTS = static_cast<int64_t>(((Time * 1000 * VP.TimeBase.Den) / VP.TimeBase.Num) + .001);
     VideoTrackIndex::FrameInfo F{ PTS };
 
@@ -1287,11 +2346,12 @@ bool BestVideoSource::WriteVideoTrackIndex(const std::string &CachePath) {
     file_ptr_t F = OpenCacheFile(CachePath, VideoTrack, true);
     if (!F)
         return false;
-    WriteBSHeader(F, true);
+    WriteBSHeader(F, true, SampledHash);
     WriteInt64(F, GetFileSize(Source));
     WriteInt(F, VideoTrack);
     WriteInt(F, VariableFormat);
     WriteString(F, HWDevice);
+    WriteInt(F, ComputeStatistics);
 
     WriteInt(F, static_cast<int>(LAVFOptions.size()));
     for (const auto &Iter : LAVFOptions) {
@@ -1306,9 +2366,20 @@ bool BestVideoSource::WriteVideoTrackIndex(const std::string &CachePath) {
         fwrite(Iter.Hash.data(), 1, Iter.Hash.size(), F.get());
         WriteInt64(F, Iter.PTS);
         WriteInt(F, Iter.RepeatPict);
-        WriteInt(F, static_cast<int>(Iter.KeyFrame) | (static_cast<int>(Iter.TFF) << 1));
+        WriteInt(F, static_cast<int>(Iter.KeyFrame) | (static_cast<int>(Iter.TFF) << 1) | (static_cast<int>(static_cast<uint8_t>(Iter.PictType)) << 8) | (static_cast<int>(Iter.MatchLength) << 16));
+    }
+
+    for (const auto &Iter : TrackIndex.Statistics) {
+        WriteInt(F, Iter.LumaMin);
+        WriteInt(F, Iter.LumaMax);
+        WriteDouble(F, Iter.LumaMean);
+        WriteDouble(F, Iter.LumaDiff);
+        fwrite(Iter.Thumbnail.data(), 1, Iter.Thumbnail.size(), F.get());
     }
 
+    for (const auto &Iter : TrackIndex.Frames)
+        WriteInt(F, Iter.PacketSize);
+
     return true;
 }
 
@@ -1316,7 +2387,9 @@ bool BestVideoSource::ReadVideoTrackIndex(const std::string &CachePath) {
     file_ptr_t F = OpenCacheFile(CachePath, VideoTrack, false);
     if (!F)
         return false;
-    if (!ReadBSHeader(F, true))
+    // The hash type of an existing index is always used, SampledHash only decides how new indexes are created
+    bool IndexSampledHash;
+    if (!ReadBSHeader(F, true, &IndexSampledHash))
         return false;
     if (!ReadCompareInt64(F, GetFileSize(Source)))
         return false;
@@ -1326,6 +2399,10 @@ bool BestVideoSource::ReadVideoTrackIndex(const std::string &CachePath) {
         return false;
     if (!ReadCompareString(F, HWDevice))
         return false;
+    // An index with statistics is also good enough when they weren't requested
+    bool IndexHasStatistics = !!ReadInt(F);
+    if (ComputeStatistics && !IndexHasStatistics)
+        return false;
     int LAVFOptCount = ReadInt(F);
     std::map<std::string, std::string> IndexLAVFOptions;
     for (int i = 0; i < LAVFOptCount; i++) {
@@ -1334,7 +2411,16 @@ bool BestVideoSource::ReadVideoTrackIndex(const std::string &CachePath) {
     }
     if (LAVFOptions != IndexLAVFOptions)
         return false;
+    if (!ReadVideoTrackIndexFrames(F, TrackIndex, IndexHasStatistics))
+        return false;
+    SampledHash = IndexSampledHash;
+    return true;
+}
+
+bool BestVideoSource::ReadVideoTrackIndexFrames(file_ptr_t &F, VideoTrackIndex &TrackIndex, bool Statistics) {
     int64_t NumFrames = ReadInt64(F);
+    if (NumFrames < 0)
+        return false;
     TrackIndex.LastFrameDuration = ReadInt64(F);
     TrackIndex.Frames.reserve(NumFrames);
 
@@ -1347,9 +2433,122 @@ bool BestVideoSource::ReadVideoTrackIndex(const std::string &CachePath) {
         int Flags = ReadInt(F);
         FI.KeyFrame = !!(Flags & 1);
         FI.TFF = !!(Flags & 2);
+        FI.PictType = static_cast<char>((Flags >> 8) & 0xFF);
+        if (!FI.PictType)
+            FI.PictType = '?';
+        FI.MatchLength = static_cast<uint8_t>((Flags >> 16) & 0xFF);
         TrackIndex.Frames.push_back(FI);
     }
 
+    if (Statistics) {
+        TrackIndex.Statistics.reserve(NumFrames);
+        for (int i = 0; i < NumFrames; i++) {
+            VideoStatistics VS = {};
+            VS.LumaMin = ReadInt(F);
+            VS.LumaMax = ReadInt(F);
+            VS.LumaMean = ReadDouble(F);
+            VS.LumaDiff = ReadDouble(F);
+            if (fread(VS.Thumbnail.data(), 1, VS.Thumbnail.size(), F.get()) != VS.Thumbnail.size())
+                return false;
+            TrackIndex.Statistics.push_back(VS);
+        }
+    }
+
+    for (auto &Iter : TrackIndex.Frames)
+        Iter.PacketSize = ReadInt(F);
+
+    // The Read* functions return -1 on short reads which are valid values for some fields so a truncated index is only noticed here
+    return !feof(F.get()) && !ferror(F.get());
+}
+
+VideoFrameInfo BestVideoSource::MakeFrameInfo(const VideoTrackIndex &TrackIndex, size_t N) {
+    const auto &Frame = TrackIndex.Frames[N];
+    int64_t Duration = TrackIndex.LastFrameDuration;
+    if (N + 1 < TrackIndex.Frames.size())
+        Duration = (Frame.PTS != AV_NOPTS_VALUE && TrackIndex.Frames[N + 1].PTS != AV_NOPTS_VALUE) ? TrackIndex.Frames[N + 1].PTS - Frame.PTS : -1;
+    return { Frame.PTS, Duration, Frame.RepeatPict, Frame.KeyFrame, Frame.TFF, Frame.PictType, Frame.PacketSize };
+}
+
+VideoFrameInfo BestVideoSource::GetFrameInfo(int64_t N) const {
+    if (N < 0 || N >= VP.NumFrames)
+        throw VideoException("Frame number out of range");
+    return MakeFrameInfo(TrackIndex, N);
+}
+
+// Returns the absolute number of the video track Track refers to or -1 if there's no such track
+static int ResolveVideoTrack(const AVFormatContext *FormatContext, int Track) {
+    if (Track < 0) {
+        for (int i = 0; i < static_cast<int>(FormatContext->nb_streams); i++) {
+            if (FormatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                if (Track == -1)
+                    return i;
+                Track++;
+            }
+        }
+        return -1;
+    }
+    if (Track >= static_cast<int>(FormatContext->nb_streams) || FormatContext->streams[Track]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+        return -1;
+    return Track;
+}
+
+bool BestVideoSource::GetIndexedFrameInfo(const std::string &SourceFile, int Track, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, std::vector<VideoFrameInfo> &FrameInfo, BSRational &TimeBase) {
+    FrameInfo.clear();
+
+    // Only the container header is read to resolve relative track numbers the same way as LWVideoDecoder and to get the time base,
+    // the streams are only probed for formats where they aren't known until packets have been read
+    AVDictionary *Dict = nullptr;
+    if (LAVFOpts)
+        for (const auto &Iter : *LAVFOpts)
+            av_dict_set(&Dict, Iter.first.c_str(), Iter.second.c_str(), 0);
+
+    AVFormatContext *FormatContext = nullptr;
+    int OpenRet = avformat_open_input(&FormatContext, SourceFile.c_str(), nullptr, &Dict);
+    av_dict_free(&Dict);
+    if (OpenRet != 0)
+        throw VideoException("Couldn't open '" + SourceFile + "'");
+
+    int ResolvedTrack = ResolveVideoTrack(FormatContext, Track);
+    if (ResolvedTrack < 0 && (FormatContext->ctx_flags & AVFMTCTX_NOHEADER)) {
+        if (avformat_find_stream_info(FormatContext, nullptr) < 0) {
+            avformat_close_input(&FormatContext);
+            throw VideoException("Couldn't find stream information");
+        }
+        ResolvedTrack = ResolveVideoTrack(FormatContext, Track);
+    }
+
+    if (ResolvedTrack < 0) {
+        avformat_close_input(&FormatContext);
+        throw VideoException("Invalid track index");
+    }
+
+    Track = ResolvedTrack;
+    TimeBase = FormatContext->streams[Track]->time_base;
+    avformat_close_input(&FormatContext);
+
+    // The header is checked like when loading an index except that the options it was created with don't matter
+    file_ptr_t F = OpenCacheFile(CachePath.empty() ? SourceFile : CachePath, Track, false);
+    if (!F)
+        return false;
+    bool IndexSampledHash;
+    if (!ReadBSHeader(F, true, &IndexSampledHash))
+        return false;
+    if (!ReadCompareInt64(F, GetFileSize(SourceFile)) || !ReadCompareInt(F, Track))
+        return false;
+    ReadInt(F); // VariableFormat
+    ReadString(F); // HWDevice
+    bool Statistics = (ReadInt(F) > 0);
+    int LAVFOptCount = ReadInt(F);
+    for (int i = 0; i < LAVFOptCount * 2; i++)
+        ReadString(F);
+
+    VideoTrackIndex TrackIndex;
+    if (!ReadVideoTrackIndexFrames(F, TrackIndex, Statistics) || TrackIndex.Frames.empty())
+        return false;
+
+    FrameInfo.reserve(TrackIndex.Frames.size());
+    for (size_t i = 0; i < TrackIndex.Frames.size(); i++)
+        FrameInfo.push_back(MakeFrameInfo(TrackIndex, i));
     return true;
 }
 
@@ -1367,6 +2566,105 @@ bool BestVideoSource::GetFrameIsTFF(int64_t N, bool RFF) {
     }
 }
 
+bool BestVideoSource::OpenProxyFile(const std::string &CachePath) {
+    ProxyFile = OpenCacheFile(CachePath, VideoTrack, false, "bsproxy");
+    ProxyOffsets.clear();
+    if (ProxyFile && ReadBSHeader(ProxyFile, true) && ReadCompareInt64(ProxyFile, GetFileSize(Source)) && ReadCompareInt(ProxyFile, VideoTrack) &&
+        ReadCompareInt(ProxyFile, ProxyScale) && ReadCompareInt(ProxyFile, ProxyWidth) && ReadCompareInt(ProxyFile, ProxyHeight)) {
+        for (auto &Iter : ProxyColorProperties)
+            Iter = ReadInt(ProxyFile);
+        int64_t DataOffset = GetFilePosition(ProxyFile);
+        int64_t FileSize = GetFileSize(GetCacheFilePath(CachePath, VideoTrack, "bsproxy"));
+        int64_t TableOffset = -1;
+        if (FileSize >= DataOffset + 16 && SetFilePosition(ProxyFile, FileSize - 8))
+            TableOffset = ReadInt64(ProxyFile);
+
+        bool Valid = TableOffset >= DataOffset && TableOffset <= FileSize - 16 && SetFilePosition(ProxyFile, TableOffset) && ReadCompareInt64(ProxyFile, static_cast<int64_t>(TrackIndex.Frames.size()));
+        for (size_t i = 0; i < TrackIndex.Frames.size() && Valid; i++) {
+            ProxyOffsets.push_back(ReadInt64(ProxyFile));
+            Valid = ProxyOffsets.back() >= ((i > 0) ? ProxyOffsets[i - 1] : DataOffset) && ProxyOffsets.back() <= TableOffset;
+        }
+        ProxyOffsets.push_back(TableOffset);
+        Valid = Valid && !feof(ProxyFile.get()) && !ferror(ProxyFile.get());
+
+        if (Valid && !ProxyDecoder) {
+            const AVCodec *Codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+            ProxyDecoder = Codec ? avcodec_alloc_context3(Codec) : nullptr;
+            if (!ProxyDecoder || avcodec_open2(ProxyDecoder, Codec, nullptr) < 0) {
+                avcodec_free_context(&ProxyDecoder);
+                Valid = false;
+            }
+        }
+
+        if (Valid)
+            return true;
+    }
+    ProxyFile.reset();
+    ProxyOffsets.clear();
+    return false;
+}
+
+bool BestVideoSource::HasProxy() const {
+    return !!ProxyFile;
+}
+
+int BestVideoSource::GetProxyWidth() const {
+    return ProxyWidth;
+}
+
+int BestVideoSource::GetProxyHeight() const {
+    return ProxyHeight;
+}
+
+BestVideoFrame *BestVideoSource::GetProxyFrame(int64_t N) {
+    if (!ProxyFile)
+        throw VideoException("No proxy available");
+    if (N < 0 || N >= VP.NumFrames)
+        return nullptr;
+
+    AVFrame *F = av_frame_alloc();
+    AVPacket *Packet = av_packet_alloc();
+    int64_t Size = ProxyOffsets[N + 1] - ProxyOffsets[N];
+    bool Success = F && Packet && Size > 0 && Size <= std::numeric_limits<int>::max() && av_new_packet(Packet, static_cast<int>(Size)) == 0 && SetFilePosition(ProxyFile, ProxyOffsets[N]) &&
+        fread(Packet->data, 1, Packet->size, ProxyFile.get()) == static_cast<size_t>(Packet->size) && avcodec_send_packet(ProxyDecoder, Packet) == 0 && avcodec_receive_frame(ProxyDecoder, F) == 0;
+    av_packet_free(&Packet);
+
+    if (!Success) {
+        av_frame_free(&F);
+        throw VideoException("Failed to read proxy frame " + std::to_string(N));
+    }
+
+    // The decoder considers the images full range JPEG but they hold the source samples unchanged
+    F->format = AV_PIX_FMT_YUV420P;
+    F->colorspace = static_cast<AVColorSpace>(ProxyColorProperties[0]);
+    F->color_primaries = static_cast<AVColorPrimaries>(ProxyColorProperties[1]);
+    F->color_trc = static_cast<AVColorTransferCharacteristic>(ProxyColorProperties[2]);
+    F->chroma_location = static_cast<AVChromaLocation>(ProxyColorProperties[3]);
+    F->color_range = static_cast<AVColorRange>(ProxyColorProperties[4]);
+    F->pts = TrackIndex.Frames[N].PTS;
+    F->repeat_pict = TrackIndex.Frames[N].RepeatPict;
+    F->pict_type = AV_PICTURE_TYPE_I;
+    F->flags |= AV_FRAME_FLAG_KEY;
+    if (TrackIndex.Frames[N].TFF)
+        F->flags |= AV_FRAME_FLAG_TOP_FIELD_FIRST;
+
+    BestVideoFrame *Result = new BestVideoFrame(F);
+    av_frame_free(&F);
+    return Result;
+}
+
+bool BestVideoSource::HasStatistics() const {
+    return !TrackIndex.Statistics.empty();
+}
+
+const VideoStatistics &BestVideoSource::GetFrameStatistics(int64_t N) const {
+    if (!HasStatistics())
+        throw VideoException("Statistics weren't computed when the index was created");
+    if (N < 0 || N >= VP.NumFrames)
+        throw VideoException("Out of bounds frame requested");
+    return TrackIndex.Statistics[N];
+}
+
 bool BestVideoSource::WriteTimecodes(const std::string &TimecodeFile) const {
     file_ptr_t F(OpenFile(TimecodeFile, true));
     if (!F)
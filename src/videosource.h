@@ -32,6 +32,9 @@
 #include <functional>
 #include <array>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 struct AVFormatContext;
 struct AVCodecContext;
@@ -39,6 +42,7 @@ struct AVBufferRef;
 struct AVFrame;
 struct AVPacket;
 struct AVPixFmtDescriptor;
+class SharedFrameCache;
 
 class VideoException : public std::runtime_error {
     using std::runtime_error::runtime_error;
@@ -94,6 +98,34 @@ struct VideoProperties {
     int Rotation; /* A positive number in degrees */
 };
 
+struct VideoStatistics {
+    static constexpr int ThumbnailSize = 8;
+
+    /* All values are in the native sample range of the luma plane, LumaMin and LumaMax are -1 if the frame format isn't supported */
+    int LumaMin;
+    int LumaMax;
+    double LumaMean;
+    double LumaDiff; /* mean absolute luma difference to the previous frame, 0 for the first frame or when the dimensions change */
+    std::array<uint8_t, ThumbnailSize * ThumbnailSize> Thumbnail; /* block averages of the luma plane scaled to 8 bits */
+};
+
+struct VideoFrameInfo {
+    int64_t PTS;
+    int64_t Duration;
+    int RepeatPict;
+    bool KeyFrame;
+    bool TFF;
+    char PictType; /* '?' if unknown */
+    int PacketSize; /* size of the packet the frame was decoded from, -1 if unknown. Only one packet per frame is counted so field pairs and packets without a frame of their own are missing from it */
+};
+
+struct VideoSplitPoint {
+    int64_t Start; /* a keyframe where decoding can start directly after seeking */
+    int64_t PTS;
+    int64_t NumFrames;
+    double Cost; /* estimated decoding cost of the chunk where a P-frame counts as 1 */
+};
+
 struct LWVideoDecoder {
 private:
     AVFormatContext *FormatContext = nullptr;
@@ -107,20 +139,22 @@ private:
     bool DecodeSuccess = true;
     AVPacket *Packet = nullptr;
     bool Seeked = false;
+    SharedPacketReader *SharedPackets = nullptr;
 
-    void OpenFile(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts);
+    void OpenFile(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts, const std::map<std::string, std::string> *CodecOpts);
     bool ReadPacket();
     bool DecodeNextFrame(bool SkipOutput = false);
     void Free();
 public:
-    LWVideoDecoder(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts); // Positive track numbers are absolute. Negative track numbers mean nth audio track to simplify things.
+    LWVideoDecoder(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::map<std::string, std::string> &LAVFOpts, const std::map<std::string, std::string> *CodecOpts = nullptr); // Positive track numbers are absolute. Negative track numbers mean nth audio track to simplify things.
     ~LWVideoDecoder();
     [[nodiscard]] int64_t GetSourceSize() const;
     [[nodiscard]] int64_t GetSourcePostion() const;
     [[nodiscard]] int GetTrack() const; // Useful when opening nth video track to get the actual number
+    void SetSharedPacketReader(SharedPacketReader *Reader); // Packets are read from Reader instead of the decoder's own file from now on, only call directly after creation and never seek afterwards
     [[nodiscard]] int64_t GetFrameNumber() const; // The frame you will get when calling GetNextFrame()
     void SetFrameNumber(int64_t N); // Use after seeking to update internal frame number
-    void GetVideoProperties(VideoProperties &VP); // Decodes one frame and advances the position to retrieve the full properties, only call directly after creation
+    void GetVideoProperties(VideoProperties &VP, AVFrame **FirstFrame = nullptr); // Decodes one frame and advances the position to retrieve the full properties, only call directly after creation, the decoded frame is returned in FirstFrame if set
     [[nodiscard]] AVFrame *GetNextFrame();
     bool SkipFrames(int64_t Count);
     [[nodiscard]] bool HasMoreFrames() const;
@@ -189,27 +223,34 @@ private:
             int RepeatPict;
             bool KeyFrame;
             bool TFF;
+            char PictType; /* '?' if unknown */
             std::array<uint8_t, HashSize> Hash;
+            uint8_t MatchLength; /* keyframes only, the number of frames starting here needed to identify the position from the hashes, 0 if unknown */
+            int PacketSize; /* -1 if unknown */
         };
 
         int64_t LastFrameDuration;
         std::vector<FrameInfo> Frames;
+        std::vector<VideoStatistics> Statistics; /* per frame, empty unless computed during indexing */
     };
 
     bool WriteVideoTrackIndex(const std::string &CachePath);
     bool ReadVideoTrackIndex(const std::string &CachePath);
+    static bool ReadVideoTrackIndexFrames(file_ptr_t &F, VideoTrackIndex &TrackIndex, bool Statistics);
+    static VideoFrameInfo MakeFrameInfo(const VideoTrackIndex &TrackIndex, size_t N);
 
     class Cache {
-    private:
+    public:
         class CacheBlock {
         public:
             int64_t FrameNumber;
             AVFrame *Frame;
+            std::shared_ptr<const BestVideoFrame> Ref; // Created on first access so properties are only parsed once
             size_t Size = 0;
             CacheBlock(int64_t FrameNumber, AVFrame *Frame);
             ~CacheBlock();
         };
-
+    private:
         size_t Size = 0;
         size_t MaxSize = 1024 * 1024 * 1024;
         std::list<CacheBlock> Data;
@@ -218,7 +259,10 @@ private:
         void Clear();
         void SetMaxSize(size_t Bytes);
         void CacheFrame(int64_t FrameNumber, AVFrame *Frame); // Takes ownership of Frame
+        [[nodiscard]] CacheBlock *GetBlock(int64_t N); // Moves the block to the front, nullptr if N isn't cached
         [[nodiscard]] BestVideoFrame *GetFrame(int64_t N);
+        [[nodiscard]] std::shared_ptr<const BestVideoFrame> GetFrameRef(int64_t N);
+        [[nodiscard]] BestVideoFrame *GetNearestFrame(int64_t N); // Doesn't affect the cache order
     };
 
     VideoTrackIndex TrackIndex;
@@ -237,30 +281,104 @@ private:
     int VideoTrack;
     bool VariableFormat;
     int Threads;
+    bool ComputeStatistics;
+    int ProxyScale;
+    bool SampledHash; /* frames are identified by hashes of a subset of their rows which is much faster for big frames, taken from the index when one is loaded */
+    int ProxyWidth = 0;
+    int ProxyHeight = 0;
+    std::vector<int64_t> ProxyOffsets; /* where the image of every frame starts followed by where the last one ends */
+    int ProxyColorProperties[5] = {}; /* matrix, primaries, transfer, chroma location and range of the first frame */
+    file_ptr_t ProxyFile;
+    AVCodecContext *ProxyDecoder = nullptr;
     bool LinearMode = false;
+    int MaxDecoders = MaxVideoSources;
     uint64_t DecoderSequenceNum = 0;
     uint64_t DecoderLastUse[MaxVideoSources] = {};
     std::unique_ptr<LWVideoDecoder> Decoders[MaxVideoSources];
+    std::unique_ptr<LWVideoDecoder> KeyFrameDecoder;
+    DecodeCounters Counters = {};
+    std::unique_ptr<AccessLog> RequestLog;
+    std::unique_ptr<SharedFrameCache> SharedCache;
+    uint64_t SharedCacheKey = 0;
+    std::map<std::string, std::string> PreviewOptions = { { "lowres", "1" }, { "skip_loop_filter", "all" } };
+    Cache PreviewCache;
+    uint64_t PreviewDecoderLastUse[MaxVideoSources] = {};
+    std::unique_ptr<LWVideoDecoder> PreviewDecoders[MaxVideoSources];
+    std::recursive_mutex DecodeMutex; /* guards the normal and preview decoders and frame caches which are shared with the progressive worker */
+    std::thread ProgressiveThread;
+    std::mutex ProgressiveMutex;
+    std::condition_variable ProgressiveCondition;
+    int64_t ProgressiveRequest = -1;
+    bool ProgressiveKeyFrame = false; /* decode the preceding keyframe as an approximation first since nothing else was available */
+    std::function<void(int64_t N, BestVideoFrame *Frame, bool Exact)> ProgressiveCallback;
+    bool ProgressiveExit = false;
+    void ProgressiveWorker();
     int64_t PreRoll = 20;
+    static constexpr int KeyFrameSearchLimit = 10;
     static constexpr size_t RetrySeekAttempts = 10;
+    static constexpr int DefaultMatchLimit = 10; /* frames decoded after seeking before giving up on identifying where it landed */
+    static constexpr uint8_t MaxMatchLength = 64;
+    static constexpr uint8_t MatchLengthNever = 255; /* the keyframe can't be identified within MaxMatchLength frames and is never seeked to */
     std::set<int64_t> BadSeekLocations;
+    void ComputeMatchLengths();
     void SetLinearMode();
     [[nodiscard]] int64_t GetSeekFrame(int64_t N);
     [[nodiscard]] BestVideoFrame *SeekAndDecode(int64_t N, int64_t SeekFrame, std::unique_ptr<LWVideoDecoder> &Decoder, size_t Depth = 0);
+    [[nodiscard]] Cache::CacheBlock *RequestFrame(int64_t N, bool Linear, std::unique_ptr<BestVideoFrame> &Decoded);
     [[nodiscard]] BestVideoFrame *GetFrameInternal(int64_t N);
     [[nodiscard]] BestVideoFrame *GetFrameLinearInternal(int64_t N, int64_t SeekFrame = -1, size_t Depth = 0, bool ForceUnseeked = false);
-    [[nodiscard]] bool IndexTrack(const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    [[nodiscard]] bool IndexTrack(const std::string &CachePath, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr, SharedPacketReader *Packets = nullptr);
     bool InitializeRFF();
+    [[nodiscard]] bool CreateProxyFile(const std::string &CachePath, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    bool OpenProxyFile(const std::string &CachePath);
+    [[nodiscard]] bool SeekPreviewDecoder(std::unique_ptr<LWVideoDecoder> &Decoder, int64_t SeekFrame);
+    [[nodiscard]] bool IsSplitPointSafe(int64_t N, std::unique_ptr<LWVideoDecoder> &Decoder);
+    [[nodiscard]] BestVideoFrame *GetSharedFrame(int64_t N);
+    friend struct BSKernelAccess;
+    friend class BestVideoStreamSource;
 public:
-    BestVideoSource(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr);
+    BestVideoSource(const std::string &SourceFile, const std::string &HWDeviceName, int ExtraHWFrames, int Track, bool VariableFormat, int Threads, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, bool ComputeStatistics, int ProxyScale, bool SampledHash, const std::function<void(int Track, int64_t Current, int64_t Total)> &Progress = nullptr, SharedPacketReader *IndexPackets = nullptr); /* IndexPackets is only used if the track has to be indexed */
+    ~BestVideoSource();
     [[nodiscard]] int GetTrack() const; // Useful when opening nth video track to get the actual number
-    void SetMaxCacheSize(size_t Bytes); /* default max size is 1GB */
+    void SetMaxCacheSize(size_t Bytes); /* default max size is 1GB, applies to the normal and preview caches separately */
     void SetSeekPreRoll(int64_t Frames); /* the number of frames to cache before the position being fast forwarded to */
+    void SetMaxDecoders(int Count); /* the number of decoders kept open at different positions, between 1 and 4, default is 4 */
+    void CloseDecoders(); /* frees all decoders and cached frames, they're recreated by the next request, useful when many sources are kept open */
+    void SetAccessLog(const std::string &Filename); /* records all GetFrame(), GetFrameRef(), GetFrameWithRFF() and GetFrameByTime() requests, pass an empty string to stop, only change it while no requests are in progress */
+    /* Shares decoded frames with other processes of the same user on the same machine through a POSIX shared memory cache of Bytes size identified by Name which must start with /,
+     * only the first process to open it decides the size. Frames are verified against the index before use. Pass an empty name to stop using it. */
+    void SetSharedCache(const std::string &Name, size_t Bytes);
+    [[nodiscard]] const DecodeCounters &GetDecodeCounters() const;
+    void ResetDecodeCounters();
     [[nodiscard]] const VideoProperties &GetVideoProperties() const;
     [[nodiscard]] BestVideoFrame *GetFrame(int64_t N, bool Linear = false);
+    [[nodiscard]] std::shared_ptr<const BestVideoFrame> GetFrameRef(int64_t N, bool Linear = false); /* shares the cached frame instead of creating a new copy for every request */
+    /* Returns the requested frame if it's cached, otherwise the proxy frame or the nearest cached or preview frame, or nullptr, and decodes the exact frame in the background.
+     * The source is never decoded in the calling thread. When there was no approximation the worker first passes the preceding keyframe to Callback with Exact set to false.
+     * Frames are passed to Callback from a worker thread, the callback takes ownership of them and is passed nullptr if decoding failed.
+     * Only the most recent request is processed, older pending requests are dropped without calling their callback. */
+    [[nodiscard]] BestVideoFrame *GetFrameProgressive(int64_t N, const std::function<void(int64_t N, BestVideoFrame *Frame, bool Exact)> &Callback, bool &Exact);
     [[nodiscard]] BestVideoFrame *GetFrameWithRFF(int64_t N, bool Linear = false);
     [[nodiscard]] BestVideoFrame *GetFrameByTime(double Time, bool Linear = false);
     [[nodiscard]] bool GetFrameIsTFF(int64_t N, bool RFF = false);
+    [[nodiscard]] VideoFrameInfo GetFrameInfo(int64_t N) const; /* everything the index knows about a frame, doesn't decode anything */
+    /* Reads the frame information for all frames from an existing index without creating a source or opening a decoder, only the container is
+     * opened to resolve the track and get the time base. The index can have been created with any options. Returns false if there's no up to date index. */
+    [[nodiscard]] static bool GetIndexedFrameInfo(const std::string &SourceFile, int Track, const std::string &CachePath, const std::map<std::string, std::string> *LAVFOpts, std::vector<VideoFrameInfo> &FrameInfo, BSRational &TimeBase);
+    void SetPreviewOptions(int LowRes, bool SkipLoopFilter, bool SkipIDCT); /* lowres divides the resolution by 2^LowRes in codecs that support it, SkipIDCT only applies to non-reference frames, default is LowRes = 1 and SkipLoopFilter */
+    [[nodiscard]] BestVideoFrame *GetPreviewFrame(int64_t N); /* uses separate decoders and cache, frames are identified by PTS only and aren't hash verified */
+    [[nodiscard]] std::vector<int64_t> GetKeyFrames() const;
+    [[nodiscard]] BestVideoFrame *GetKeyFrame(int64_t N); /* only decodes keyframes and skips preroll, intended for thumbnails, returns nullptr if N isn't a keyframe */
+    /* Splits the track into chunks of roughly ChunkFrames frames that all start on keyframes that can be seeked to directly, meant for distributing encodes.
+     * Verify test seeks to every chosen keyframe which is needed to rule out open-GOP and broken keyframes, the ones that fail are avoided from then on.
+     * Set the seek preroll to 0 when decoding a chunk so decoding starts exactly at its first frame. */
+    [[nodiscard]] std::vector<VideoSplitPoint> GetSplitPoints(int64_t ChunkFrames, bool Verify = true);
+    [[nodiscard]] bool HasStatistics() const; /* only true if ComputeStatistics was set when the index was created */
+    [[nodiscard]] const VideoStatistics &GetFrameStatistics(int64_t N) const;
+    [[nodiscard]] bool HasProxy() const; /* a proxy is only available if ProxyScale was set to a value greater than 0 */
+    [[nodiscard]] int GetProxyWidth() const;
+    [[nodiscard]] int GetProxyHeight() const;
+    [[nodiscard]] BestVideoFrame *GetProxyFrame(int64_t N); /* 8 bit 4:2:0 frames downscaled by ProxyScale, reading one only decodes its own small image and never the source */
     bool WriteTimecodes(const std::string &TimecodeFile) const;
 };
 